@@ -18,7 +18,7 @@
 
 #include <string.h>
 extern "C" {
-#include "ptr_queue.h"
+#include "ptr_ring.h"
 #include "rkdrm_display.h"
 #include "rknn_api.h"
 #include "serial_comm.h"
@@ -44,7 +44,13 @@ extern "C" {
 #include "opencv2/imgproc.hpp"
 #include "opencv2/opencv.hpp"
 #include "postprocess.h"
+#include "src/det_pool.h"
+#include "src/model_swap.h"
+#include "src/multires.h"
+#include "src/rga_cache.h"
+#include "src/rknn_profile.h"
 #include "src/rknn_runner.h"
+#include <getopt.h>
 
 #ifdef LOG_TAG
 #undef LOG_TAG
@@ -56,9 +62,6 @@ enum { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG };
 int enable_minilog = 0;
 int rkipc_log_level = LOG_DEBUG;
 
-long long start_time;
-long long end_time;
-
 static int main_loop_run = 1;
 
 int input_width = 1920;
@@ -67,12 +70,72 @@ int output_width = 480;
 int output_height = 480;
 
 static char RKNN_YOLO_MODEL[] = {"/oem/model/yolov5s-640-640.rknn"};
+static char RKNN_YOLO_LABELS[] = {"/oem/model/labels.txt"};
 static char ini_config_file[] = {"/usr/share/yolocam/default.ini"};
 static char remote_host[] = {"192.168.100.11"};
 static int remote_port = 9900;
 static char output_tty[] = {"/dev/ttyS1"};
 static serialport_t serial_port;
 static float serial_min_prop = 0.35;
+// --post-threads N: decode workers for post process, 1 decodes on the post
+// stage itself. rknn_runner_post logs the post time every 100 frames of a
+// model
+static int post_process_threads = 1;
+// --class-activation: whether the anchor free class scores still need the
+// sigmoid, auto guesses it from each tensor's quant params
+static post_activation_e class_activation = POST_ACTIVATION_AUTO;
+// --output-format nc1hwc2 skips the driver conversion to NHWC
+static rknn_tensor_format rknn_output_fmt = RKNN_TENSOR_NHWC;
+// --npu-cores N: npu contexts, one pinned per core: 1 on rv1106, up to 3 on
+// rk3588
+static int rknn_npu_cores = 1;
+// --io-depth N: io sets per context, 2 prepares the next frame while one is
+// on the npu
+static int rknn_io_depth = 2;
+// --fast-model FILE: a low resolution build of the model runs on the frames
+// between full resolution ones, every multires_full_period frames or when
+// the fast model is unsure
+static const char *rknn_fast_model = NULL;
+static int multires_full_period = 10;
+// --full-max-age N: frames the boxes of a full result stay merged into fast
+// results, 0 picks the full period but at least 10
+static int multires_full_max_age = 0;
+// npu weight, internal and io memory from the dma heap, owned here, so the
+// rga handle of each npu input is imported once instead of per frame.
+// --no-mem-outside leaves them to the runtime
+static int rknn_mem_outside = 1;
+// queue the run of the next io set while the npu is still on the previous
+// one (RKNN_FLAG_ASYNC_MASK, rknn_wait), off while profiling or with
+// --no-async
+static int rknn_async = 1;
+// capture hands the npu and the display the newest frame and drops the one
+// still pending, instead of waiting up to 10 ms for a queue slot as with
+// --no-mailbox
+static int frame_mailbox = 1;
+// the display thread converts its frame for the npu too, one rga job with
+// two tasks instead of two jobs reading the same camera frame.
+// --no-rga-batch converts on the rknn thread
+static int rga_batch = 1;
+// --backend mock replays RKNN_YOLO_MODEL as a recording, made on the rknn
+// backend with --record FILE
+static const char *infer_backend_name = "rknn";
+static const char *rknn_record_path = NULL;
+// --mock-latency US: npu time of a mock run, -1 keeps the mock's default
+static int mock_latency_us = -1;
+// --profile FILE: per frame npu time and every profile_period frames the
+// per layer report, as csv rotated at profile_max_bytes (--profile-max-kb)
+static const char *profile_path = NULL;
+static int profile_period = 100;
+static long profile_max_bytes = 4 * 1024 * 1024;
+// SIGUSR1 swaps to the model and labels on the first two lines of this file
+static char model_swap_file[] = {"/tmp/yolocam_model"};
+static volatile sig_atomic_t model_swap_signaled = 0;
+// --warmup N: dummy inferences per io set before a model takes frames, at
+// start too
+static int model_warmup_runs = 3;
+// process start, the first detection is reported relative to it
+static long long startup_start_us = 0;
+static int startup_first_detection = 1;
 
 typedef struct {
   pthread_t rknn_thread;
@@ -80,22 +143,55 @@ typedef struct {
   pthread_t disp_thread;
   pthread_t uart_thread;
   pthread_attr_t attr;
-  ptr_queue_t disp_queue;
-  ptr_queue_t rknn_queue;
-  ptr_queue_t info_queue;
-  ptr_queue_t uart_queue;
+  ptr_ring_t disp_queue;
+  ptr_ring_t rknn_queue;
+  ptr_ring_t info_queue;
+  ptr_ring_t uart_queue;
+  det_pool_t det_pool; /* result groups for the posts */
+  ptr_ring_t npu_request; /* rga_batch: npu input for the display to fill */
+  ptr_ring_t npu_filled;  /* and back to the rknn thread */
   v4l2_device_t *v4l2_device;
-  rknn_runner_t *runner;
+  rknn_runner_pool_t *runner_pool; /* only touched by the rknn thread */
+  rknn_runner_pool_t *fast_pool;   /* NULL without --fast-model */
+  multires_t multires;
+  model_swap_t model_swap;
+  rga_cache_t rga_cache; /* camera and display buffers */
   struct display drm_disp;
 } smart_cam_t;
 
 smart_cam_t smart_cam;
 
+// result groups out of info_queue and uart_queue at once: the display's
+// shown and new group, the one uart sends, and two per post of two models.
+// the pool adds one group per cell of the two queues
+#define DET_GROUP_HELD (2 + 1 + 2 * 2)
+
 static void sig_proc(int signo) {
   LOG_INFO("received signo %d \n", signo);
   main_loop_run = 0;
 }
 
+static void sig_model_swap(int signo) { model_swap_signaled = 1; }
+
+static void model_swap_from_file(const char *path) {
+  char model_path[MODEL_SWAP_PATH_MAX] = {0};
+  char label_path[MODEL_SWAP_PATH_MAX] = {0};
+
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    printf("open model swap file %s failed\n", path);
+    return;
+  }
+  if (fscanf(fp, "%255s %255s", model_path, label_path) != 2) {
+    printf("%s needs a model and a labels path\n", path);
+    fclose(fp);
+    return;
+  }
+  fclose(fp);
+
+  model_swap_request(&smart_cam.model_swap, model_path, label_path);
+}
+
 static int check_sololinker_device() {
   FILE *fp;
   char model[256];
@@ -125,12 +221,12 @@ void v4l2_buffer_recycling(smart_cam_t *cam_ctx) {
   image_pkt_t *img_pkt_rknn = NULL;
   image_pkt_t *img_pkt_disp = NULL;
 
-  img_pkt_rknn = (image_pkt_t *)ptr_queue_dequeue(&cam_ctx->rknn_queue, 1);
+  img_pkt_rknn = (image_pkt_t *)ptr_ring_dequeue(&cam_ctx->rknn_queue, 1);
   if (img_pkt_rknn) {
     image_pkt_unref(img_pkt_rknn);
   }
 
-  img_pkt_disp = (image_pkt_t *)ptr_queue_dequeue(&cam_ctx->disp_queue, 1);
+  img_pkt_disp = (image_pkt_t *)ptr_ring_dequeue(&cam_ctx->disp_queue, 1);
   if (img_pkt_disp) {
     image_pkt_unref(img_pkt_disp);
   }
@@ -172,10 +268,11 @@ int detect_result_to_serialport(serialport_t *port,
     if (det_result->prop < serial_min_prop) {
       continue;
     }
+    const char *name = label_table_name(det_grp->labels, det_result->class_id);
     int formated_len = snprintf(
-        detect_result_str, 256, "$%s,%s,%.1f,%d,%d,%d,%d#\n", time_str,
-        det_result->name, det_result->prop * 100, det_result->box.left,
-        det_result->box.top, det_result->box.right, det_result->box.bottom);
+        detect_result_str, 256, "$%s,%s,%.1f,%d,%d,%d,%d#\n", time_str, name,
+        det_result->prop * 100, det_result->box.left, det_result->box.top,
+        det_result->box.right, det_result->box.bottom);
     serial_send(port, detect_result_str, formated_len);
   }
   // group end
@@ -184,30 +281,45 @@ int detect_result_to_serialport(serialport_t *port,
   return 0;
 }
 
+// a frame pushed out of a mailbox by a newer one goes back to v4l2
+static void frame_drop(void *pkt) { image_pkt_unref((image_pkt_t *)pkt); }
+
+// frames still queued when the threads stopped go back to v4l2 as well
+static void frame_queue_drain(ptr_ring_t *queue) {
+  image_pkt_t *img_pkt;
+  while ((img_pkt = (image_pkt_t *)ptr_ring_dequeue(queue, 0)) != NULL) {
+    image_pkt_unref(img_pkt);
+  }
+}
+
 void *thread_func_v4l2(void *arg) {
   smart_cam_t *cam_ctx = (smart_cam_t *)(arg);
   while (main_loop_run) {
-    image_pkt_t *img_pkt = (image_pkt_t *)malloc(sizeof(image_pkt_t));
-    memset(img_pkt, 0, sizeof(image_pkt_t));
-
-    if (0 != v4l2_device_read(smart_cam.v4l2_device, img_pkt)) {
+    // comes with a reference capture keeps until both are posted, the
+    // display may be done with the frame before the npu gets it
+    image_pkt_t *img_pkt = v4l2_device_dequeue(smart_cam.v4l2_device);
+    if (!img_pkt) {
       // v4l2_buffer_recycling(cam_ctx);
       continue;
     }
 
     image_pkt_ref(img_pkt);
-    if (0 != ptr_queue_enqueue(&cam_ctx->disp_queue, img_pkt, 10)) {
+    if (0 != ptr_ring_enqueue(&cam_ctx->disp_queue, img_pkt, 10)) {
       image_pkt_unref(img_pkt);
     }
 
-    image_pkt_ref(img_pkt);
-    if (0 != ptr_queue_enqueue(&cam_ctx->rknn_queue, img_pkt, 10)) {
-      image_pkt_unref(img_pkt);
+    // batched, the npu gets its frame from the display thread
+    if (!rga_batch) {
+      image_pkt_ref(img_pkt);
+      if (0 != ptr_ring_enqueue(&cam_ctx->rknn_queue, img_pkt, 10)) {
+        image_pkt_unref(img_pkt);
+      }
     }
-  }
 
-  v4l2_device_destroy(cam_ctx->v4l2_device);
+    image_pkt_unref(img_pkt);
+  }
 
+  // the device goes in main, display and npu may still hold its frames
   return NULL;
 }
 
@@ -218,55 +330,167 @@ long long get_timestamp() {
   return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
 }
 
+// square from the top left corner of the camera frame, the model input
+static im_rect rknn_crop_rect() {
+  im_rect rect;
+  rect.x = 0;
+  rect.y = 0;
+  rect.width = (input_width < input_height) ? input_width : input_height;
+  rect.height = rect.width;
+  return rect;
+}
+
+// one npu input on its way, filled by the rknn thread or in rga_batch by
+// the display thread
+typedef struct {
+  npu_pool_t *npu;
+  int slot;
+  rknn_runner_io_t *io;
+  rga_buffer_t img;
+  rga_buffer_handle_t handle;
+  int handle_cached;
+  int filled;
+} rknn_frame_t;
+
+/* submits a filled input to the npu, gives it back otherwise */
+static void rknn_frame_finish(rknn_frame_t *frame) {
+  if (frame->slot >= 0) {
+    if (frame->filled) {
+      npu_pool_submit(frame->npu, frame->slot);
+    } else {
+      npu_pool_cancel(frame->npu, frame->slot);
+    }
+    frame->slot = -1;
+  }
+  if (frame->handle && !frame->handle_cached) {
+    releasebuffer_handle(frame->handle);
+  }
+  frame->handle = 0;
+}
+
+/*
+ * a swap replaces the full model only, the fast one was built for the old
+ * model and its labels, so its boxes would no longer merge. the frames it
+ * still has in flight post first, then the full model runs alone.
+ */
+static void multires_disable(smart_cam_t *cam_ctx) {
+  npu_pool_drain(&cam_ctx->fast_pool->npu);
+  rknn_runner_pool_destroy(cam_ctx->fast_pool);
+  cam_ctx->fast_pool = NULL;
+  multires_cleanup(&cam_ctx->multires);
+  printf("model swap: fast model disabled, the full model runs every "
+         "frame\n");
+}
+
+/* model, context and input for the next frame, -1 if none came free */
+static int rknn_frame_acquire(smart_cam_t *cam_ctx, rknn_frame_t *frame,
+                              unsigned long *frame_seq) {
+  memset(frame, 0, sizeof(rknn_frame_t));
+  frame->slot = -1;
+
+  // a newly loaded model takes over here, between two frames
+  rknn_runner_pool_t *running = cam_ctx->runner_pool;
+  cam_ctx->runner_pool = model_swap_update(&cam_ctx->model_swap, running);
+  if (cam_ctx->fast_pool && cam_ctx->runner_pool != running) {
+    multires_disable(cam_ctx);
+  }
+  if (!cam_ctx->runner_pool) {
+    // no model to run: sleep until one is loaded rather than spin
+    model_swap_wait(&cam_ctx->model_swap, 1000);
+    return -1;
+  }
+
+  frame->npu = &cam_ctx->runner_pool->npu;
+  if (cam_ctx->fast_pool &&
+      multires_pick(&cam_ctx->multires) == MULTIRES_FAST) {
+    frame->npu = &cam_ctx->fast_pool->npu;
+  }
+
+  // next context in order, frees up as soon as its previous frame posted
+  frame->slot = npu_pool_acquire(frame->npu, 1000);
+  if (frame->slot < 0) {
+    return -1;
+  }
+  frame->io = (rknn_runner_io_t *)npu_pool_ctx(frame->npu, frame->slot);
+  frame->io->frame = (*frame_seq)++;
+
+  rknn_runner_t *runner = frame->io->runner;
+  int width = runner->input_attrs[0].dims[2];
+  int height = runner->input_attrs[0].dims[1];
+  if (frame->io->input_bufs) {
+    // imported on first use, released with the runner
+    frame->handle = dma_buffer_rga_handle(&frame->io->input_bufs[0]);
+    frame->handle_cached = 1;
+  } else {
+    frame->handle = importbuffer_fd(frame->io->input_mems[0]->fd,
+                                    frame->io->input_mems[0]->size);
+  }
+  if (frame->handle == 0) {
+    printf("import rknn buffer failed!\n");
+    rknn_frame_finish(frame);
+    return -1;
+  }
+  frame->img =
+      wrapbuffer_handle(frame->handle, width, height, RK_FORMAT_RGB_888);
+
+  return 0;
+}
+
+/*
+ * rga_batch: the input goes to the display thread, which fills it from its
+ * next camera frame in the same rga job as the display conversion, and
+ * comes back here to be submitted. one input is out at a time, so a model
+ * swap never retires a pool the display thread still writes to.
+ */
+static void rknn_frame_batched(smart_cam_t *cam_ctx, rknn_frame_t *frame,
+                               unsigned long *frame_seq) {
+  if (rknn_frame_acquire(cam_ctx, frame, frame_seq) != 0) {
+    return;
+  }
+
+  if (ptr_ring_enqueue(&cam_ctx->npu_request, frame, 100) == 0) {
+    while (!ptr_ring_dequeue(&cam_ctx->npu_filled, 100)) {
+      // on exit take it back, unless the display thread is filling it
+      if (!main_loop_run && ptr_ring_dequeue(&cam_ctx->npu_request, 0)) {
+        break;
+      }
+    }
+  }
+  rknn_frame_finish(frame);
+}
+
 void *thread_func_rknn(void *arg) {
   smart_cam_t *cam_ctx = (smart_cam_t *)(arg);
   int ret = 0;
-  im_rect crop_rect;
-  crop_rect.x = 0;
-  crop_rect.y = 0;
-  crop_rect.width = (input_width < input_height) ? input_width : input_height;
-  crop_rect.height = (input_width < input_height) ? input_width : input_height;
+  im_rect crop_rect = rknn_crop_rect();
+  unsigned long frame_seq = 0;
+  rknn_frame_t frame;
 
   while (main_loop_run) {
     image_pkt_t *img_pkt = NULL;
-    int rknn_width = 0;
-    int rknn_height = 0;
-    int rknn_format = 0;
-    rga_buffer_t rknn_img;
     rga_buffer_t src_img;
     rga_buffer_handle_t src_handle = 0;
-    rga_buffer_handle_t rknn_handle = 0;
-    int src_format = 0;
-    rknn_format = RK_FORMAT_RGB_888;
+    int src_format = RK_FORMAT_YCbCr_420_SP;
+
+    if (rga_batch) {
+      rknn_frame_batched(cam_ctx, &frame, &frame_seq);
+      continue;
+    }
 
     memset(&src_img, 0, sizeof(src_img));
-    memset(&rknn_img, 0, sizeof(rknn_img));
 
-    img_pkt = (image_pkt_t *)ptr_queue_dequeue(&cam_ctx->rknn_queue, 1000);
+    img_pkt = (image_pkt_t *)ptr_ring_dequeue(&cam_ctx->rknn_queue, 1000);
     if (!img_pkt) {
       continue;
     }
 
-    if (!cam_ctx->runner || !cam_ctx->runner->input_attrs) {
+    if (rknn_frame_acquire(cam_ctx, &frame, &frame_seq) != 0) {
       image_pkt_unref(img_pkt);
       continue;
     }
 
-    rknn_width = cam_ctx->runner->input_attrs[0].dims[2];
-    rknn_height = cam_ctx->runner->input_attrs[0].dims[1];
-    rknn_handle = importbuffer_fd(cam_ctx->runner->input_mems[0]->fd,
-                                  cam_ctx->runner->input_mems[0]->size);
-    if (rknn_handle == 0) {
-      printf("import rknn buffer failed!\n");
-      goto release_buffer;
-    }
-
-    rknn_img =
-        wrapbuffer_handle(rknn_handle, rknn_width, rknn_height, rknn_format);
-
-    src_format = RK_FORMAT_YCbCr_420_SP;
-
-    src_handle = importbuffer_fd(img_pkt->dma_fd, img_pkt->size);
+    src_handle = rga_cache_import(&cam_ctx->rga_cache, cam_ctx->v4l2_device,
+                                  img_pkt->dma_fd, img_pkt->size, src_format);
     if (src_handle == 0) {
       printf("import src buffer in rknn failed!\n");
       goto release_buffer;
@@ -275,33 +499,44 @@ void *thread_func_rknn(void *arg) {
     src_img = wrapbuffer_handle(src_handle, img_pkt->width, img_pkt->height,
                                 src_format);
 
-    ret = improcess(src_img, rknn_img, {}, crop_rect, {}, {}, IM_SYNC);
+    ret = improcess(src_img, frame.img, {}, crop_rect, {}, {}, IM_SYNC);
     if (ret != IM_STATUS_SUCCESS) {
       printf("%s running failed, %s\n", LOG_TAG, imStrError((IM_STATUS)ret));
       goto release_buffer;
     }
+    frame.filled = 1;
 
+  release_buffer:
+    rknn_frame_finish(&frame);
     image_pkt_unref(img_pkt);
+  }
 
-    start_time = get_timestamp();
-    rknn_runner_process(cam_ctx->runner, NULL);
-    end_time = get_timestamp();
-    // printf("---->RKNN run time:%lld\n", end_time - start_time);
+  rknn_runner_pool_destroy(cam_ctx->fast_pool);
+  rknn_runner_pool_destroy(cam_ctx->runner_pool);
 
-  release_buffer:
-    if (src_handle) {
-      releasebuffer_handle(src_handle);
-      src_handle = 0;
-    }
-    if (rknn_handle) {
-      releasebuffer_handle(rknn_handle);
-      rknn_handle = 0;
-    }
+  return NULL;
+}
+
+/* npu input and display frame out of one camera frame, one rga submission */
+static IM_STATUS rga_convert_batched(rga_buffer_t src, im_rect npu_rect,
+                                     rga_buffer_t npu_img, im_rect disp_rect,
+                                     rga_buffer_t disp_img) {
+  im_job_handle_t job = imbeginJob();
+  if (job == 0) {
+    return IM_STATUS_FAILED;
   }
 
-  rknn_runner_destroy(cam_ctx->runner);
+  IM_STATUS ret =
+      improcessTask(job, src, npu_img, {}, npu_rect, {}, {}, NULL, 0);
+  if (ret == IM_STATUS_SUCCESS) {
+    ret = improcessTask(job, src, disp_img, {}, disp_rect, {}, {}, NULL, 0);
+  }
+  if (ret != IM_STATUS_SUCCESS) {
+    imcancelJob(job);
+    return ret;
+  }
 
-  return NULL;
+  return imendJob(job, IM_SYNC);
 }
 
 void *thread_func_disp(void *arg) {
@@ -309,9 +544,11 @@ void *thread_func_disp(void *arg) {
   int v4l2_index = 0;
   detect_result_group_t *det_grp = NULL;
   int det_lifespan = 15;
+  im_rect npu_rect = rknn_crop_rect();
 
   while (main_loop_run) {
     image_pkt_t *img_pkt = NULL;
+    rknn_frame_t *npu_frame = NULL;
     detect_result_group_t *new_grp = NULL;
     int src_width, src_height, src_format;
     int disp_width, disp_height, disp_format;
@@ -325,13 +562,13 @@ void *thread_func_disp(void *arg) {
     memset(&src_img, 0, sizeof(src_img));
     memset(&disp_img, 0, sizeof(disp_img));
 
-    img_pkt = (image_pkt_t *)ptr_queue_dequeue(&cam_ctx->disp_queue, 100);
+    img_pkt = (image_pkt_t *)ptr_ring_dequeue(&cam_ctx->disp_queue, 100);
     if (!img_pkt) {
       continue;
     }
 
     new_grp =
-        (detect_result_group_t *)ptr_queue_dequeue(&cam_ctx->info_queue, 10);
+        (detect_result_group_t *)ptr_ring_dequeue(&cam_ctx->info_queue, 10);
 
     src_width = img_pkt->width;
     src_height = img_pkt->height;
@@ -352,14 +589,17 @@ void *thread_func_disp(void *arg) {
     src_buf_size = src_width * src_height * get_bpp_from_format(src_format);
     disp_buf_size = disp_width * disp_height * get_bpp_from_format(disp_format);
 
-    src_handle = importbuffer_fd(img_pkt->dma_fd, src_buf_size);
+    src_handle = rga_cache_import(&cam_ctx->rga_cache, cam_ctx->v4l2_device,
+                                  img_pkt->dma_fd, src_buf_size, src_format);
     if (src_handle == 0) {
       printf("import src buffer failed!\n");
       goto release_buffer;
     }
 
-    disp_handle = importbuffer_fd(cam_ctx->drm_disp.buf[v4l2_index].dmabuf_fd,
-                                  disp_buf_size);
+    disp_handle = rga_cache_import(
+        &cam_ctx->rga_cache, &cam_ctx->drm_disp,
+        cam_ctx->drm_disp.buf[v4l2_index].dmabuf_fd, disp_buf_size,
+        disp_format);
     if (disp_handle == 0) {
       printf("import disp buffer failed!\n");
       goto release_buffer;
@@ -375,16 +615,24 @@ void *thread_func_disp(void *arg) {
       goto release_buffer;
     }
 
-    ret = improcess(src_img, disp_img, {}, crop_rect, {}, {}, IM_SYNC);
+    // an npu input waiting for a frame rides along in the same job
+    if (rga_batch) {
+      npu_frame = (rknn_frame_t *)ptr_ring_dequeue(&cam_ctx->npu_request, 0);
+    }
+    if (npu_frame) {
+      ret = rga_convert_batched(src_img, npu_rect, npu_frame->img, crop_rect,
+                                disp_img);
+      npu_frame->filled = (ret == IM_STATUS_SUCCESS);
+    } else {
+      ret = improcess(src_img, disp_img, {}, crop_rect, {}, {}, IM_SYNC);
+    }
     if (ret != IM_STATUS_SUCCESS) {
       printf("%s running failed, %s\n", LOG_TAG, imStrError((IM_STATUS)ret));
       goto release_buffer;
     }
 
     if (new_grp) {
-      if (det_grp) {
-        delete det_grp;
-      }
+      det_pool_put(&cam_ctx->det_pool, det_grp);
       det_grp = new_grp;
       det_lifespan = 15;
       new_grp = NULL;
@@ -393,7 +641,7 @@ void *thread_func_disp(void *arg) {
     if (det_grp) {
       det_lifespan--;
       if (--det_lifespan <= 0) {
-        delete det_grp;
+        det_pool_put(&cam_ctx->det_pool, det_grp);
         det_grp = NULL;
       } else {
         char text[256];
@@ -402,8 +650,10 @@ void *thread_func_disp(void *arg) {
           if (det_result->prop < 0.35) {
             continue;
           }
-          sprintf(text, "%s %.1f%%", det_result->name, det_result->prop * 100);
-          printf("%s @ (%d %d %d %d) %f\n", det_result->name,
+          const char *name =
+              label_table_name(det_grp->labels, det_result->class_id);
+          sprintf(text, "%s %.1f%%", name, det_result->prop * 100);
+          printf("%s @ (%d %d %d %d) %f\n", name,
                  det_result->box.left, det_result->box.top,
                  det_result->box.right, det_result->box.bottom,
                  det_result->prop);
@@ -425,15 +675,22 @@ void *thread_func_disp(void *arg) {
     if (v4l2_index == BUF_COUNT)
       v4l2_index = 0;
 
-    image_pkt_unref(img_pkt);
-
   release_buffer:
-    if (src_handle)
-      releasebuffer_handle(src_handle);
-    if (disp_handle)
-      releasebuffer_handle(disp_handle);
+    // the rknn thread submits it, or takes it back if the job failed
+    if (npu_frame) {
+      ptr_ring_enqueue(&cam_ctx->npu_filled, npu_frame, 100);
+    }
+    // the camera buffer and the result group go back on errors too, both
+    // are one of a fixed few
+    det_pool_put(&cam_ctx->det_pool, new_grp);
+    image_pkt_unref(img_pkt);
   }
 
+  det_pool_put(&cam_ctx->det_pool, det_grp);
+
+  // the drm buffers outlive this thread, their rga handles do not
+  rga_cache_release(&cam_ctx->rga_cache, &cam_ctx->drm_disp);
+
   return NULL;
 }
 
@@ -444,59 +701,404 @@ void *thread_func_uart(void *arg) {
     detect_result_group_t *new_grp = NULL;
 
     new_grp =
-        (detect_result_group_t *)ptr_queue_dequeue(&cam_ctx->info_queue, 10);
+        (detect_result_group_t *)ptr_ring_dequeue(&cam_ctx->uart_queue, 10);
+    if (!new_grp) {
+      continue;
+    }
     detect_result_to_serialport(&serial_port, new_grp);
 
-    delete new_grp;
+    det_pool_put(&cam_ctx->det_pool, new_grp);
   }
 
   return NULL;
 }
 
+static void det_group_release(detect_result_group_t *group) {
+  det_pool_put(&smart_cam.det_pool, group);
+}
+
 void rknn_runner_post(void *arg) {
+  rknn_runner_io_t *io = NULL;
   rknn_runner_t *runner = NULL;
   const float nms_threshold = NMS_THRESH;
-  const float box_conf_threshold = BOX_THRESH;
 
   if (!arg) {
     return;
   }
-  runner = (rknn_runner_t *)arg;
+  io = (rknn_runner_io_t *)arg;
+  runner = io->runner;
 
+  // taken from the model, a swapped in model may have another input size
   int model_width = 0;
   int model_height = 0;
   if (runner->input_attrs[0].fmt == RKNN_TENSOR_NCHW) {
-    model_width = runner->input_attrs[0].dims[2];
-    model_height = runner->input_attrs[0].dims[3];
-  } else {
-    model_width = runner->input_attrs[0].dims[1];
     model_height = runner->input_attrs[0].dims[2];
+    model_width = runner->input_attrs[0].dims[3];
+  } else {
+    model_height = runner->input_attrs[0].dims[1];
+    model_width = runner->input_attrs[0].dims[2];
   }
   float scale_w = (float)model_width / output_width;
   float scale_h = (float)model_height / output_height;
 
-  detect_result_group_t *detect_result_group = new detect_result_group_t;
-  detect_result_group_t *detect_result_group_s = new detect_result_group_t;
-  std::vector<float> out_scales;
-  std::vector<int32_t> out_zps;
-  for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
-    out_scales.push_back(runner->output_attrs[i].scale);
-    out_zps.push_back(runner->output_attrs[i].zp);
+  // the display and the uart hand the groups back once shown and sent, the
+  // pool has enough that none of them waits here
+  detect_result_group_t *detect_result_group =
+      det_pool_get(&smart_cam.det_pool);
+  detect_result_group_t *detect_result_group_s =
+      det_pool_get(&smart_cam.det_pool);
+  if (!detect_result_group || !detect_result_group_s) {
+    printf("no free result group, frame %lu dropped\n", io->frame);
+    det_group_release(detect_result_group);
+    det_group_release(detect_result_group_s);
+    return;
+  }
+
+  long long post_start = get_timestamp();
+  if (runner->head == YOLO_HEAD_ANCHOR_FREE) {
+    post_tensor_t tensors[POST_TENSOR_MAX];
+    int n_tensor =
+        rknn_runner_get_post_tensors(io, tensors, POST_TENSOR_MAX);
+    post_process_anchor_free(tensors, n_tensor, model_height, model_width,
+                             nms_threshold, scale_w, scale_h,
+                             runner->output_qnts, runner->post_ws,
+                             detect_result_group);
+  } else {
+    post_process((int8_t *)io->output_mems[0]->virt_addr,
+                 (int8_t *)io->output_mems[1]->virt_addr,
+                 (int8_t *)io->output_mems[2]->virt_addr, model_height,
+                 model_width, nms_threshold, scale_w, scale_h,
+                 runner->output_qnts, runner->post_ws, detect_result_group);
+  }
+  long long post_us = get_timestamp() - post_start;
+  detect_result_group->id = io->frame;
+  if (smart_cam.fast_pool) {
+    multires_model_e model =
+        runner->pool == smart_cam.fast_pool ? MULTIRES_FAST : MULTIRES_FULL;
+    if (!multires_merge(&smart_cam.multires, model, detect_result_group)) {
+      det_group_release(detect_result_group);
+      det_group_release(detect_result_group_s);
+      return;
+    }
   }
 
-  post_process((int8_t *)runner->output_mems[0]->virt_addr,
-               (int8_t *)runner->output_mems[1]->virt_addr,
-               (int8_t *)runner->output_mems[2]->virt_addr, 640, 640,
-               box_conf_threshold, nms_threshold, scale_w, scale_h, out_zps,
-               out_scales, detect_result_group);
+  // only the filled results are worth copying
   memcpy(detect_result_group_s, detect_result_group,
-         sizeof(detect_result_group_t));
-  ptr_queue_enqueue(&smart_cam.info_queue, detect_result_group, 10);
-  ptr_queue_enqueue(&smart_cam.uart_queue, detect_result_group_s, 10);
+         offsetof(detect_result_group_t, results) +
+             detect_result_group->count * sizeof(detect_result_t));
+  // a consumer that fell behind misses results, the post stage never waits
+  if (ptr_ring_enqueue(&smart_cam.info_queue, detect_result_group, 0)) {
+    det_group_release(detect_result_group);
+  }
+  if (ptr_ring_enqueue(&smart_cam.uart_queue, detect_result_group_s, 0)) {
+    det_group_release(detect_result_group_s);
+  }
+
+  if (__sync_bool_compare_and_swap(&startup_first_detection, 1, 0)) {
+    printf("startup: first detection after %lld ms\n",
+           (get_timestamp() - startup_start_us) / 1000);
+  }
+
+  // posts of a pool run in frame order on its post thread, so this is the
+  // end to end rate of that model. dropped multires frames are decoded too
+  // but not counted, close enough
+  rknn_runner_pool_report_t report;
+  if (runner->pool &&
+      rknn_runner_pool_report(runner->pool, post_us, 100, &report)) {
+    const char *name = "rknn";
+    if (smart_cam.fast_pool) {
+      name = runner->pool == smart_cam.fast_pool ? "rknn fast" : "rknn full";
+    }
+    // below 100% the npu waits on capture, preprocess or decode
+    printf("%s %.1f fps, npu duty %.0f%%, post %lld us avg %lld us max on "
+           "%d threads\n",
+           name, report.fps, report.duty * 100, report.post_us_avg,
+           report.post_us_max, runner->post_ws->threads);
+  }
+}
+
+/* runner pool for a model, used at start and for every swap */
+static rknn_runner_pool_t *model_pool_load(const char *model_path,
+                                           const char *label_path) {
+  rknn_runner_t *runner =
+      rknn_runner_create((char *)model_path, RKNN_TENSOR_UINT8,
+                         RKNN_TENSOR_NHWC, rknn_output_fmt, rknn_runner_post);
+  if (!runner) {
+    return NULL;
+  }
+
+  if (rknn_runner_load_labels(runner, label_path) != 0) {
+    rknn_runner_destroy(runner);
+    return NULL;
+  }
+
+  rknn_runner_pool_t *pool =
+      rknn_runner_pool_create(runner, rknn_npu_cores, rknn_io_depth);
+  if (!pool) {
+    rknn_runner_destroy(runner);
+    return NULL;
+  }
+
+  for (int i = 0; i < pool->num; i++) {
+    post_process_workspace_set_threads(pool->runners[i]->post_ws,
+                                       post_process_threads);
+  }
+
+  return pool;
+}
+
+/* a subsystem brought up on a thread of its own at start */
+typedef struct {
+  const char *name;
+  int (*init)(smart_cam_t *cam_ctx);
+  pthread_t tid;
+  int ret;
+  long long us;
+} startup_task_t;
+
+static void startup_phase(const char *name, long long start_us) {
+  printf("startup: %-8s %6lld ms\n", name,
+         (get_timestamp() - start_us) / 1000);
+}
+
+static void *startup_task_thread(void *arg) {
+  startup_task_t *task = (startup_task_t *)arg;
+  long long start = get_timestamp();
+  task->ret = task->init(&smart_cam);
+  task->us = get_timestamp() - start;
+  return NULL;
+}
+
+static int startup_drm_init(smart_cam_t *cam_ctx) {
+  memset(&cam_ctx->drm_disp, 0, sizeof(struct display));
+  cam_ctx->drm_disp.fmt = DRM_FORMAT_ARGB8888;
+  cam_ctx->drm_disp.width = output_width;
+  cam_ctx->drm_disp.height = output_height;
+  cam_ctx->drm_disp.plane_type = DRM_PLANE_TYPE_PRIMARY;
+  cam_ctx->drm_disp.buf_cnt = BUF_COUNT;
+  if (drm_display_init(&cam_ctx->drm_disp)) {
+    LOG_ERROR("drm display init failed!\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int startup_v4l2_init(smart_cam_t *cam_ctx) {
+  cam_ctx->v4l2_device =
+      v4l2_device_create("/dev/video11", "NV12", input_width, input_height, 4);
+  if (cam_ctx->v4l2_device == NULL) {
+    LOG_ERROR("create v4l2 device failed!\n");
+    return -1;
+  }
+  return v4l2_device_init(cam_ctx->v4l2_device);
+}
+
+/* a missing model is not fatal, the camera still previews */
+static int startup_npu_init(smart_cam_t *cam_ctx) {
+  cam_ctx->runner_pool = model_pool_load(RKNN_YOLO_MODEL, RKNN_YOLO_LABELS);
+  if (!cam_ctx->runner_pool) {
+    return 0;
+  }
+  if (rknn_record_path) {
+    rknn_runner_record(cam_ctx->runner_pool->runners[0], rknn_record_path);
+  }
+  // lazy driver allocations are paid here rather than on the first frame
+  rknn_runner_pool_warmup(cam_ctx->runner_pool, model_warmup_runs);
+
+  // same labels, boxes of both models merge by class id
+  if (rknn_fast_model) {
+    cam_ctx->fast_pool = model_pool_load(rknn_fast_model, RKNN_YOLO_LABELS);
+    if (cam_ctx->fast_pool) {
+      rknn_runner_pool_warmup(cam_ctx->fast_pool, model_warmup_runs);
+      // with --full-period 0 full frames are rare, their boxes still count
+      int max_age = multires_full_max_age;
+      if (max_age <= 0) {
+        max_age = multires_full_period > 10 ? multires_full_period : 10;
+      }
+      multires_init(&cam_ctx->multires, multires_full_period, BOX_THRESH,
+                    0.5f, max_age);
+    }
+  }
+  return 0;
+}
+
+static void usage(const char *progname) {
+  printf("Usage: %s [options]\n", progname);
+  printf("  -B, --backend mock|rknn     inference backend, rknn by default\n");
+  printf("  -R, --record FILE           record the npu outputs to FILE for the "
+         "mock\n");
+  printf("  -L, --mock-latency US       npu time per run of the mock "
+         "backend\n");
+  printf("  -P, --profile FILE          log npu timing to FILE (csv)\n");
+  printf("  -N, --profile-period N      per layer report every N frames\n");
+  printf("  -F, --fast-model FILE       low resolution model between full "
+         "frames\n");
+  printf("  -C, --full-period N         full model every N frames, 0 only "
+         "when unsure\n");
+  printf("  -A, --full-max-age N        merge full boxes into fast frames for "
+         "N frames\n");
+  printf("  -T, --post-threads N        decode threads per model, 1 by "
+         "default\n");
+  printf("  -S, --class-activation M    anchor free class scores: auto, "
+         "sigmoid or none\n");
+  printf("  -n, --npu-cores N           npu contexts, one per core, at most "
+         "%d\n",
+         RKNN_RUNNER_POOL_MAX);
+  printf("  -M, --profile-max-kb N      rotate the profile csv past N KB\n");
+  printf("  -O, --output-format F       npu output layout: nhwc or nc1hwc2\n");
+  printf("  -D, --io-depth N            io sets per npu context, at most %d\n",
+         RKNN_RUNNER_IO_MAX);
+  printf("  -W, --warmup N              dummy npu runs per io set at load\n");
+  printf("      --no-mem-outside        let the npu runtime allocate its "
+         "memory\n");
+  printf("      --no-async              run the npu synchronously\n");
+  printf("      --no-mailbox            queue camera frames instead of "
+         "keeping the newest\n");
+  printf("      --no-rga-batch          convert the npu input on the rknn "
+         "thread\n");
+  printf("  -?, --help                  show this help\n");
+}
+
+static int parse_args(int argc, char **argv) {
+  static struct option long_options[] = {
+      {"backend", required_argument, 0, 'B'},
+      {"record", required_argument, 0, 'R'},
+      {"mock-latency", required_argument, 0, 'L'},
+      {"profile", required_argument, 0, 'P'},
+      {"profile-period", required_argument, 0, 'N'},
+      {"fast-model", required_argument, 0, 'F'},
+      {"full-period", required_argument, 0, 'C'},
+      {"full-max-age", required_argument, 0, 'A'},
+      {"post-threads", required_argument, 0, 'T'},
+      {"class-activation", required_argument, 0, 'S'},
+      {"npu-cores", required_argument, 0, 'n'},
+      {"profile-max-kb", required_argument, 0, 'M'},
+      {"output-format", required_argument, 0, 'O'},
+      {"io-depth", required_argument, 0, 'D'},
+      {"warmup", required_argument, 0, 'W'},
+      {"no-mem-outside", no_argument, &rknn_mem_outside, 0},
+      {"no-async", no_argument, &rknn_async, 0},
+      {"no-mailbox", no_argument, &frame_mailbox, 0},
+      {"no-rga-batch", no_argument, &rga_batch, 0},
+      {"help", no_argument, 0, '?'},
+      {0, 0, 0, 0}};
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "B:R:L:P:N:F:C:A:T:S:n:M:O:D:W:?",
+                            long_options, NULL)) != -1) {
+    switch (opt) {
+    case 0:
+      // a --no-* switch, getopt_long cleared its flag
+      break;
+    case 'B':
+      infer_backend_name = optarg;
+      break;
+    case 'R':
+      rknn_record_path = optarg;
+      break;
+    case 'L':
+      mock_latency_us = atoi(optarg);
+      break;
+    case 'P':
+      profile_path = optarg;
+      break;
+    case 'N':
+      profile_period = atoi(optarg);
+      break;
+    case 'F':
+      rknn_fast_model = optarg;
+      break;
+    case 'C':
+      multires_full_period = atoi(optarg);
+      break;
+    case 'A':
+      multires_full_max_age = atoi(optarg);
+      break;
+    case 'T':
+      post_process_threads = atoi(optarg);
+      if (post_process_threads < 1) {
+        printf("--post-threads needs at least 1\n");
+        return -1;
+      }
+      break;
+    case 'S':
+      if (strcmp(optarg, "auto") == 0) {
+        class_activation = POST_ACTIVATION_AUTO;
+      } else if (strcmp(optarg, "sigmoid") == 0) {
+        class_activation = POST_ACTIVATION_SIGMOID;
+      } else if (strcmp(optarg, "none") == 0) {
+        class_activation = POST_ACTIVATION_NONE;
+      } else {
+        printf("--class-activation is auto, sigmoid or none\n");
+        return -1;
+      }
+      break;
+    case 'n':
+      rknn_npu_cores = atoi(optarg);
+      if (rknn_npu_cores < 1) {
+        printf("--npu-cores needs at least 1\n");
+        return -1;
+      }
+      if (rknn_npu_cores > RKNN_RUNNER_POOL_MAX) {
+        printf("--npu-cores %d, using %d\n", rknn_npu_cores,
+               RKNN_RUNNER_POOL_MAX);
+        rknn_npu_cores = RKNN_RUNNER_POOL_MAX;
+      }
+      break;
+    case 'M':
+      profile_max_bytes = atol(optarg) * 1024;
+      if (profile_max_bytes <= 0) {
+        printf("--profile-max-kb needs at least 1\n");
+        return -1;
+      }
+      break;
+    case 'O':
+      if (strcmp(optarg, "nhwc") == 0) {
+        rknn_output_fmt = RKNN_TENSOR_NHWC;
+      } else if (strcmp(optarg, "nc1hwc2") == 0) {
+        rknn_output_fmt = RKNN_TENSOR_NC1HWC2;
+      } else {
+        printf("--output-format is nhwc or nc1hwc2\n");
+        return -1;
+      }
+      break;
+    case 'D':
+      rknn_io_depth = atoi(optarg);
+      if (rknn_io_depth < 1 || rknn_io_depth > RKNN_RUNNER_IO_MAX) {
+        printf("--io-depth is 1 to %d\n", RKNN_RUNNER_IO_MAX);
+        return -1;
+      }
+      break;
+    case 'W':
+      model_warmup_runs = atoi(optarg);
+      if (model_warmup_runs < 0) {
+        printf("--warmup needs at least 0\n");
+        return -1;
+      }
+      break;
+    default:
+      usage(argv[0]);
+      return -1;
+    }
+  }
+
+  return 0;
 }
 
 int main(int argc, char **argv) {
   int ret = -1;
+  long long phase_start = get_timestamp();
+  startup_task_t startup_tasks[] = {
+      {"drm", startup_drm_init},
+      {"v4l2", startup_v4l2_init},
+      {"npu", startup_npu_init},
+  };
+  int startup_task_num = sizeof(startup_tasks) / sizeof(startup_tasks[0]);
+
+  startup_start_us = phase_start;
+  if (parse_args(argc, argv) != 0) {
+    return 1;
+  }
 
   if (0 != check_sololinker_device()) {
     LOG_ERROR("Envirement init failed!\n");
@@ -518,36 +1120,71 @@ int main(int argc, char **argv) {
     return ret;
   }
 
-  smart_cam.runner = rknn_runner_create(RKNN_YOLO_MODEL, rknn_runner_post);
-  signal(SIGINT, sig_proc);
+  if (infer_backend_select(infer_backend_name) != 0) {
+    return 1;
+  }
+  if (mock_latency_us >= 0) {
+    infer_backend_mock_set_latency(mock_latency_us);
+  }
+  rknn_runner_set_mem_outside(rknn_mem_outside);
+  rknn_runner_set_async(rknn_async);
+  post_process_set_class_activation(class_activation);
+  if (profile_path) {
+    rknn_profile_open(profile_path, profile_period, profile_max_bytes);
+  }
+  startup_phase("serial+rga", phase_start);
 
   LOG_INFO("input_width is %d, input_height is %d\n", input_width,
            input_height);
 
-  memset(&smart_cam.drm_disp, 0, sizeof(struct display));
-  smart_cam.drm_disp.fmt = DRM_FORMAT_ARGB8888;
-  smart_cam.drm_disp.width = output_width;
-  smart_cam.drm_disp.height = output_height;
-  smart_cam.drm_disp.plane_type = DRM_PLANE_TYPE_PRIMARY;
-  smart_cam.drm_disp.buf_cnt = BUF_COUNT;
-  ret = drm_display_init(&smart_cam.drm_disp);
+  // display, camera and npu do not depend on each other, the slowest one
+  // (usually rknn_init plus warm up) sets the start time
+  phase_start = get_timestamp();
+  for (int i = 0; i < startup_task_num; i++) {
+    if (pthread_create(&startup_tasks[i].tid, NULL, startup_task_thread,
+                       &startup_tasks[i]) != 0) {
+      startup_tasks[i].tid = 0;
+      startup_task_thread(&startup_tasks[i]);
+    }
+  }
+  ret = 0;
+  for (int i = 0; i < startup_task_num; i++) {
+    if (startup_tasks[i].tid) {
+      pthread_join(startup_tasks[i].tid, NULL);
+    }
+    printf("startup: %-8s %6lld ms%s\n", startup_tasks[i].name,
+           startup_tasks[i].us / 1000, startup_tasks[i].ret ? " failed" : "");
+    if (startup_tasks[i].ret) {
+      ret = -1;
+    }
+  }
+  startup_phase("parallel", phase_start);
   if (ret) {
-    LOG_ERROR("drm display init failed!\n");
     return ret;
   }
 
-  smart_cam.v4l2_device =
-      v4l2_device_create("/dev/video11", "NV12", input_width, input_height, 4);
-  v4l2_device_init(smart_cam.v4l2_device);
-  if (smart_cam.v4l2_device == NULL) {
-    LOG_ERROR("create v4l2 device failed!\n");
+  model_swap_init(&smart_cam.model_swap, model_pool_load, model_warmup_runs);
+  signal(SIGINT, sig_proc);
+  signal(SIGUSR1, sig_model_swap);
+
+  rga_cache_init(&smart_cam.rga_cache);
+  if (frame_mailbox) {
+    ret = ptr_ring_init_mailbox(&smart_cam.disp_queue, 1, frame_drop) ||
+          ptr_ring_init_mailbox(&smart_cam.rknn_queue, 1, frame_drop);
+  } else {
+    ret = ptr_ring_init(&smart_cam.disp_queue, 4) ||
+          ptr_ring_init(&smart_cam.rknn_queue, 2);
+  }
+  if (ret || ptr_ring_init(&smart_cam.npu_request, 2) ||
+      ptr_ring_init(&smart_cam.npu_filled, 2) ||
+      ptr_ring_init(&smart_cam.info_queue, 5) ||
+      ptr_ring_init(&smart_cam.uart_queue, 10)) {
+    return -1;
+  }
+  ptr_ring_t *det_queues[] = {&smart_cam.info_queue, &smart_cam.uart_queue};
+  if (det_pool_init(&smart_cam.det_pool, det_queues, 2, DET_GROUP_HELD) != 0) {
     return -1;
   }
-
-  ptr_queue_init(&smart_cam.disp_queue, 4);
-  ptr_queue_init(&smart_cam.rknn_queue, 2);
-  ptr_queue_init(&smart_cam.info_queue, 5);
-  ptr_queue_init(&smart_cam.uart_queue, 10);
 
   struct sched_param param;
   pthread_attr_init(&smart_cam.attr);
@@ -560,9 +1197,14 @@ int main(int argc, char **argv) {
   pthread_create(&smart_cam.rknn_thread, NULL, thread_func_rknn, &smart_cam);
   pthread_create(&smart_cam.disp_thread, NULL, thread_func_disp, &smart_cam);
   pthread_create(&smart_cam.uart_thread, NULL, thread_func_uart, &smart_cam);
+  startup_phase("total", startup_start_us);
 
   while (main_loop_run) {
     sleep(1);
+    if (model_swap_signaled) {
+      model_swap_signaled = 0;
+      model_swap_from_file(model_swap_file);
+    }
   }
 
   pthread_join(smart_cam.v4l2_thread, NULL);
@@ -570,10 +1212,32 @@ int main(int argc, char **argv) {
   pthread_join(smart_cam.disp_thread, NULL);
   pthread_join(smart_cam.uart_thread, NULL);
 
-  ptr_queue_cleanup(&smart_cam.disp_queue);
-  ptr_queue_cleanup(&smart_cam.rknn_queue);
-  ptr_queue_cleanup(&smart_cam.info_queue);
-  ptr_queue_cleanup(&smart_cam.uart_queue);
+  // the capture buffers hold the frame packets, every reference is dropped
+  // before they go
+  frame_queue_drain(&smart_cam.disp_queue);
+  frame_queue_drain(&smart_cam.rknn_queue);
+  rga_cache_release(&smart_cam.rga_cache, smart_cam.v4l2_device);
+  v4l2_device_destroy(smart_cam.v4l2_device);
+
+  ptr_ring_cleanup(&smart_cam.disp_queue);
+  ptr_ring_cleanup(&smart_cam.rknn_queue);
+  ptr_ring_cleanup(&smart_cam.info_queue);
+  ptr_ring_cleanup(&smart_cam.uart_queue);
+  det_pool_cleanup(&smart_cam.det_pool);
+  ptr_ring_cleanup(&smart_cam.npu_request);
+  ptr_ring_cleanup(&smart_cam.npu_filled);
+  // camera and display released theirs already, prints the hit rate
+  rga_cache_cleanup(&smart_cam.rga_cache);
+
+  // pools loaded or swapped out after the rknn thread stopped
+  model_swap_cleanup(&smart_cam.model_swap);
+  if (smart_cam.fast_pool) {
+    multires_cleanup(&smart_cam.multires);
+  }
+
+  // the runners are gone with the rknn thread, print the summary
+  rknn_profile_close();
+  label_table_cleanup();
 
   return 0;
 }
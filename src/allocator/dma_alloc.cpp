@@ -48,6 +48,7 @@
 
 #include "dma_alloc.h"
 #include "rga/RgaUtils.h"
+#include "rga/im2d.hpp"
 
 
 typedef unsigned long long __u64;
@@ -80,8 +81,10 @@ struct dma_buf_sync {
 #define CMA_HEAP_PATH	"/dev/rk_dma_heap/rk-dma-heap-cma"
 #define CMA_HEAP_SIZE	1024 * 1024
 
-int cma_heap_fd = -1;
+static int cma_heap_fd = -1;
+static pthread_mutex_t cma_heap_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* begins cpu access to a dma-buf, invalidates what the device wrote */
 int dma_sync_device_to_cpu(int fd) {
     struct dma_buf_sync sync = {0};
 
@@ -89,6 +92,7 @@ int dma_sync_device_to_cpu(int fd) {
     return ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
 }
 
+/* ends the cpu access begun above, flushes what the cpu wrote */
 int dma_sync_cpu_to_device(int fd) {
     struct dma_buf_sync sync = {0};
 
@@ -96,27 +100,32 @@ int dma_sync_cpu_to_device(int fd) {
     return ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
 }
 
-int dma_buf_alloc(int width, int height, int format, int *fd, void **va) {
+static int dma_heap_alloc(size_t len, int *fd, void **va) {
     int ret;
     int prot;
     void *mmap_va;
     struct dma_heap_allocation_data buf_data;
 
-    /* open cma fd */
+    /* open cma fd, once for runners set up in parallel */
+    pthread_mutex_lock(&cma_heap_lock);
     if (cma_heap_fd < 0) {
-        cma_heap_fd = open(CMA_HEAP_PATH, O_RDWR);
+        cma_heap_fd = open(CMA_HEAP_PATH, O_RDWR | O_CLOEXEC);
         if (cma_heap_fd < 0) {
             printf("open %s fail!\n", CMA_HEAP_PATH);
-            return cma_heap_fd;
         }
     }
+    int heap_fd = cma_heap_fd;
+    pthread_mutex_unlock(&cma_heap_lock);
+    if (heap_fd < 0) {
+        return heap_fd;
+    }
 
     /* alloc buffer */
     memset(&buf_data, 0x0, sizeof(struct dma_heap_allocation_data));
 
-    buf_data.len = width * height * get_bpp_from_format(format);
+    buf_data.len = len;
     buf_data.fd_flags = O_CLOEXEC | O_RDWR;
-    ret = ioctl(cma_heap_fd, DMA_HEAP_IOCTL_ALLOC, &buf_data);
+    ret = ioctl(heap_fd, DMA_HEAP_IOCTL_ALLOC, &buf_data);
     if (ret < 0) {
         printf("RK_DMA_HEAP_ALLOC_BUFFER failed\n");
         return ret;
@@ -131,8 +140,10 @@ int dma_buf_alloc(int width, int height, int format, int *fd, void **va) {
     /* mmap contiguors buffer to user */
     mmap_va = (void *)mmap(NULL, buf_data.len, prot, MAP_SHARED, buf_data.fd, 0);
     if (mmap_va == MAP_FAILED) {
+        ret = -errno;
         printf("mmap failed: %s\n", strerror(errno));
-        return -errno;
+        close(buf_data.fd);
+        return ret;
     }
 
     *va = mmap_va;
@@ -141,6 +152,12 @@ int dma_buf_alloc(int width, int height, int format, int *fd, void **va) {
     return 0;
 }
 
+int dma_buf_alloc(int width, int height, int format, int *fd, void **va) {
+    size_t len = width * height * get_bpp_from_format(format);
+
+    return dma_heap_alloc(len, fd, va);
+}
+
 void dma_buf_free(int width, int height, int format, int *fd, void *va) {
     int len;
 
@@ -151,5 +168,41 @@ void dma_buf_free(int width, int height, int format, int *fd, void *va) {
     *fd = -1;
 }
 
+int dma_buffer_alloc(dma_buffer_t *buf, size_t size) {
+    memset(buf, 0, sizeof(dma_buffer_t));
+    buf->fd = -1;
+
+    int ret = dma_heap_alloc(size, &buf->fd, &buf->va);
+    if (ret < 0) {
+        buf->fd = -1;
+        return ret;
+    }
+    buf->size = size;
+
+    return 0;
+}
+
+void dma_buffer_free(dma_buffer_t *buf) {
+    if (buf->rga_handle) {
+        releasebuffer_handle(buf->rga_handle);
+        buf->rga_handle = 0;
+    }
+
+    if (buf->size) {
+        munmap(buf->va, buf->size);
+        close(buf->fd);
+        buf->fd = -1;
+        buf->size = 0;
+    }
+}
+
+uint32_t dma_buffer_rga_handle(dma_buffer_t *buf) {
+    if (!buf->rga_handle && buf->size) {
+        buf->rga_handle = importbuffer_fd(buf->fd, buf->size);
+    }
+
+    return buf->rga_handle;
+}
+
 
 
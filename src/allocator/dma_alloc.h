@@ -25,4 +25,23 @@ int dma_sync_cpu_to_device(int fd);
 int dma_buf_alloc(int width, int height, int format, int *fd, void **va);
 void dma_buf_free(int width, int height, int format, int *fd, void *va);
 
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * a cma heap buffer owned by the application. the same fd backs npu tensors
+ * (rknn_create_mem_from_fd) and rga jobs, the rga handle is imported on
+ * first use and released with the buffer. size is 0 until allocated.
+ */
+typedef struct {
+    int fd;
+    void *va;
+    size_t size;
+    uint32_t rga_handle;
+} dma_buffer_t;
+
+int dma_buffer_alloc(dma_buffer_t *buf, size_t size);
+void dma_buffer_free(dma_buffer_t *buf);
+uint32_t dma_buffer_rga_handle(dma_buffer_t *buf);
+
 #endif
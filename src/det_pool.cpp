@@ -0,0 +1,48 @@
+#include "det_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+int det_pool_init(det_pool_t *pool, ptr_ring_t *const *queues, int n_queue,
+                  int held) {
+  // a ring holds its rounded up capacity, not the size it was asked for
+  int num = held;
+  for (int i = 0; i < n_queue; i++) {
+    num += ptr_ring_capacity(queues[i]);
+  }
+
+  pool->groups =
+      (detect_result_group_t *)calloc(num, sizeof(detect_result_group_t));
+  if (!pool->groups) {
+    printf("allocate %d result groups oom\n", num);
+    return -1;
+  }
+  if (ptr_ring_init(&pool->free, num) != 0) {
+    free(pool->groups);
+    pool->groups = NULL;
+    return -1;
+  }
+  pool->num = num;
+  for (int i = 0; i < num; i++) {
+    ptr_ring_enqueue(&pool->free, &pool->groups[i], 0);
+  }
+
+  return 0;
+}
+
+void det_pool_cleanup(det_pool_t *pool) {
+  ptr_ring_cleanup(&pool->free);
+  free(pool->groups);
+  pool->groups = NULL;
+  pool->num = 0;
+}
+
+detect_result_group_t *det_pool_get(det_pool_t *pool) {
+  return (detect_result_group_t *)ptr_ring_dequeue(&pool->free, 0);
+}
+
+void det_pool_put(det_pool_t *pool, detect_result_group_t *group) {
+  if (group) {
+    ptr_ring_enqueue(&pool->free, group, 0);
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef __DET_POOL_H__
+#define __DET_POOL_H__
+
+#include "postprocess.h"
+#include "ptr_ring.h"
+
+/*
+ * result groups the posts hand to the display and the uart. there is one
+ * for every cell of the queues they wait in and every group held outside
+ * them, so a post finds a free group even when every consumer is stalled,
+ * and never waits for one.
+ */
+typedef struct {
+  detect_result_group_t *groups;
+  int num;
+  ptr_ring_t free;
+} det_pool_t;
+
+/* queues: what the groups are posted to, held: groups out of them at once */
+int det_pool_init(det_pool_t *pool, ptr_ring_t *const *queues, int n_queue,
+                  int held);
+void det_pool_cleanup(det_pool_t *pool);
+
+/* NULL when every group is taken, which the sizing rules out */
+detect_result_group_t *det_pool_get(det_pool_t *pool);
+void det_pool_put(det_pool_t *pool, detect_result_group_t *group);
+
+#endif /*__DET_POOL_H__*/
@@ -6,10 +6,14 @@ void image_pkt_unref(image_pkt_t *img_pkt) {
     return;
   }
   if (__sync_sub_and_fetch(&img_pkt->ref_count, 1) == 0) {
+    // a pooled packet may be handed out again as soon as unref returns
+    int pooled = img_pkt->pooled;
     if (img_pkt->unref) {
       img_pkt->unref(img_pkt->creator, img_pkt);
     }
-    free(img_pkt);
+    if (!pooled) {
+      free(img_pkt);
+    }
   }
 }
 
@@ -21,6 +21,8 @@ typedef struct {
   int width_strip;
   int height;
   void *creator;
+  int index; /* buffer of the creator the frame is in */
+  int pooled; /* owned by the creator, recycled instead of freed */
   int ref_count;
   img_pkt_unref unref;
 } image_pkt_t;
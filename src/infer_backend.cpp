@@ -0,0 +1,28 @@
+#include "infer_backend.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const infer_backend_t *backends[] = {
+#ifndef INFER_BACKEND_NO_RKNN
+    &infer_backend_rknn,
+#endif
+    &infer_backend_mock,
+};
+
+static const infer_backend_t *backend_current = backends[0];
+
+const infer_backend_t *infer_backend_current(void) { return backend_current; }
+
+int infer_backend_select(const char *name) {
+  for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+    if (strcmp(backends[i]->name, name) == 0) {
+      backend_current = backends[i];
+      printf("inference backend: %s\n", name);
+      return 0;
+    }
+  }
+
+  printf("unknown inference backend %s\n", name);
+  return -1;
+}
@@ -0,0 +1,81 @@
+#ifndef __INFER_BACKEND_H__
+#define __INFER_BACKEND_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "rknn_api.h"
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * what rknn_runner needs from an inference engine. the calls and types are
+ * the rknn api ones, so the rknn backend is a thin pass through and other
+ * backends only fill in the same structs.
+ */
+typedef struct __infer_backend_t {
+  const char *name;
+  /* size 0 takes model as a path, like rknn_init */
+  int (*init)(rknn_context *ctx, void *model, uint32_t size, uint32_t flag,
+              rknn_init_extend *extend);
+  int (*dup_context)(rknn_context *ctx_in, rknn_context *ctx_out);
+  int (*destroy)(rknn_context ctx);
+  /* tensor attrs, io num, versions, as rknn_query */
+  int (*query)(rknn_context ctx, rknn_query_cmd cmd, void *info,
+               uint32_t size);
+  /* input and output buffers */
+  rknn_tensor_mem *(*create_mem)(rknn_context ctx, uint32_t size);
+  /* wraps a buffer the caller allocated and keeps owning */
+  rknn_tensor_mem *(*create_mem_from_fd)(rknn_context ctx, int32_t fd,
+                                         void *virt_addr, uint32_t size,
+                                         int32_t offset);
+  int (*destroy_mem)(rknn_context ctx, rknn_tensor_mem *mem);
+  /* contexts made with RKNN_FLAG_MEM_ALLOC_OUTSIDE get these before io */
+  int (*set_weight_mem)(rknn_context ctx, rknn_tensor_mem *mem);
+  int (*set_internal_mem)(rknn_context ctx, rknn_tensor_mem *mem);
+  int (*set_io_mem)(rknn_context ctx, rknn_tensor_mem *mem,
+                    rknn_tensor_attr *attr);
+  int (*set_core_mask)(rknn_context ctx, rknn_core_mask core_mask);
+  /* blocks until the outputs are in the bound output mems */
+  int (*run)(rknn_context ctx);
+  /*
+   * queues a run on the bound mems and returns, fills extend->frame_id.
+   * runs queued on one context execute in order, the mems may be rebound
+   * for the next one meanwhile. wait blocks until the run of extend is done.
+   */
+  int (*submit)(rknn_context ctx, rknn_run_extend *extend);
+  int (*wait)(rknn_context ctx, rknn_run_extend *extend);
+} infer_backend_t;
+
+/* host builds without librknnmrt define INFER_BACKEND_NO_RKNN */
+#ifndef INFER_BACKEND_NO_RKNN
+extern const infer_backend_t infer_backend_rknn;
+#endif
+
+/*
+ * replays output tensors recorded on the device, frame after frame, after a
+ * simulated latency. the model given to init is the recording.
+ */
+extern const infer_backend_t infer_backend_mock;
+
+/* backend new runners are created on, rknn unless built without it */
+const infer_backend_t *infer_backend_current(void);
+int infer_backend_select(const char *name);
+
+void infer_backend_mock_set_latency(int latency_us);
+
+/* recording format read by the mock backend */
+FILE *infer_backend_mock_record_open(const char *path, uint32_t n_input,
+                                     const rknn_tensor_attr *input_attrs,
+                                     uint32_t n_output,
+                                     const rknn_tensor_attr *output_attrs);
+int infer_backend_mock_record_frame(FILE *fp, uint32_t n_output,
+                                    const rknn_tensor_attr *output_attrs,
+                                    rknn_tensor_mem **output_mems);
+
+#endif /*__INFER_BACKEND_H__*/
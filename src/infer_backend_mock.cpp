@@ -0,0 +1,516 @@
+#include "infer_backend.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * recording layout: magic, n_input, n_output, the input then output
+ * rknn_tensor_attr structs, then per frame every output tensor of
+ * size_with_stride bytes back to back
+ */
+#define MOCK_RECORD_MAGIC "YCMOCK1"
+#define MOCK_RECORD_MAGIC_LEN 8
+
+typedef struct {
+  int refs;
+  uint32_t n_input;
+  uint32_t n_output;
+  rknn_tensor_attr *attrs; /* inputs followed by outputs */
+  uint8_t *frames;
+  size_t frame_size;
+  int n_frames;
+} mock_record_t;
+
+// runs queued on a context at once, more than the io sets of a runner
+#define MOCK_JOBS_MAX 4
+
+/* a submitted run, writes frame to the outputs bound at submit */
+typedef struct {
+  uint64_t id;
+  int pending;
+  int frame;
+  long long done_us;
+  rknn_tensor_mem **outputs;
+} mock_job_t;
+
+typedef struct {
+  mock_record_t *record;
+  rknn_tensor_mem **outputs; /* bound by set_io_mem */
+  pthread_mutex_t job_lock;
+  mock_job_t jobs[MOCK_JOBS_MAX];
+  uint64_t next_job;
+  long long busy_until_us; /* queued runs execute one after the other */
+  int next_frame;
+  int share_weight; /* created with RKNN_FLAG_SHARE_WEIGHT_MEM */
+  uint64_t mem_size; /* bytes of the mems made by create_mem */
+} mock_ctx_t;
+
+static int mock_latency_us = 10000;
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void infer_backend_mock_set_latency(int latency_us) {
+  mock_latency_us = latency_us;
+}
+
+static mock_ctx_t *mock_ctx(rknn_context ctx) {
+  return (mock_ctx_t *)(uintptr_t)ctx;
+}
+
+static long long mock_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int mock_read_file(const char *path, uint8_t **data, size_t *size) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    printf("open mock record %s failed\n", path);
+    return -1;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long len = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (len <= 0) {
+    fclose(fp);
+    return -1;
+  }
+
+  *data = (uint8_t *)malloc(len);
+  if (!*data || fread(*data, 1, len, fp) != (size_t)len) {
+    free(*data);
+    fclose(fp);
+    return -1;
+  }
+  fclose(fp);
+  *size = len;
+
+  return 0;
+}
+
+static mock_record_t *mock_record_parse(const uint8_t *data, size_t size) {
+  size_t head = MOCK_RECORD_MAGIC_LEN + 2 * sizeof(uint32_t);
+  if (size < head || memcmp(data, MOCK_RECORD_MAGIC, MOCK_RECORD_MAGIC_LEN)) {
+    printf("not a mock record\n");
+    return NULL;
+  }
+
+  mock_record_t *record = (mock_record_t *)calloc(1, sizeof(mock_record_t));
+  if (!record) {
+    return NULL;
+  }
+  memcpy(&record->n_input, data + MOCK_RECORD_MAGIC_LEN, sizeof(uint32_t));
+  memcpy(&record->n_output, data + MOCK_RECORD_MAGIC_LEN + sizeof(uint32_t),
+         sizeof(uint32_t));
+
+  uint32_t n_attr = record->n_input + record->n_output;
+  size_t attr_size = n_attr * sizeof(rknn_tensor_attr);
+  if (size < head + attr_size) {
+    free(record);
+    return NULL;
+  }
+  record->attrs = (rknn_tensor_attr *)malloc(attr_size);
+  if (!record->attrs) {
+    free(record);
+    return NULL;
+  }
+  memcpy(record->attrs, data + head, attr_size);
+
+  for (uint32_t i = 0; i < record->n_output; i++) {
+    record->frame_size += record->attrs[record->n_input + i].size_with_stride;
+  }
+  size_t body = size - head - attr_size;
+  record->n_frames = record->frame_size ? body / record->frame_size : 0;
+  record->frames = (uint8_t *)malloc(record->n_frames * record->frame_size);
+  if (!record->frames && record->n_frames) {
+    free(record->attrs);
+    free(record);
+    return NULL;
+  }
+  memcpy(record->frames, data + head + attr_size,
+         record->n_frames * record->frame_size);
+  record->refs = 1;
+  printf("mock record: %d inputs, %d outputs, %d frames\n", record->n_input,
+         record->n_output, record->n_frames);
+
+  return record;
+}
+
+static void mock_record_unref(mock_record_t *record) {
+  pthread_mutex_lock(&mock_lock);
+  int refs = --record->refs;
+  pthread_mutex_unlock(&mock_lock);
+  if (refs > 0) {
+    return;
+  }
+
+  free(record->attrs);
+  free(record->frames);
+  free(record);
+}
+
+static int mock_ctx_create(rknn_context *ctx, mock_record_t *record) {
+  mock_ctx_t *mock = (mock_ctx_t *)calloc(1, sizeof(mock_ctx_t));
+  if (!mock) {
+    return RKNN_ERR_MALLOC_FAIL;
+  }
+
+  mock->record = record;
+  // the current binding first, then one snapshot per job
+  mock->outputs = (rknn_tensor_mem **)calloc(
+      (MOCK_JOBS_MAX + 1) * record->n_output, sizeof(rknn_tensor_mem *));
+  if (!mock->outputs) {
+    free(mock);
+    return RKNN_ERR_MALLOC_FAIL;
+  }
+  for (int i = 0; i < MOCK_JOBS_MAX; i++) {
+    mock->jobs[i].outputs = mock->outputs + (i + 1) * record->n_output;
+  }
+  pthread_mutex_init(&mock->job_lock, NULL);
+  *ctx = (rknn_context)(uintptr_t)mock;
+
+  return RKNN_SUCC;
+}
+
+static int mock_init(rknn_context *ctx, void *model, uint32_t size,
+                     uint32_t flag, rknn_init_extend *extend) {
+  uint8_t *data = (uint8_t *)model;
+  size_t data_size = size;
+
+  int share_weight = (flag & RKNN_FLAG_SHARE_WEIGHT_MEM) != 0;
+  if (share_weight && (!extend || !extend->ctx)) {
+    return RKNN_ERR_PARAM_INVALID;
+  }
+
+  if (size == 0 &&
+      mock_read_file((const char *)model, &data, &data_size) != 0) {
+    return RKNN_ERR_MODEL_INVALID;
+  }
+
+  mock_record_t *record = mock_record_parse(data, data_size);
+  if (size == 0) {
+    free(data);
+  }
+  if (!record) {
+    return RKNN_ERR_MODEL_INVALID;
+  }
+
+  int ret = mock_ctx_create(ctx, record);
+  // the recording stands in for the weights, a sharing context owns none
+  if (ret == RKNN_SUCC) {
+    mock_ctx(*ctx)->share_weight = share_weight;
+  }
+
+  return ret;
+}
+
+static int mock_dup_context(rknn_context *ctx_in, rknn_context *ctx_out) {
+  mock_record_t *record = mock_ctx(*ctx_in)->record;
+
+  pthread_mutex_lock(&mock_lock);
+  record->refs++;
+  pthread_mutex_unlock(&mock_lock);
+
+  return mock_ctx_create(ctx_out, record);
+}
+
+static int mock_destroy(rknn_context ctx) {
+  mock_ctx_t *mock = mock_ctx(ctx);
+
+  mock_record_unref(mock->record);
+  pthread_mutex_destroy(&mock->job_lock);
+  free(mock->outputs);
+  free(mock);
+
+  return RKNN_SUCC;
+}
+
+static int mock_query(rknn_context ctx, rknn_query_cmd cmd, void *info,
+                      uint32_t size) {
+  mock_record_t *record = mock_ctx(ctx)->record;
+
+  switch (cmd) {
+  case RKNN_QUERY_IN_OUT_NUM: {
+    rknn_input_output_num *io_num = (rknn_input_output_num *)info;
+    io_num->n_input = record->n_input;
+    io_num->n_output = record->n_output;
+    return RKNN_SUCC;
+  }
+  case RKNN_QUERY_INPUT_ATTR:
+  case RKNN_QUERY_NATIVE_INPUT_ATTR:
+  case RKNN_QUERY_NATIVE_NHWC_INPUT_ATTR: {
+    rknn_tensor_attr *attr = (rknn_tensor_attr *)info;
+    if (attr->index >= record->n_input) {
+      return RKNN_ERR_PARAM_INVALID;
+    }
+    *attr = record->attrs[attr->index];
+    return RKNN_SUCC;
+  }
+  // outputs keep the layout they were recorded in
+  case RKNN_QUERY_OUTPUT_ATTR:
+  case RKNN_QUERY_NATIVE_OUTPUT_ATTR:
+  case RKNN_QUERY_NATIVE_NHWC_OUTPUT_ATTR: {
+    rknn_tensor_attr *attr = (rknn_tensor_attr *)info;
+    if (attr->index >= record->n_output) {
+      return RKNN_ERR_PARAM_INVALID;
+    }
+    *attr = record->attrs[record->n_input + attr->index];
+    return RKNN_SUCC;
+  }
+  case RKNN_QUERY_SDK_VERSION: {
+    rknn_sdk_version *ver = (rknn_sdk_version *)info;
+    snprintf(ver->api_version, sizeof(ver->api_version), "mock");
+    snprintf(ver->drv_version, sizeof(ver->drv_version), "mock");
+    return RKNN_SUCC;
+  }
+  case RKNN_QUERY_PERF_RUN: {
+    rknn_perf_run *perf = (rknn_perf_run *)info;
+    perf->run_duration = mock_latency_us;
+    return RKNN_SUCC;
+  }
+  case RKNN_QUERY_MEM_SIZE: {
+    mock_ctx_t *mock = mock_ctx(ctx);
+    rknn_mem_size *mem_size = (rknn_mem_size *)info;
+    memset(mem_size, 0, sizeof(rknn_mem_size));
+    if (!mock->share_weight) {
+      mem_size->total_weight_size = record->n_frames * record->frame_size;
+    }
+    mem_size->total_dma_allocated_size =
+        mem_size->total_weight_size + mock->mem_size;
+    return RKNN_SUCC;
+  }
+  case RKNN_QUERY_CUSTOM_STRING:
+    memset(info, 0, size);
+    return RKNN_SUCC;
+  default:
+    return RKNN_ERR_PARAM_INVALID;
+  }
+}
+
+static rknn_tensor_mem *mock_create_mem(rknn_context ctx, uint32_t size) {
+  rknn_tensor_mem *mem = (rknn_tensor_mem *)calloc(1, sizeof(rknn_tensor_mem));
+  if (!mem) {
+    return NULL;
+  }
+
+  mem->virt_addr = calloc(1, size);
+  if (!mem->virt_addr) {
+    free(mem);
+    return NULL;
+  }
+  mem->fd = -1;
+  mem->size = size;
+  mock_ctx(ctx)->mem_size += size;
+
+  return mem;
+}
+
+static rknn_tensor_mem *mock_create_mem_from_fd(rknn_context, int32_t fd,
+                                                void *virt_addr, uint32_t size,
+                                                int32_t offset) {
+  rknn_tensor_mem *mem = (rknn_tensor_mem *)calloc(1, sizeof(rknn_tensor_mem));
+  if (!mem) {
+    return NULL;
+  }
+
+  mem->virt_addr = (uint8_t *)virt_addr + offset;
+  mem->fd = fd;
+  mem->offset = offset;
+  mem->size = size;
+  mem->flags = RKNN_TENSOR_MEMORY_FLAGS_FROM_FD;
+
+  return mem;
+}
+
+static int mock_destroy_mem(rknn_context ctx, rknn_tensor_mem *mem) {
+  // wrapped buffers belong to the caller
+  if (mem->flags != RKNN_TENSOR_MEMORY_FLAGS_FROM_FD) {
+    mock_ctx(ctx)->mem_size -= mem->size;
+    free(mem->virt_addr);
+  }
+  free(mem);
+  return RKNN_SUCC;
+}
+
+static int mock_set_mem(rknn_context, rknn_tensor_mem *mem) {
+  return mem ? RKNN_SUCC : RKNN_ERR_PARAM_INVALID;
+}
+
+static int mock_set_io_mem(rknn_context ctx, rknn_tensor_mem *mem,
+                           rknn_tensor_attr *attr) {
+  mock_ctx_t *mock = mock_ctx(ctx);
+  mock_record_t *record = mock->record;
+
+  // inputs carry no data here, anything not naming one is an output
+  if (attr->index < record->n_input &&
+      strcmp(attr->name, record->attrs[attr->index].name) == 0) {
+    return RKNN_SUCC;
+  }
+
+  // output n replays recorded output n, whatever either is called
+  if (attr->index >= record->n_output) {
+    printf("mock: output %u, the recording has %u\n", attr->index,
+           record->n_output);
+    return RKNN_ERR_PARAM_INVALID;
+  }
+  const rknn_tensor_attr *rec = &record->attrs[record->n_input + attr->index];
+  if (attr->size_with_stride != rec->size_with_stride ||
+      attr->type != rec->type || mem->size < rec->size_with_stride) {
+    printf("mock: output %u is %u bytes of %s in a %u byte mem, recorded "
+           "%u bytes of %s\n",
+           attr->index, attr->size_with_stride, get_type_string(attr->type),
+           mem->size, rec->size_with_stride, get_type_string(rec->type));
+    return RKNN_ERR_PARAM_INVALID;
+  }
+  mock->outputs[attr->index] = mem;
+
+  return RKNN_SUCC;
+}
+
+static int mock_set_core_mask(rknn_context, rknn_core_mask) {
+  return RKNN_SUCC;
+}
+
+/* the npu takes runs in order, each one mock latency after the previous */
+static int mock_submit(rknn_context ctx, rknn_run_extend *extend) {
+  mock_ctx_t *mock = mock_ctx(ctx);
+  mock_record_t *record = mock->record;
+
+  // a run without every output bound would leave stale data unnoticed
+  for (uint32_t i = 0; i < record->n_output; i++) {
+    if (!mock->outputs[i]) {
+      printf("mock: output %u is not bound\n", i);
+      return RKNN_ERR_OUTPUT_INVALID;
+    }
+  }
+
+  pthread_mutex_lock(&mock->job_lock);
+  mock_job_t *job = &mock->jobs[mock->next_job % MOCK_JOBS_MAX];
+  if (job->pending) {
+    pthread_mutex_unlock(&mock->job_lock);
+    printf("mock: more than %d runs queued\n", MOCK_JOBS_MAX);
+    return RKNN_ERR_DEVICE_UNAVAILABLE;
+  }
+
+  long long start = mock_now_us();
+  if (start < mock->busy_until_us) {
+    start = mock->busy_until_us;
+  }
+  job->id = mock->next_job++;
+  job->pending = 1;
+  job->done_us = start + (mock_latency_us > 0 ? mock_latency_us : 0);
+  job->frame = mock->next_frame;
+  memcpy(job->outputs, mock->outputs,
+         record->n_output * sizeof(rknn_tensor_mem *));
+  mock->busy_until_us = job->done_us;
+  if (record->n_frames) {
+    mock->next_frame = (mock->next_frame + 1) % record->n_frames;
+  }
+  extend->frame_id = job->id;
+  pthread_mutex_unlock(&mock->job_lock);
+
+  return RKNN_SUCC;
+}
+
+static int mock_wait(rknn_context ctx, rknn_run_extend *extend) {
+  mock_ctx_t *mock = mock_ctx(ctx);
+  mock_record_t *record = mock->record;
+
+  pthread_mutex_lock(&mock->job_lock);
+  mock_job_t *job = &mock->jobs[extend->frame_id % MOCK_JOBS_MAX];
+  int valid = job->pending && job->id == extend->frame_id;
+  pthread_mutex_unlock(&mock->job_lock);
+  if (!valid) {
+    return RKNN_ERR_PARAM_INVALID;
+  }
+
+  long long left = job->done_us - mock_now_us();
+  if (left > 0) {
+    usleep(left);
+  }
+
+  if (record->n_frames) {
+    const uint8_t *frame = record->frames + job->frame * record->frame_size;
+    for (uint32_t i = 0; i < record->n_output; i++) {
+      // sizes were checked when the mems were bound
+      uint32_t size = record->attrs[record->n_input + i].size_with_stride;
+      memcpy(job->outputs[i]->virt_addr, frame, size);
+      frame += size;
+    }
+  }
+
+  pthread_mutex_lock(&mock->job_lock);
+  job->pending = 0;
+  pthread_mutex_unlock(&mock->job_lock);
+
+  return RKNN_SUCC;
+}
+
+static int mock_run(rknn_context ctx) {
+  rknn_run_extend extend;
+
+  memset(&extend, 0, sizeof(extend));
+  int ret = mock_submit(ctx, &extend);
+  if (ret != RKNN_SUCC) {
+    return ret;
+  }
+  return mock_wait(ctx, &extend);
+}
+
+const infer_backend_t infer_backend_mock = {
+    "mock",
+    mock_init,
+    mock_dup_context,
+    mock_destroy,
+    mock_query,
+    mock_create_mem,
+    mock_create_mem_from_fd,
+    mock_destroy_mem,
+    mock_set_mem,
+    mock_set_mem,
+    mock_set_io_mem,
+    mock_set_core_mask,
+    mock_run,
+    mock_submit,
+    mock_wait,
+};
+
+FILE *infer_backend_mock_record_open(const char *path, uint32_t n_input,
+                                     const rknn_tensor_attr *input_attrs,
+                                     uint32_t n_output,
+                                     const rknn_tensor_attr *output_attrs) {
+  char magic[MOCK_RECORD_MAGIC_LEN] = MOCK_RECORD_MAGIC;
+
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    printf("open %s for recording failed\n", path);
+    return NULL;
+  }
+
+  fwrite(magic, 1, sizeof(magic), fp);
+  fwrite(&n_input, sizeof(n_input), 1, fp);
+  fwrite(&n_output, sizeof(n_output), 1, fp);
+  fwrite(input_attrs, sizeof(rknn_tensor_attr), n_input, fp);
+  fwrite(output_attrs, sizeof(rknn_tensor_attr), n_output, fp);
+
+  return fp;
+}
+
+int infer_backend_mock_record_frame(FILE *fp, uint32_t n_output,
+                                    const rknn_tensor_attr *output_attrs,
+                                    rknn_tensor_mem **output_mems) {
+  for (uint32_t i = 0; i < n_output; i++) {
+    size_t size = output_attrs[i].size_with_stride;
+    if (fwrite(output_mems[i]->virt_addr, 1, size, fp) != size) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,31 @@
+#include "infer_backend.h"
+
+static int rknn_backend_run(rknn_context ctx) { return rknn_run(ctx, NULL); }
+
+static int rknn_backend_submit(rknn_context ctx, rknn_run_extend *extend) {
+  extend->non_block = 1;
+  return rknn_run(ctx, extend);
+}
+
+static int rknn_backend_wait(rknn_context ctx, rknn_run_extend *extend) {
+  extend->timeout_ms = 1000;
+  return rknn_wait(ctx, extend);
+}
+
+const infer_backend_t infer_backend_rknn = {
+    "rknn",
+    rknn_init,
+    rknn_dup_context,
+    rknn_destroy,
+    rknn_query,
+    rknn_create_mem,
+    rknn_create_mem_from_fd,
+    rknn_destroy_mem,
+    rknn_set_weight_mem,
+    rknn_set_internal_mem,
+    rknn_set_io_mem,
+    rknn_set_core_mask,
+    rknn_backend_run,
+    rknn_backend_submit,
+    rknn_backend_wait,
+};
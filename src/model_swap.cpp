@@ -0,0 +1,192 @@
+#include "model_swap.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+static long long swap_time_us() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static rknn_runner_pool_t *model_swap_load(model_swap_t *swap,
+                                           const char *model_path,
+                                           const char *label_path) {
+  long long start = swap_time_us();
+
+  printf("model swap: loading %s\n", model_path);
+  rknn_runner_pool_t *pool = swap->load(model_path, label_path);
+  if (!pool) {
+    printf("model swap: load %s failed, keep the running model\n",
+           model_path);
+    return NULL;
+  }
+
+  if (swap->warmup_runs > 0 &&
+      rknn_runner_pool_warmup(pool, swap->warmup_runs) != 0) {
+    printf("model swap: warm up %s failed, keep the running model\n",
+           model_path);
+    rknn_runner_pool_destroy(pool);
+    return NULL;
+  }
+  printf("model swap: %s ready in %lld ms\n", model_path,
+         (swap_time_us() - start) / 1000);
+
+  return pool;
+}
+
+static void *model_swap_thread(void *arg) {
+  model_swap_t *swap = (model_swap_t *)arg;
+  char model_path[MODEL_SWAP_PATH_MAX];
+  char label_path[MODEL_SWAP_PATH_MAX];
+
+  pthread_mutex_lock(&swap->mutex);
+  while (!swap->quit) {
+    if (swap->retired) {
+      rknn_runner_pool_t *retired = swap->retired;
+      swap->retired = NULL;
+      pthread_mutex_unlock(&swap->mutex);
+      rknn_runner_pool_destroy(retired);
+      pthread_mutex_lock(&swap->mutex);
+      continue;
+    }
+
+    if (swap->requested) {
+      swap->requested = 0;
+      memcpy(model_path, swap->model_path, sizeof(model_path));
+      memcpy(label_path, swap->label_path, sizeof(label_path));
+      pthread_mutex_unlock(&swap->mutex);
+
+      rknn_runner_pool_t *pool = model_swap_load(swap, model_path, label_path);
+
+      pthread_mutex_lock(&swap->mutex);
+      // a pool loaded earlier but not picked up yet is superseded
+      rknn_runner_pool_t *stale = swap->pending;
+      swap->pending = pool ? pool : stale;
+      if (pool) {
+        pthread_cond_signal(&swap->ready);
+      }
+      if (pool && stale) {
+        pthread_mutex_unlock(&swap->mutex);
+        rknn_runner_pool_destroy(stale);
+        pthread_mutex_lock(&swap->mutex);
+      }
+      continue;
+    }
+
+    pthread_cond_wait(&swap->cond, &swap->mutex);
+  }
+  pthread_mutex_unlock(&swap->mutex);
+
+  return NULL;
+}
+
+int model_swap_init(model_swap_t *swap, model_swap_load_func load,
+                    int warmup_runs) {
+  memset(swap, 0, sizeof(model_swap_t));
+  swap->load = load;
+  swap->warmup_runs = warmup_runs;
+  pthread_mutex_init(&swap->mutex, NULL);
+  pthread_cond_init(&swap->cond, NULL);
+  // timed waits on the ready condition must not follow wall clock changes
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&swap->ready, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&swap->thread, NULL, model_swap_thread, swap) != 0) {
+    printf("create model swap thread failed\n");
+    pthread_mutex_destroy(&swap->mutex);
+    pthread_cond_destroy(&swap->cond);
+    pthread_cond_destroy(&swap->ready);
+    return -1;
+  }
+
+  return 0;
+}
+
+int model_swap_request(model_swap_t *swap, const char *model_path,
+                       const char *label_path) {
+  if (!model_path || !label_path) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&swap->mutex);
+  snprintf(swap->model_path, sizeof(swap->model_path), "%s", model_path);
+  snprintf(swap->label_path, sizeof(swap->label_path), "%s", label_path);
+  swap->requested = 1;
+  pthread_cond_signal(&swap->cond);
+  pthread_mutex_unlock(&swap->mutex);
+
+  return 0;
+}
+
+rknn_runner_pool_t *model_swap_update(model_swap_t *swap,
+                                      rknn_runner_pool_t *current) {
+  pthread_mutex_lock(&swap->mutex);
+  // the previous pool is still being torn down, swap on a later frame
+  if (!swap->pending || swap->retired) {
+    pthread_mutex_unlock(&swap->mutex);
+    return current;
+  }
+  rknn_runner_pool_t *next = swap->pending;
+  swap->pending = NULL;
+  pthread_mutex_unlock(&swap->mutex);
+
+  // frames in flight finish and post on the old model, in order before the
+  // first frame of the new one
+  if (current) {
+    long long start = swap_time_us();
+    npu_pool_drain(&current->npu);
+    printf("model swap: switched after draining %lld us\n",
+           swap_time_us() - start);
+  }
+
+  pthread_mutex_lock(&swap->mutex);
+  swap->retired = current;
+  pthread_cond_signal(&swap->cond);
+  pthread_mutex_unlock(&swap->mutex);
+
+  return next;
+}
+
+void model_swap_wait(model_swap_t *swap, int timeout_ms) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&swap->mutex);
+  while (!swap->pending && !swap->quit) {
+    if (pthread_cond_timedwait(&swap->ready, &swap->mutex, &deadline) != 0) {
+      break;
+    }
+  }
+  pthread_mutex_unlock(&swap->mutex);
+}
+
+void model_swap_cleanup(model_swap_t *swap) {
+  pthread_mutex_lock(&swap->mutex);
+  swap->quit = 1;
+  pthread_cond_signal(&swap->cond);
+  pthread_cond_broadcast(&swap->ready);
+  pthread_mutex_unlock(&swap->mutex);
+
+  pthread_join(swap->thread, NULL);
+
+  rknn_runner_pool_destroy(swap->pending);
+  rknn_runner_pool_destroy(swap->retired);
+  swap->pending = NULL;
+  swap->retired = NULL;
+
+  pthread_mutex_destroy(&swap->mutex);
+  pthread_cond_destroy(&swap->cond);
+  pthread_cond_destroy(&swap->ready);
+}
@@ -0,0 +1,57 @@
+#ifndef __MODEL_SWAP_H__
+#define __MODEL_SWAP_H__
+
+#include "rknn_runner.h"
+#include <pthread.h>
+
+#define MODEL_SWAP_PATH_MAX 256
+
+/* builds a runner pool with labels loaded, NULL on failure */
+typedef rknn_runner_pool_t *(*model_swap_load_func)(const char *model_path,
+                                                    const char *label_path);
+
+/*
+ * replaces the running model without stopping the pipeline. the new pool is
+ * loaded and warmed up on a thread of its own, the npu thread picks it up
+ * between two frames and the old pool is destroyed on that thread again, so
+ * the only stall on the npu thread is draining the frames already submitted.
+ */
+typedef struct {
+  model_swap_load_func load;
+  int warmup_runs;
+  char model_path[MODEL_SWAP_PATH_MAX];
+  char label_path[MODEL_SWAP_PATH_MAX];
+  int requested;
+  int quit;
+  rknn_runner_pool_t *pending; /* ready, not yet running frames */
+  rknn_runner_pool_t *retired; /* drained, waits to be destroyed */
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_cond_t ready; /* a pool became pending */
+} model_swap_t;
+
+int model_swap_init(model_swap_t *swap, model_swap_load_func load,
+                    int warmup_runs);
+
+/* queue a load, a newer request replaces one not yet picked up */
+int model_swap_request(model_swap_t *swap, const char *model_path,
+                       const char *label_path);
+
+/*
+ * called by the npu thread between frames with the pool it runs on, returns
+ * the pool to submit the next frame to.
+ */
+rknn_runner_pool_t *model_swap_update(model_swap_t *swap,
+                                      rknn_runner_pool_t *current);
+
+/*
+ * npu thread without a model (none at startup or the load failed): sleeps
+ * until a pool is pending or timeout_ms passed, instead of polling update.
+ */
+void model_swap_wait(model_swap_t *swap, int timeout_ms);
+
+/* stops the loader, destroys pools that never went or are out of service */
+void model_swap_cleanup(model_swap_t *swap);
+
+#endif /*__MODEL_SWAP_H__*/
@@ -0,0 +1,121 @@
+#include "multires.h"
+
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+// a full box this close to a fast box of the same class is the same object
+#define MULTIRES_SAME_IOU 0.45f
+
+static float multires_iou(const BOX_RECT *a, const BOX_RECT *b) {
+  float w = fmaxf(0.f, fminf(a->right, b->right) - fmaxf(a->left, b->left));
+  float h = fmaxf(0.f, fminf(a->bottom, b->bottom) - fmaxf(a->top, b->top));
+  float i = w * h;
+  float u = (float)(a->right - a->left) * (a->bottom - a->top) +
+            (float)(b->right - b->left) * (b->bottom - b->top) - i;
+  return u <= 0.f ? 0.f : i / u;
+}
+
+/* frame ids wrap, compare by difference */
+static int multires_age(int newer, int older) {
+  return (int)((unsigned)newer - (unsigned)older);
+}
+
+static int multires_covered(const detect_result_group_t *group,
+                            const detect_result_t *det) {
+  for (int i = 0; i < group->count; i++) {
+    const detect_result_t *own = &group->results[i];
+    if (own->class_id == det->class_id &&
+        multires_iou(&own->box, &det->box) > MULTIRES_SAME_IOU) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* boxes of the last full frame the fast model missed, usually small ones */
+static void multires_add_full(multires_t *ms, detect_result_group_t *group) {
+  const detect_result_group_t *full = &ms->full_last;
+
+  // class ids only compare within one label table
+  if (!ms->full_valid || full->labels != group->labels ||
+      multires_age(group->id, full->id) > ms->full_max_age) {
+    return;
+  }
+
+  int count = group->count;
+  for (int i = 0; i < full->count && count < OBJ_NUMB_MAX_SIZE; i++) {
+    if (!multires_covered(group, &full->results[i])) {
+      group->results[count++] = full->results[i];
+    }
+  }
+  group->count = count;
+}
+
+void multires_init(multires_t *ms, int full_period, float uncertain_lo,
+                   float uncertain_hi, int full_max_age) {
+  memset(ms, 0, sizeof(multires_t));
+  ms->full_period = full_period;
+  ms->uncertain_lo = uncertain_lo;
+  ms->uncertain_hi = uncertain_hi;
+  ms->full_max_age = full_max_age;
+  pthread_mutex_init(&ms->mutex, NULL);
+}
+
+void multires_cleanup(multires_t *ms) {
+  printf("multires: %lu full, %lu fast frames\n", ms->picked[MULTIRES_FULL],
+         ms->picked[MULTIRES_FAST]);
+  pthread_mutex_destroy(&ms->mutex);
+}
+
+multires_model_e multires_pick(multires_t *ms) {
+  multires_model_e model = MULTIRES_FAST;
+
+  pthread_mutex_lock(&ms->mutex);
+  if (ms->full_wanted ||
+      (ms->full_period > 0 && ms->frames % ms->full_period == 0)) {
+    ms->full_wanted = 0;
+    model = MULTIRES_FULL;
+  }
+  ms->frames++;
+  ms->picked[model]++;
+  pthread_mutex_unlock(&ms->mutex);
+
+  return model;
+}
+
+int multires_merge(multires_t *ms, multires_model_e model,
+                   detect_result_group_t *group) {
+  int emit = 0;
+
+  pthread_mutex_lock(&ms->mutex);
+  if (model == MULTIRES_FULL) {
+    if (!ms->full_valid || multires_age(group->id, ms->full_last.id) > 0) {
+      memcpy(&ms->full_last, group,
+             offsetof(detect_result_group_t, results) +
+                 group->count * sizeof(detect_result_t));
+      ms->full_valid = 1;
+    }
+  } else {
+    for (int i = 0; i < group->count; i++) {
+      float prop = group->results[i].prop;
+      if (prop >= ms->uncertain_lo && prop < ms->uncertain_hi) {
+        ms->full_wanted = 1;
+        break;
+      }
+    }
+    multires_add_full(ms, group);
+  }
+
+  // the models post independently, a slow full frame may land after fast
+  // frames that came later. it still feeds the merge but is not shown.
+  if (!ms->emitted || multires_age(group->id, ms->last_id) > 0) {
+    ms->emitted = 1;
+    ms->last_id = group->id;
+    emit = 1;
+  }
+  pthread_mutex_unlock(&ms->mutex);
+
+  return emit;
+}
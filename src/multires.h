@@ -0,0 +1,49 @@
+#ifndef __MULTIRES_H__
+#define __MULTIRES_H__
+
+#include "postprocess.h"
+#include <pthread.h>
+
+typedef enum {
+  MULTIRES_FULL = 0, /* full resolution model, small far objects */
+  MULTIRES_FAST      /* low resolution model, every other frame */
+} multires_model_e;
+
+/*
+ * per frame choice between a fast and a full resolution model, and one
+ * result stream out of both. the full model runs every full_period frames,
+ * or on the next frame after the fast model reported a box scored in
+ * [uncertain_lo, uncertain_hi). fast results carry the boxes of the last
+ * full result that they do not cover, for full_max_age frames.
+ */
+typedef struct {
+  int full_period; /* 0 runs the full model on demand only */
+  float uncertain_lo;
+  float uncertain_hi;
+  int full_max_age;
+  unsigned long frames;
+  int full_wanted;
+  int emitted; /* a group went out, last_id is valid */
+  int last_id;
+  int full_valid;
+  detect_result_group_t full_last;
+  unsigned long picked[2];
+  pthread_mutex_t mutex;
+} multires_t;
+
+void multires_init(multires_t *ms, int full_period, float uncertain_lo,
+                   float uncertain_hi, int full_max_age);
+void multires_cleanup(multires_t *ms);
+
+/* model for the next frame, from the producer */
+multires_model_e multires_pick(multires_t *ms);
+
+/*
+ * from the post callbacks of both models with a decoded group whose id is
+ * the frame number. returns 1 if the group goes out, 0 if a newer frame
+ * already did. fast groups are merged with the last full result in place.
+ */
+int multires_merge(multires_t *ms, multires_model_e model,
+                   detect_result_group_t *group);
+
+#endif /*__MULTIRES_H__*/
@@ -0,0 +1,187 @@
+#include "npu_pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static void *npu_pool_worker(void *arg) {
+  npu_slot_t *slot = (npu_slot_t *)arg;
+  npu_pool_t *pool = slot->pool;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (1) {
+    while (slot->state != NPU_SLOT_QUEUED && !pool->quit) {
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+    if (slot->state != NPU_SLOT_QUEUED) {
+      break;
+    }
+    slot->state = NPU_SLOT_RUNNING;
+    pthread_mutex_unlock(&pool->mutex);
+
+    int ret = pool->run(slot->ctx);
+
+    pthread_mutex_lock(&pool->mutex);
+    slot->ret = ret;
+    slot->state = NPU_SLOT_DONE;
+    pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+static npu_slot_t *npu_pool_next_done(npu_pool_t *pool) {
+  for (int i = 0; i < pool->num; i++) {
+    npu_slot_t *slot = &pool->slots[i];
+    if (slot->state == NPU_SLOT_DONE && slot->seq == pool->next_post) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/* the decode stage, one frame at a time in submit order */
+static void *npu_pool_post_worker(void *arg) {
+  npu_pool_t *pool = (npu_pool_t *)arg;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (1) {
+    npu_slot_t *slot = npu_pool_next_done(pool);
+    if (!slot) {
+      // on quit, stay until every submitted frame is posted
+      if (pool->quit && pool->next_post == pool->next_submit) {
+        break;
+      }
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+      continue;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (slot->ret == 0 && pool->post) {
+      pool->post(slot->ctx);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    if (slot->ret != 0) {
+      pool->failed++;
+    }
+    pool->next_post++;
+    slot->state = NPU_SLOT_IDLE;
+    pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+int npu_pool_init(npu_pool_t *pool, void **ctxs, int num,
+                  npu_pool_run_func run, npu_pool_post_func post) {
+  if (num <= 0 || num > NPU_POOL_MAX || !run) {
+    return -1;
+  }
+
+  memset(pool, 0, sizeof(npu_pool_t));
+  pool->run = run;
+  pool->post = post;
+  pthread_mutex_init(&pool->mutex, NULL);
+  // acquire deadlines must not follow wall clock changes
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&pool->cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if (pthread_create(&pool->post_tid, NULL, npu_pool_post_worker, pool) != 0) {
+    printf("create npu post thread failed\n");
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+    return -1;
+  }
+
+  for (int i = 0; i < num; i++) {
+    npu_slot_t *slot = &pool->slots[i];
+    slot->pool = pool;
+    slot->ctx = ctxs[i];
+    slot->state = NPU_SLOT_IDLE;
+    if (pthread_create(&slot->tid, NULL, npu_pool_worker, slot) != 0) {
+      printf("create npu worker %d failed\n", i);
+      npu_pool_cleanup(pool);
+      return -1;
+    }
+    // the post thread is already scanning the slots
+    pthread_mutex_lock(&pool->mutex);
+    pool->num++;
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  return 0;
+}
+
+int npu_pool_acquire(npu_pool_t *pool, int timeout_ms) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += timeout_ms / 1000;
+  ts.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  int index = pool->next_submit % pool->num;
+  npu_slot_t *slot = &pool->slots[index];
+  while (slot->state != NPU_SLOT_IDLE) {
+    if (pthread_cond_timedwait(&pool->cond, &pool->mutex, &ts) == ETIMEDOUT) {
+      pthread_mutex_unlock(&pool->mutex);
+      return -1;
+    }
+  }
+  slot->state = NPU_SLOT_ACQUIRED;
+  pthread_mutex_unlock(&pool->mutex);
+
+  return index;
+}
+
+void *npu_pool_ctx(npu_pool_t *pool, int slot) {
+  return pool->slots[slot].ctx;
+}
+
+void npu_pool_submit(npu_pool_t *pool, int slot) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->slots[slot].seq = pool->next_submit++;
+  pool->slots[slot].state = NPU_SLOT_QUEUED;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void npu_pool_cancel(npu_pool_t *pool, int slot) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->slots[slot].state = NPU_SLOT_IDLE;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void npu_pool_drain(npu_pool_t *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->next_post != pool->next_submit) {
+    pthread_cond_wait(&pool->cond, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+void npu_pool_cleanup(npu_pool_t *pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int i = 0; i < pool->num; i++) {
+    pthread_join(pool->slots[i].tid, NULL);
+  }
+  pthread_join(pool->post_tid, NULL);
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->cond);
+}
@@ -0,0 +1,83 @@
+#ifndef __npu_pool_H__
+#define __npu_pool_H__
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// contexts times io sets
+#define NPU_POOL_MAX 9
+
+// runs inference on one context, 0 on success
+typedef int (*npu_pool_run_func)(void *ctx);
+// consumes the outputs of one context, called in submit order
+typedef void (*npu_pool_post_func)(void *ctx);
+
+enum {
+  NPU_SLOT_IDLE = 0,
+  NPU_SLOT_ACQUIRED, /* input being filled by the producer */
+  NPU_SLOT_QUEUED,
+  NPU_SLOT_RUNNING,
+  NPU_SLOT_DONE /* outputs ready, waiting for the post stage */
+};
+
+typedef struct __npu_pool_t npu_pool_t;
+
+typedef struct {
+  npu_pool_t *pool;
+  void *ctx;
+  pthread_t tid;
+  int state;
+  int ret;
+  unsigned long seq;
+} npu_slot_t;
+
+/*
+ * round robin over a fixed set of slots, one worker thread per slot. a slot
+ * is whatever run/post take, an inference context or one io set of it.
+ * workers only run, a finished slot is handed to the post thread, which
+ * posts in submit order no matter which slot finished first. so decode of
+ * one frame never delays the next run. the pool never touches the npu
+ * itself, run/post do, so it can be driven by stub contexts on a host.
+ */
+struct __npu_pool_t {
+  npu_slot_t slots[NPU_POOL_MAX];
+  int num;
+  npu_pool_run_func run;
+  npu_pool_post_func post;
+  pthread_t post_tid;
+  unsigned long next_submit;
+  unsigned long next_post;
+  unsigned long failed;
+  int quit;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+int npu_pool_init(npu_pool_t *pool, void **ctxs, int num,
+                  npu_pool_run_func run, npu_pool_post_func post);
+
+// next slot in round robin order once it is idle, -1 on timeout
+int npu_pool_acquire(npu_pool_t *pool, int timeout_ms);
+
+void *npu_pool_ctx(npu_pool_t *pool, int slot);
+
+// hand an acquired slot to its worker
+void npu_pool_submit(npu_pool_t *pool, int slot);
+
+// give an acquired slot back without running it
+void npu_pool_cancel(npu_pool_t *pool, int slot);
+
+// waits until every submitted frame has posted
+void npu_pool_drain(npu_pool_t *pool);
+
+// finishes the submitted frames and joins the workers
+void npu_pool_cleanup(npu_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__npu_pool_H__*/
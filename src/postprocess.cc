@@ -13,21 +13,32 @@
 // limitations under the License.
 
 #include "postprocess.h"
+#include <algorithm>
 #include <math.h>
-#include <set>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
 #include <vector>
-#define LABEL_NALE_TXT_PATH "/oem/model/labels.txt"
 
-#define OBJ_CLASS_NUM_MAX 100
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define POSTPROCESS_USE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define POSTPROCESS_USE_SSE2
+#endif
 
-static char *labels[OBJ_CLASS_NUM_MAX];
-static int labels_count = 0;
-static int prop_box_size = 0;
+// candidates beyond the top K scores never reach nms
+#define NMS_TOP_K 1024
+// cell size in model input pixels of the spatial grid nms
+#define NMS_GRID_CELL 64
+
+static nms_method_e nms_method = NMS_METHOD_TOPK_BATCHED;
+static int decode_generic = 0;
+static post_activation_e class_activation = POST_ACTIVATION_AUTO;
 
 const int anchor0[6] = {10, 13, 16, 30, 33, 23};
 const int anchor1[6] = {30, 61, 62, 45, 59, 119};
@@ -70,7 +81,7 @@ char *readLine(FILE *fp, char *buffer, int *len) {
   return buffer;
 }
 
-int readLines(const char *fileName, char *lines[]) {
+int readLines(const char *fileName, char *lines[], int max_line) {
   FILE *file = fopen(fileName, "r");
   if (!file) {
     perror("Error opening file");
@@ -82,7 +93,7 @@ int readLines(const char *fileName, char *lines[]) {
   ssize_t read;
   int i = 0;
 
-  while ((read = getline(&line, &len, file)) != -1) {
+  while (i < max_line && (read = getline(&line, &len, file)) != -1) {
     // 去除换行符
     if (line[read - 1] == '\n') {
       line[read - 1] = '\0';
@@ -112,9 +123,83 @@ int readLines(const char *fileName, char *lines[]) {
   return i;
 }
 
-int loadLabelName(const char *locationFilename, char *label[]) {
-  printf("loadLabelName %s\n", locationFilename);
-  return readLines(locationFilename, label);
+int label_table_load(label_table_t *table, const char *path) {
+  memset(table, 0, sizeof(label_table_t));
+  int ret = readLines(path, table->names, OBJ_CLASS_NUM_MAX);
+  if (ret <= 0) {
+    printf("load labels from %s failed\n", path);
+    return -1;
+  }
+
+  table->count = ret;
+  printf("[post_process] found labels:[%d]\n", table->count);
+  return 0;
+}
+
+void label_table_release(label_table_t *table) {
+  for (int i = 0; i < table->count; i++) {
+    free(table->names[i]);
+  }
+  memset(table, 0, sizeof(label_table_t));
+}
+
+const char *label_table_name(const label_table_t *table, int class_id) {
+  if (!table || class_id < 0 || class_id >= table->count) {
+    return "unknown";
+  }
+  return table->names[class_id];
+}
+
+static label_table_t *shared_labels = NULL;
+static pthread_mutex_t shared_labels_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int label_table_equal(const label_table_t *a, const label_table_t *b) {
+  if (a->count != b->count) {
+    return 0;
+  }
+  for (int i = 0; i < a->count; i++) {
+    if (strcmp(a->names[i], b->names[i]) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+const label_table_t *label_table_get(const char *path) {
+  label_table_t *table = (label_table_t *)malloc(sizeof(label_table_t));
+  if (!table) {
+    return NULL;
+  }
+  if (label_table_load(table, path) != 0) {
+    free(table);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&shared_labels_lock);
+  for (label_table_t *it = shared_labels; it; it = it->next) {
+    if (label_table_equal(it, table)) {
+      pthread_mutex_unlock(&shared_labels_lock);
+      label_table_release(table);
+      free(table);
+      return it;
+    }
+  }
+  table->next = shared_labels;
+  shared_labels = table;
+  pthread_mutex_unlock(&shared_labels_lock);
+
+  return table;
+}
+
+void label_table_cleanup(void) {
+  pthread_mutex_lock(&shared_labels_lock);
+  while (shared_labels) {
+    label_table_t *table = shared_labels;
+    shared_labels = table->next;
+    label_table_release(table);
+    free(table);
+  }
+  pthread_mutex_unlock(&shared_labels_lock);
 }
 
 static float CalculateOverlap(float xmin0, float ymin0, float xmax0,
@@ -129,8 +214,8 @@ static float CalculateOverlap(float xmin0, float ymin0, float xmax0,
 }
 
 static int nms(int validCount, std::vector<float> &outputLocations,
-               std::vector<int> classIds, std::vector<int> &order, int filterId,
-               float threshold) {
+               std::vector<int> &classIds, std::vector<int> &order,
+               int filterId, float threshold) {
   for (int i = 0; i < validCount; ++i) {
     if (order[i] == -1 || classIds[i] != filterId) {
       continue;
@@ -162,6 +247,209 @@ static int nms(int validCount, std::vector<float> &outputLocations,
   return 0;
 }
 
+/* order becomes the top K candidate indices by score, K is returned */
+static int nms_select_topk(int validCount, std::vector<float> &scores,
+                           std::vector<int> &order) {
+  int top_k = validCount < NMS_TOP_K ? validCount : NMS_TOP_K;
+
+  order.resize(validCount);
+  for (int i = 0; i < validCount; ++i) {
+    order[i] = i;
+  }
+  std::partial_sort(order.begin(), order.begin() + top_k, order.end(),
+                    [&scores](int a, int b) {
+                      return scores[a] > scores[b] ||
+                             (scores[a] == scores[b] && a < b);
+                    });
+  order.resize(top_k);
+
+  return top_k;
+}
+
+/*
+ * keep the top K candidates by score, bucket them by class in one pass and
+ * suppress inside each bucket on a structure-of-arrays box layout.
+ * order is rewritten to the K survivors in score order, -1 for suppressed,
+ * and K is returned.
+ */
+static int nms_topk_batched(int validCount, std::vector<float> &outputLocations,
+                            std::vector<float> &scores,
+                            std::vector<int> &classIds, std::vector<int> &order,
+                            float threshold, post_process_workspace_t *ws) {
+  int top_k = nms_select_topk(validCount, scores, order);
+
+  // counting sort by class keeps the score order inside every bucket
+  std::vector<int> &bucket = ws->bucket;
+  const int class_num = ws->labels->count;
+  bucket.assign(class_num + 1, 0);
+  for (int i = 0; i < top_k; ++i) {
+    bucket[classIds[order[i]] + 1]++;
+  }
+  for (int c = 0; c < class_num; ++c) {
+    bucket[c + 1] += bucket[c];
+  }
+
+  std::vector<int> &fill = ws->fill;
+  std::vector<int> &rank = ws->rank;
+  std::vector<float> &xmin = ws->xmin;
+  std::vector<float> &ymin = ws->ymin;
+  std::vector<float> &xmax = ws->xmax;
+  std::vector<float> &ymax = ws->ymax;
+  fill.assign(bucket.begin(), bucket.end() - 1);
+  rank.resize(top_k);
+  xmin.resize(top_k);
+  ymin.resize(top_k);
+  xmax.resize(top_k);
+  ymax.resize(top_k);
+  for (int i = 0; i < top_k; ++i) {
+    int n = order[i];
+    int pos = fill[classIds[n]]++;
+    rank[pos] = i;
+    xmin[pos] = outputLocations[n * 4 + 0];
+    ymin[pos] = outputLocations[n * 4 + 1];
+    xmax[pos] = xmin[pos] + outputLocations[n * 4 + 2];
+    ymax[pos] = ymin[pos] + outputLocations[n * 4 + 3];
+  }
+
+  std::vector<char> &removed = ws->removed;
+  removed.assign(top_k, 0);
+  for (int c = 0; c < class_num; ++c) {
+    for (int i = bucket[c]; i < bucket[c + 1]; ++i) {
+      if (removed[i]) {
+        continue;
+      }
+      for (int j = i + 1; j < bucket[c + 1]; ++j) {
+        if (removed[j]) {
+          continue;
+        }
+        float iou = CalculateOverlap(xmin[i], ymin[i], xmax[i], ymax[i],
+                                     xmin[j], ymin[j], xmax[j], ymax[j]);
+        if (iou > threshold) {
+          removed[j] = 1;
+        }
+      }
+    }
+  }
+
+  for (int pos = 0; pos < top_k; ++pos) {
+    if (removed[pos]) {
+      order[rank[pos]] = -1;
+    }
+  }
+
+  return top_k;
+}
+
+static inline int grid_cell(float v, int cells) {
+  int cell = (int)floorf(v) / NMS_GRID_CELL;
+  return cell < 0 ? 0 : (cell >= cells ? cells - 1 : cell);
+}
+
+/*
+ * greedy nms over the top K candidates where each kept box is only compared
+ * with the boxes registered in the coarse grid cells it covers. the kept set
+ * is the same as a full pairwise sweep, class_agnostic ignores class ids.
+ */
+static int nms_spatial_grid(int validCount, std::vector<float> &outputLocations,
+                            std::vector<float> &scores,
+                            std::vector<int> &classIds, std::vector<int> &order,
+                            float threshold, int class_agnostic,
+                            int model_in_h, int model_in_w,
+                            post_process_workspace_t *ws) {
+  int top_k = nms_select_topk(validCount, scores, order);
+  int grid_w = (model_in_w + NMS_GRID_CELL - 1) / NMS_GRID_CELL;
+  int grid_h = (model_in_h + NMS_GRID_CELL - 1) / NMS_GRID_CELL;
+
+  std::vector<float> &xmin = ws->xmin;
+  std::vector<float> &ymin = ws->ymin;
+  std::vector<float> &xmax = ws->xmax;
+  std::vector<float> &ymax = ws->ymax;
+  std::vector<int> &cls = ws->rank;
+  xmin.resize(top_k);
+  ymin.resize(top_k);
+  xmax.resize(top_k);
+  ymax.resize(top_k);
+  cls.resize(top_k);
+  for (int r = 0; r < top_k; ++r) {
+    int n = order[r];
+    xmin[r] = outputLocations[n * 4 + 0];
+    ymin[r] = outputLocations[n * 4 + 1];
+    xmax[r] = xmin[r] + outputLocations[n * 4 + 2];
+    ymax[r] = ymin[r] + outputLocations[n * 4 + 3];
+    cls[r] = classIds[n];
+  }
+
+  // register every box in the cells it covers, CalculateOverlap adds 1 pixel
+  std::vector<int> &cell_start = ws->cellStart;
+  std::vector<int> &cell_fill = ws->cellFill;
+  std::vector<int> &cell_items = ws->cellItems;
+  cell_start.assign(grid_w * grid_h + 1, 0);
+  for (int r = 0; r < top_k; ++r) {
+    int cx1 = grid_cell(xmax[r] + 1, grid_w);
+    int cy1 = grid_cell(ymax[r] + 1, grid_h);
+    for (int cy = grid_cell(ymin[r], grid_h); cy <= cy1; cy++) {
+      for (int cx = grid_cell(xmin[r], grid_w); cx <= cx1; cx++) {
+        cell_start[cy * grid_w + cx + 1]++;
+      }
+    }
+  }
+  for (int c = 0; c < grid_w * grid_h; ++c) {
+    cell_start[c + 1] += cell_start[c];
+  }
+  cell_fill.assign(cell_start.begin(), cell_start.end() - 1);
+  cell_items.resize(cell_start[grid_w * grid_h]);
+  for (int r = 0; r < top_k; ++r) {
+    int cx1 = grid_cell(xmax[r] + 1, grid_w);
+    int cy1 = grid_cell(ymax[r] + 1, grid_h);
+    for (int cy = grid_cell(ymin[r], grid_h); cy <= cy1; cy++) {
+      for (int cx = grid_cell(xmin[r], grid_w); cx <= cx1; cx++) {
+        cell_items[cell_fill[cy * grid_w + cx]++] = r;
+      }
+    }
+  }
+
+  // cell lists are in rank order, visited stops double checks across cells
+  std::vector<char> &removed = ws->removed;
+  std::vector<int> &visited = ws->visited;
+  removed.assign(top_k, 0);
+  visited.assign(top_k, -1);
+  for (int i = 0; i < top_k; ++i) {
+    if (removed[i]) {
+      continue;
+    }
+    int cx1 = grid_cell(xmax[i] + 1, grid_w);
+    int cy1 = grid_cell(ymax[i] + 1, grid_h);
+    for (int cy = grid_cell(ymin[i], grid_h); cy <= cy1; cy++) {
+      for (int cx = grid_cell(xmin[i], grid_w); cx <= cx1; cx++) {
+        int c = cy * grid_w + cx;
+        for (int k = cell_start[c]; k < cell_start[c + 1]; ++k) {
+          int j = cell_items[k];
+          if (j <= i || removed[j] || visited[j] == i) {
+            continue;
+          }
+          visited[j] = i;
+          if (!class_agnostic && cls[j] != cls[i]) {
+            continue;
+          }
+          float iou = CalculateOverlap(xmin[i], ymin[i], xmax[i], ymax[i],
+                                       xmin[j], ymin[j], xmax[j], ymax[j]);
+          if (iou > threshold) {
+            removed[j] = 1;
+          }
+        }
+      }
+    }
+  }
+
+  for (int r = 0; r < top_k; ++r) {
+    if (removed[r]) {
+      order[r] = -1;
+    }
+  }
+
+  return top_k;
+}
+
 static int quick_sort_indice_inverse(std::vector<float> &input, int left,
                                      int right, std::vector<int> &indices) {
   float key;
@@ -191,6 +479,61 @@ static int quick_sort_indice_inverse(std::vector<float> &input, int left,
   return low;
 }
 
+/*
+ * max and argmax over a contiguous int8 class slice, the first index wins on
+ * ties so the result matches the plain scalar scan
+ */
+static inline int argmax_i8(const int8_t *probs, int count, int8_t *max_prob) {
+  int k = 0;
+  int8_t max_val = probs[0];
+
+#if defined(POSTPROCESS_USE_NEON)
+  if (count >= 16) {
+    int8x16_t vmax = vld1q_s8(probs);
+    for (k = 16; k + 16 <= count; k += 16) {
+      vmax = vmaxq_s8(vmax, vld1q_s8(probs + k));
+    }
+    // armv7 has no vmaxvq_s8, fold with pairwise max instead
+    int8x8_t m = vmax_s8(vget_low_s8(vmax), vget_high_s8(vmax));
+    m = vpmax_s8(m, m);
+    m = vpmax_s8(m, m);
+    m = vpmax_s8(m, m);
+    max_val = vget_lane_s8(m, 0);
+  }
+#elif defined(POSTPROCESS_USE_SSE2)
+  if (count >= 16) {
+    // sse2 only has an unsigned byte max, flip the sign bit around it
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    __m128i vmax =
+        _mm_xor_si128(_mm_loadu_si128((const __m128i *)probs), bias);
+    for (k = 16; k + 16 <= count; k += 16) {
+      __m128i v =
+          _mm_xor_si128(_mm_loadu_si128((const __m128i *)(probs + k)), bias);
+      vmax = _mm_max_epu8(vmax, v);
+    }
+    vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 8));
+    vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 4));
+    vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 2));
+    vmax = _mm_max_epu8(vmax, _mm_srli_si128(vmax, 1));
+    max_val = (int8_t)((_mm_cvtsi128_si32(vmax) & 0xff) ^ 0x80);
+  }
+#endif
+
+  for (; k < count; ++k) {
+    if (probs[k] > max_val) {
+      max_val = probs[k];
+    }
+  }
+
+  int max_id = 0;
+  while (probs[max_id] != max_val) {
+    max_id++;
+  }
+
+  *max_prob = max_val;
+  return max_id;
+}
+
 static float sigmoid(float x) { return 1.0 / (1.0 + expf(-x)); }
 
 static float unsigmoid(float y) { return -1.0 * logf((1.0 / y) - 1.0); }
@@ -210,56 +553,199 @@ static float deqnt_affine_to_f32(int8_t qnt, int32_t zp, float scale) {
   return ((float)qnt - (float)zp) * scale;
 }
 
-static int process(int8_t *input, int *anchor, int grid_h, int grid_w,
-                   int height, int width, int stride, std::vector<float> &boxes,
-                   std::vector<float> &objProbs, std::vector<int> &classId,
-                   float threshold, int32_t zp, float scale) {
+void qnt_param_init(qnt_param_t *qnt, int32_t zp, float scale,
+                    float conf_threshold) {
+  qnt->zp = zp;
+  qnt->scale = scale;
+  qnt->box_thres_i8 = qnt_f32_to_affine(conf_threshold, zp, scale);
+
+  /*
+   * box_conf * class_prob > conf_threshold is the same test as
+   * (box_q - zp) * (class_q - zp) > conf_threshold / scale^2, and since the
+   * left side is an integer it may compare against the floor of the right
+   */
+  double score_thres = floor((double)conf_threshold / ((double)scale * scale));
+  if (score_thres > INT32_MAX) {
+    score_thres = INT32_MAX;
+  }
+  qnt->score_thres_i32 = (int32_t)score_thres;
+
+  // the score sum adds up class scores, it is compared as is, no sigmoid
+  qnt->sum_thres_i8 = qnt_f32_to_affine(conf_threshold, zp, scale);
+
+  /*
+   * anchor free heads are exported with or without the class sigmoid in the
+   * graph. unless told, a tensor whose whole int8 range dequantizes into
+   * [0, 1] is taken as already activated
+   */
+  int activated = deqnt_affine_to_f32(-128, zp, scale) > -0.01f &&
+                  deqnt_affine_to_f32(127, zp, scale) < 1.01f;
+  if (class_activation != POST_ACTIVATION_AUTO) {
+    activated = class_activation == POST_ACTIVATION_NONE;
+  }
+  qnt->prob_activated = activated;
+  qnt->prob_thres_q = 128;
+  for (int q = -128; q <= 127; q++) {
+    float val = deqnt_affine_to_f32(q, zp, scale);
+    qnt->prob_lut[q + 128] = activated ? val : sigmoid(val);
+    qnt->exp_lut[q + 128] = expf(-(q + 128) * scale);
+    if (qnt->prob_thres_q == 128 && qnt->prob_lut[q + 128] > conf_threshold) {
+      qnt->prob_thres_q = q;
+    }
+  }
+}
+
+/* NC1HWC2 keeps channels in blocks of c2, channel ch of a cell lives here */
+static inline int8_t *nc1hwc2_ptr(int8_t *input, int ch, int cell, int grid_len,
+                                  int c2) {
+  return input + ((ch / c2) * grid_len + cell) * c2 + ch % c2;
+}
+
+/* argmax over channels [ch, ch + count), one contiguous run per c2 block */
+static int argmax_nc1hwc2(int8_t *input, int ch, int count, int cell,
+                          int grid_len, int c2, int8_t *max_prob) {
+  int max_id = 0;
+  int8_t max_val = *nc1hwc2_ptr(input, ch, cell, grid_len, c2);
+
+  for (int k = 0; k < count;) {
+    int run = c2 - (ch + k) % c2;
+    if (run > count - k) {
+      run = count - k;
+    }
+
+    int8_t run_max;
+    int run_id = argmax_i8(nc1hwc2_ptr(input, ch + k, cell, grid_len, c2), run,
+                           &run_max);
+    if (run_max > max_val) {
+      max_val = run_max;
+      max_id = k + run_id;
+    }
+    k += run;
+  }
+
+  *max_prob = max_val;
+  return max_id;
+}
 
+/*
+ * anchor based decode of one branch over rows [h_begin, h_end) and anchors
+ * [a_begin, a_end). NumClasses 0 takes class_num at runtime, otherwise the
+ * class count and box stride are constants and the class loop is
+ * unrolled/vectorized by the compiler.
+ */
+template <int NumClasses, int Layout>
+static int decode_branch(int8_t *input, const int *anchor, int grid_h,
+                         int grid_w, int h_begin, int h_end, int a_begin,
+                         int a_end, int stride, int c2, int class_num_rt,
+                         std::vector<float> &boxes,
+                         std::vector<float> &boxScores,
+                         std::vector<int> &classId, const qnt_param_t *qnt) {
+  const int class_num = NumClasses > 0 ? NumClasses : class_num_rt;
+  const int box_size = class_num + 5;
+  const int anchor_per_branch = 3;
+  const int grid_len = grid_h * grid_w;
+  // distance between two channels of one anchor
+  const int ch_step = Layout == POST_LAYOUT_NHWC ? 1 : grid_len;
   int validCount = 0;
-  int grid_len = grid_h * grid_w;
-  int8_t thres_i8 = qnt_f32_to_affine(threshold, zp, scale);
-  for (int a = 0; a < 3; a++) {
-    for (int i = 0; i < grid_h; i++) {
-      for (int j = 0; j < grid_w; j++) {
-        int8_t box_confidence =
-            input[(prop_box_size * a + 4) * grid_len + i * grid_w + j];
-        if (box_confidence >= thres_i8) {
-          int offset = (prop_box_size * a) * grid_len + i * grid_w + j;
-          int8_t *in_ptr = input + offset;
-          float box_x = (deqnt_affine_to_f32(*in_ptr, zp, scale)) * 2.0 - 0.5;
-          float box_y =
-              (deqnt_affine_to_f32(in_ptr[grid_len], zp, scale)) * 2.0 - 0.5;
-          float box_w =
-              (deqnt_affine_to_f32(in_ptr[2 * grid_len], zp, scale)) * 2.0;
-          float box_h =
-              (deqnt_affine_to_f32(in_ptr[3 * grid_len], zp, scale)) * 2.0;
-          box_x = (box_x + j) * (float)stride;
-          box_y = (box_y + i) * (float)stride;
-          box_w = box_w * box_w * (float)anchor[a * 2];
-          box_h = box_h * box_h * (float)anchor[a * 2 + 1];
-          box_x -= (box_w / 2.0);
-          box_y -= (box_h / 2.0);
+  int32_t zp = qnt->zp;
+  float scale = qnt->scale;
+  int8_t thres_i8 = qnt->box_thres_i8;
+
+  // walk memory in order, anchors outermost only for NCHW
+  const int outer_begin = Layout == POST_LAYOUT_NCHW ? a_begin : 0;
+  const int outer_end = Layout == POST_LAYOUT_NCHW ? a_end : 1;
+  const int inner_begin = Layout == POST_LAYOUT_NCHW ? 0 : a_begin;
+  const int inner_end = Layout == POST_LAYOUT_NCHW ? 1 : a_end;
+
+  for (int outer = outer_begin; outer < outer_end; outer++) {
+    for (int h = h_begin; h < h_end; h++) {
+      for (int w = 0; w < grid_w; w++) {
+        for (int inner = inner_begin; inner < inner_end; inner++) {
+          int a = Layout == POST_LAYOUT_NCHW ? outer : inner;
+          int cell = h * grid_w + w;
+          int8_t *hw_ptr;
+          int8_t box_confidence;
+          if (Layout == POST_LAYOUT_NC1HWC2) {
+            // channels are gathered per c2 block, no layout conversion
+            hw_ptr = NULL;
+            box_confidence = *nc1hwc2_ptr(input, a * box_size + 4, cell,
+                                          grid_len, c2);
+          } else if (Layout == POST_LAYOUT_NHWC) {
+            // 新驱动不再有对齐要求
+            hw_ptr = input + (h * grid_w + w) * box_size * anchor_per_branch +
+                     a * box_size;
+          } else {
+            hw_ptr = input + a * box_size * grid_len + h * grid_w + w;
+          }
+
+          if (Layout != POST_LAYOUT_NC1HWC2) {
+            box_confidence = hw_ptr[4 * ch_step];
+          }
+          if (box_confidence < thres_i8) {
+            continue;
+          }
 
-          int8_t maxClassProbs = in_ptr[5 * grid_len];
+          int8_t maxClassProbs;
           int maxClassId = 0;
-          for (int k = 1; k < labels_count; ++k) {
-            int8_t prob = in_ptr[(5 + k) * grid_len];
-            if (prob > maxClassProbs) {
-              maxClassId = k;
-              maxClassProbs = prob;
+          int8_t box_raw[4];
+          if (Layout == POST_LAYOUT_NC1HWC2) {
+            maxClassId = argmax_nc1hwc2(input, a * box_size + 5, class_num,
+                                        cell, grid_len, c2, &maxClassProbs);
+            for (int k = 0; k < 4; k++) {
+              box_raw[k] =
+                  *nc1hwc2_ptr(input, a * box_size + k, cell, grid_len, c2);
+            }
+          } else {
+            maxClassProbs = hw_ptr[5 * ch_step];
+            for (int k = 0; k < 4; k++) {
+              box_raw[k] = hw_ptr[k * ch_step];
             }
           }
-          if (maxClassProbs > thres_i8) {
-            boxes.push_back(box_x);
-            boxes.push_back(box_y);
-            boxes.push_back(box_w);
-            boxes.push_back(box_h);
-            objProbs.push_back(
-                (deqnt_affine_to_f32(maxClassProbs, zp, scale)) *
-                (deqnt_affine_to_f32(box_confidence, zp, scale)));
-            classId.push_back(maxClassId);
-            validCount++;
+          if (class_num > 1 && Layout != POST_LAYOUT_NC1HWC2) {
+            if (Layout == POST_LAYOUT_NHWC) {
+              maxClassId = argmax_i8(hw_ptr + 5, class_num, &maxClassProbs);
+            } else {
+              for (int k = 1; k < class_num; ++k) {
+                int8_t prob = hw_ptr[(5 + k) * ch_step];
+                if (prob > maxClassProbs) {
+                  maxClassId = k;
+                  maxClassProbs = prob;
+                }
+              }
+            }
           }
+
+          int32_t score_i32 = (int32_t)(box_confidence - zp) *
+                              (int32_t)(maxClassProbs - zp);
+          if (score_i32 <= qnt->score_thres_i32) {
+            continue;
+          }
+
+          float box_x, box_y, box_w, box_h;
+          float limit_score = (float)score_i32 * scale * scale;
+
+          box_x = deqnt_affine_to_f32(box_raw[0], zp, scale) * 2.0 - 0.5;
+          box_y = deqnt_affine_to_f32(box_raw[1], zp, scale) * 2.0 - 0.5;
+          box_w = deqnt_affine_to_f32(box_raw[2], zp, scale) * 2.0;
+          box_h = deqnt_affine_to_f32(box_raw[3], zp, scale) * 2.0;
+          box_w = box_w * box_w;
+          box_h = box_h * box_h;
+
+          box_x = (box_x + w) * (float)stride;
+          box_y = (box_y + h) * (float)stride;
+          box_w *= (float)anchor[a * 2];
+          box_h *= (float)anchor[a * 2 + 1];
+
+          box_x -= (box_w / 2.0);
+          box_y -= (box_h / 2.0);
+
+          boxes.push_back(box_x);
+          boxes.push_back(box_y);
+          boxes.push_back(box_w);
+          boxes.push_back(box_h);
+          boxScores.push_back(limit_score);
+          classId.push_back(maxClassId);
+          validCount++;
         }
       }
     }
@@ -267,158 +753,594 @@ static int process(int8_t *input, int *anchor, int grid_h, int grid_w,
   return validCount;
 }
 
-static int process_native_nhwc(int8_t *input, int *anchor, int grid_h,
-                               int grid_w, int height, int width, int stride,
-                               std::vector<float> &boxes,
-                               std::vector<float> &boxScores,
-                               std::vector<int> &classId, float threshold,
-                               int32_t zp, float scale) {
-  int validCount = 0;
-  int8_t thres_i8 = qnt_f32_to_affine(threshold, zp, scale);
-
-  int anchor_per_branch = 3;
-  // 新驱动不再有对齐要求
-  // int align_c = get_align(prop_box_size*anchor_per_branch, 16);
-  int align_c = prop_box_size * anchor_per_branch;
-  // printf("align_c %d\n", align_c);
-
-  for (int h = 0; h < grid_h; h++) {
-    for (int w = 0; w < grid_w; w++) {
-      for (int a = 0; a < anchor_per_branch; a++) {
-        int hw_offset = h * grid_w * align_c + w * align_c + a * prop_box_size;
-        // int hw_offset = h*grid_w*anchor_per_branch*prop_box_size +
-        // w*anchor_per_branch*prop_box_size + a*prop_box_size;
-        int8_t *hw_ptr = input + hw_offset;
-        int8_t box_confidence = hw_ptr[4];
-
-        if (box_confidence >= thres_i8) {
-          // printf("box_conf %d, thres_i8 %d\n", box_confidence, thres_i8);
-
-          int8_t maxClassProbs = hw_ptr[5];
-          int maxClassId = 0;
-          for (int k = 1; k < labels_count; ++k) {
-            int8_t prob = hw_ptr[5 + k];
-            if (prob > maxClassProbs) {
-              maxClassId = k;
-              maxClassProbs = prob;
-            }
-          }
+typedef int (*decode_func_t)(int8_t *input, const int *anchor, int grid_h,
+                             int grid_w, int h_begin, int h_end, int a_begin,
+                             int a_end, int stride, int c2, int class_num,
+                             std::vector<float> &boxes,
+                             std::vector<float> &boxScores,
+                             std::vector<int> &classId,
+                             const qnt_param_t *qnt);
 
-          // printf("box_conf %d, thres_i8 %d, maxClassProbs %d\n",
-          // box_confidence, thres_i8, maxClassProbs);
-          float box_conf_f32 = deqnt_affine_to_f32(box_confidence, zp, scale);
-          float class_prob_f32 = deqnt_affine_to_f32(maxClassProbs, zp, scale);
-          float limit_score = box_conf_f32 * class_prob_f32;
-
-          if (limit_score > threshold) {
-            float box_x, box_y, box_w, box_h;
-
-            box_x = deqnt_affine_to_f32(hw_ptr[0], zp, scale) * 2.0 - 0.5;
-            box_y = deqnt_affine_to_f32(hw_ptr[1], zp, scale) * 2.0 - 0.5;
-            box_w = deqnt_affine_to_f32(hw_ptr[2], zp, scale) * 2.0;
-            box_h = deqnt_affine_to_f32(hw_ptr[3], zp, scale) * 2.0;
-            box_w = box_w * box_w;
-            box_h = box_h * box_h;
-
-            box_x = (box_x + w) * (float)stride;
-            box_y = (box_y + h) * (float)stride;
-            box_w *= (float)anchor[a * 2];
-            box_h *= (float)anchor[a * 2 + 1];
-
-            box_x -= (box_w / 2.0);
-            box_y -= (box_h / 2.0);
-
-            boxes.push_back(box_x);
-            boxes.push_back(box_y);
-            boxes.push_back(box_w);
-            boxes.push_back(box_h);
-            boxScores.push_back(limit_score);
-            classId.push_back(maxClassId);
-            validCount++;
-          }
-        }
+/* specialized kernels for the common class counts, generic otherwise */
+static decode_func_t select_decode_kernel(int class_num, int layout) {
+  if (decode_generic) {
+    class_num = 0;
+  }
+  if (layout == POST_LAYOUT_NC1HWC2) {
+    switch (class_num) {
+    case 1:
+      return decode_branch<1, POST_LAYOUT_NC1HWC2>;
+    case 2:
+      return decode_branch<2, POST_LAYOUT_NC1HWC2>;
+    case 80:
+      return decode_branch<80, POST_LAYOUT_NC1HWC2>;
+    default:
+      return decode_branch<0, POST_LAYOUT_NC1HWC2>;
+    }
+  }
+
+  if (layout == POST_LAYOUT_NCHW) {
+    switch (class_num) {
+    case 1:
+      return decode_branch<1, POST_LAYOUT_NCHW>;
+    case 2:
+      return decode_branch<2, POST_LAYOUT_NCHW>;
+    case 80:
+      return decode_branch<80, POST_LAYOUT_NCHW>;
+    default:
+      return decode_branch<0, POST_LAYOUT_NCHW>;
+    }
+  }
+
+  switch (class_num) {
+  case 1:
+    return decode_branch<1, POST_LAYOUT_NHWC>;
+  case 2:
+    return decode_branch<2, POST_LAYOUT_NHWC>;
+  case 80:
+    return decode_branch<80, POST_LAYOUT_NHWC>;
+  default:
+    return decode_branch<0, POST_LAYOUT_NHWC>;
+  }
+}
+
+#define DECODE_BRANCH_NUM 3
+#define DECODE_ANCHOR_NUM 3
+
+typedef struct {
+  std::vector<float> boxes;
+  std::vector<float> probs;
+  std::vector<int> classId;
+} decode_buf_t;
+
+typedef struct {
+  post_process_pool_t *pool;
+  int index;
+} decode_worker_t;
+
+/*
+ * persistent decode workers, worker w decodes row band w of every branch into
+ * its own buffers. the caller thread works as worker 0. NCHW decodes anchor
+ * by anchor, a band keeps one buffer per anchor there so the merge can put
+ * them back in the order of the serial decode.
+ */
+struct __post_process_pool_t {
+  int threads;
+  std::vector<pthread_t> tids;
+  std::vector<decode_worker_t> workers;
+  std::vector<decode_buf_t> bufs; // [worker][branch][anchor group]
+  pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  unsigned long generation;
+  int pending;
+  int quit;
+
+  int8_t *inputs[DECODE_BRANCH_NUM];
+  decode_func_t kernel;
+  int anchor_groups; /* DECODE_ANCHOR_NUM for NCHW, 1 otherwise */
+  int c2;
+  int class_num;
+  int model_in_h;
+  int model_in_w;
+  const qnt_param_t *qnts;
+};
+
+static const int *branch_anchors[DECODE_BRANCH_NUM] = {anchor0, anchor1,
+                                                       anchor2};
+static const int branch_strides[DECODE_BRANCH_NUM] = {8, 16, 32};
+
+static decode_buf_t *decode_buf(post_process_pool_t *pool, int worker,
+                                int branch, int group) {
+  return &pool->bufs[(worker * DECODE_BRANCH_NUM + branch) * DECODE_ANCHOR_NUM +
+                     group];
+}
+
+static void decode_band(post_process_pool_t *pool, int index) {
+  for (int b = 0; b < DECODE_BRANCH_NUM; b++) {
+    int stride = branch_strides[b];
+    int grid_h = pool->model_in_h / stride;
+    int grid_w = pool->model_in_w / stride;
+    int h_begin = grid_h * index / pool->threads;
+    int h_end = grid_h * (index + 1) / pool->threads;
+
+    for (int g = 0; g < pool->anchor_groups; g++) {
+      decode_buf_t *buf = decode_buf(pool, index, b, g);
+      int a_begin = DECODE_ANCHOR_NUM * g / pool->anchor_groups;
+      int a_end = DECODE_ANCHOR_NUM * (g + 1) / pool->anchor_groups;
+
+      buf->boxes.clear();
+      buf->probs.clear();
+      buf->classId.clear();
+      pool->kernel(pool->inputs[b], branch_anchors[b], grid_h, grid_w,
+                   h_begin, h_end, a_begin, a_end, stride, pool->c2,
+                   pool->class_num, buf->boxes, buf->probs, buf->classId,
+                   &pool->qnts[b]);
+    }
+  }
+}
+
+static void *decode_worker_func(void *arg) {
+  decode_worker_t *worker = (decode_worker_t *)arg;
+  post_process_pool_t *pool = worker->pool;
+  unsigned long seen = 0;
+
+  while (1) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->generation == seen && !pool->quit) {
+      pthread_cond_wait(&pool->start, &pool->mutex);
+    }
+    if (pool->quit) {
+      pthread_mutex_unlock(&pool->mutex);
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->mutex);
+
+    decode_band(pool, worker->index);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (--pool->pending == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+  }
+
+  return NULL;
+}
+
+static void post_process_pool_destroy(post_process_pool_t *pool) {
+  if (!pool) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->quit = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (size_t i = 0; i < pool->tids.size(); i++) {
+    pthread_join(pool->tids[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  delete pool;
+}
+
+static post_process_pool_t *post_process_pool_create(int threads,
+                                                     int model_in_h,
+                                                     int model_in_w) {
+  post_process_pool_t *pool = new post_process_pool_t;
+
+  pool->threads = threads;
+  pool->generation = 0;
+  pool->pending = 0;
+  pool->quit = 0;
+  pool->model_in_h = model_in_h;
+  pool->model_in_w = model_in_w;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  pool->bufs.resize(threads * DECODE_BRANCH_NUM * DECODE_ANCHOR_NUM);
+  for (int w = 0; w < threads; w++) {
+    for (int b = 0; b < DECODE_BRANCH_NUM; b++) {
+      int grid_h = model_in_h / branch_strides[b];
+      int grid_w = model_in_w / branch_strides[b];
+      int rows = grid_h * (w + 1) / threads - grid_h * w / threads;
+      for (int g = 0; g < DECODE_ANCHOR_NUM; g++) {
+        // group 0 takes all anchors of a band unless NCHW splits them
+        int anchors = g == 0 ? DECODE_ANCHOR_NUM : 1;
+        decode_buf_t *buf = decode_buf(pool, w, b, g);
+        buf->boxes.reserve(rows * grid_w * anchors * 4);
+        buf->probs.reserve(rows * grid_w * anchors);
+        buf->classId.reserve(rows * grid_w * anchors);
       }
     }
   }
-  return validCount;
+
+  pool->workers.resize(threads);
+  for (int w = 0; w < threads; w++) {
+    pool->workers[w].pool = pool;
+    pool->workers[w].index = w;
+  }
+
+  for (int w = 1; w < threads; w++) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, decode_worker_func, &pool->workers[w]) !=
+        0) {
+      printf("[post_process] create decode worker %d failed\n", w);
+      post_process_pool_destroy(pool);
+      return NULL;
+    }
+    pool->tids.push_back(tid);
+  }
+
+  return pool;
 }
 
-int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h,
-                 int model_in_w, float conf_threshold, float nms_threshold,
-                 float scale_w, float scale_h, std::vector<int32_t> &qnt_zps,
-                 std::vector<float> &qnt_scales, detect_result_group_t *group) {
-  static int init = -1;
-  if (init == -1) {
-    int ret = 0;
-    ret = loadLabelName(LABEL_NALE_TXT_PATH, labels);
-    if (ret <= 0) {
+/* decode all branches on the pool and merge in the serial decode order */
+static int post_process_pool_decode(post_process_pool_t *pool,
+                                    decode_func_t kernel, int layout, int c2,
+                                    int class_num, int8_t *input0,
+                                    int8_t *input1, int8_t *input2,
+                                    const qnt_param_t *qnts,
+                                    std::vector<float> &boxes,
+                                    std::vector<float> &probs,
+                                    std::vector<int> &classId) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->inputs[0] = input0;
+  pool->inputs[1] = input1;
+  pool->inputs[2] = input2;
+  pool->qnts = qnts;
+  pool->kernel = kernel;
+  pool->anchor_groups = layout == POST_LAYOUT_NCHW ? DECODE_ANCHOR_NUM : 1;
+  pool->c2 = c2;
+  pool->class_num = class_num;
+  pool->pending = pool->threads - 1;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->mutex);
+
+  decode_band(pool, 0);
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->done, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+
+  // branch, then anchor for NCHW, then rows
+  for (int b = 0; b < DECODE_BRANCH_NUM; b++) {
+    for (int g = 0; g < pool->anchor_groups; g++) {
+      for (int w = 0; w < pool->threads; w++) {
+        decode_buf_t *buf = decode_buf(pool, w, b, g);
+        boxes.insert(boxes.end(), buf->boxes.begin(), buf->boxes.end());
+        probs.insert(probs.end(), buf->probs.begin(), buf->probs.end());
+        classId.insert(classId.end(), buf->classId.begin(),
+                       buf->classId.end());
+      }
+    }
+  }
+
+  return (int)probs.size();
+}
+
+static size_t workspace_capacity(post_process_workspace_t *ws) {
+  size_t pool_capacity = 0;
+  if (ws->pool) {
+    for (size_t i = 0; i < ws->pool->bufs.size(); i++) {
+      pool_capacity += ws->pool->bufs[i].boxes.capacity() +
+                       ws->pool->bufs[i].probs.capacity() +
+                       ws->pool->bufs[i].classId.capacity();
+    }
+  }
+
+  return pool_capacity + ws->filterBoxes.capacity() + ws->objProbs.capacity() +
+         ws->classId.capacity() + ws->indexArray.capacity() +
+         ws->sortedProbs.capacity() + ws->classSeen.capacity() +
+         ws->bucket.capacity() + ws->fill.capacity() + ws->rank.capacity() +
+         ws->xmin.capacity() + ws->ymin.capacity() + ws->xmax.capacity() +
+         ws->ymax.capacity() + ws->removed.capacity() +
+         ws->cellStart.capacity() + ws->cellFill.capacity() +
+         ws->cellItems.capacity() + ws->visited.capacity();
+}
+
+static void workspace_account(post_process_workspace_t *ws) {
+  size_t capacity = workspace_capacity(ws);
+  if (capacity != ws->capacity) {
+    ws->capacity = capacity;
+    ws->realloc_count++;
+  }
+}
+
+post_process_workspace_t *post_process_workspace_create(int model_in_h,
+                                                        int model_in_w) {
+  post_process_workspace_t *ws = new post_process_workspace_t;
+  int max_candidates = 0;
+
+  // one candidate at most per anchor of every grid cell
+  for (int stride = 8; stride <= 32; stride *= 2) {
+    max_candidates += (model_in_h / stride) * (model_in_w / stride) * 3;
+  }
+  int top_k = max_candidates < NMS_TOP_K ? max_candidates : NMS_TOP_K;
+
+  ws->filterBoxes.reserve(max_candidates * 4);
+  ws->objProbs.reserve(max_candidates);
+  ws->classId.reserve(max_candidates);
+  ws->indexArray.reserve(max_candidates);
+  ws->sortedProbs.reserve(max_candidates);
+  ws->classSeen.reserve(OBJ_CLASS_NUM_MAX);
+  ws->bucket.reserve(OBJ_CLASS_NUM_MAX + 1);
+  ws->fill.reserve(OBJ_CLASS_NUM_MAX);
+  ws->rank.reserve(top_k);
+  ws->xmin.reserve(top_k);
+  ws->ymin.reserve(top_k);
+  ws->xmax.reserve(top_k);
+  ws->ymax.reserve(top_k);
+  ws->removed.reserve(top_k);
+  int grid_cells = ((model_in_h + NMS_GRID_CELL - 1) / NMS_GRID_CELL) *
+                   ((model_in_w + NMS_GRID_CELL - 1) / NMS_GRID_CELL);
+  ws->cellStart.reserve(grid_cells + 1);
+  ws->cellFill.reserve(grid_cells);
+  // dense frames decode boxes as large as the model input, each in every cell
+  ws->cellItems.reserve(top_k * grid_cells);
+  ws->visited.reserve(top_k);
+
+  ws->model_in_h = model_in_h;
+  ws->model_in_w = model_in_w;
+  ws->threads = 1;
+  ws->pool = NULL;
+  ws->layout = POST_LAYOUT_NHWC;
+  ws->c2 = 1;
+  ws->capacity = workspace_capacity(ws);
+  ws->realloc_count = 0;
+  printf("[post_process] workspace for %d candidates\n", max_candidates);
+
+  return ws;
+}
+
+void post_process_workspace_destroy(post_process_workspace_t *ws) {
+  post_process_pool_destroy(ws->pool);
+  delete ws;
+}
+
+int post_process_workspace_set_threads(post_process_workspace_t *ws,
+                                       int threads) {
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  post_process_pool_destroy(ws->pool);
+  ws->pool = NULL;
+  ws->threads = 1;
+
+  if (threads > 1) {
+    ws->pool =
+        post_process_pool_create(threads, ws->model_in_h, ws->model_in_w);
+    if (!ws->pool) {
       return -1;
     }
+    ws->threads = threads;
+  }
+
+  ws->capacity = workspace_capacity(ws);
+  printf("[post_process] decode threads:[%d]\n", ws->threads);
+
+  return 0;
+}
+
+void post_process_set_nms_method(nms_method_e method) { nms_method = method; }
+
+void post_process_set_decode_generic(int generic) { decode_generic = generic; }
+
+void post_process_set_class_activation(post_activation_e activation) {
+  class_activation = activation;
+}
+
+yolo_head_e post_process_detect_head(const post_tensor_t *outputs,
+                                     int n_output) {
+  if (n_output == 3) {
+    return YOLO_HEAD_ANCHOR_BASED;
+  }
+
+  if (n_output != 6 && n_output != 9) {
+    return YOLO_HEAD_UNKNOWN;
+  }
+
+  // box, class and optionally score sum for each of the three strides
+  int per_branch = n_output / 3;
+  for (int b = 0; b < 3; b++) {
+    const post_tensor_t *box = &outputs[b * per_branch];
+    const post_tensor_t *cls = &outputs[b * per_branch + 1];
+    if (box->channels % 4 != 0 || box->channels / 4 > DFL_LEN_MAX ||
+        box->grid_h != cls->grid_h || box->grid_w != cls->grid_w) {
+      return YOLO_HEAD_UNKNOWN;
+    }
+    if (per_branch == 3 && outputs[b * per_branch + 2].channels != 1) {
+      return YOLO_HEAD_UNKNOWN;
+    }
+  }
 
-    labels_count = ret;
-    prop_box_size = labels_count + 5;
-    printf("[post_process] found labels:[%d]\n", labels_count);
-    init = 0;
+  return YOLO_HEAD_ANCHOR_FREE;
+}
+
+/*
+ * softmax expectation over one side's DFL bins. exp_lut[d] holds
+ * exp(-d * scale) so the softmax needs no expf, the 16 bin weighted sum is
+ * vectorized.
+ */
+static float dfl_expectation(const int8_t *bins, int dfl_len,
+                             const float *exp_lut) {
+  float exps[DFL_LEN_MAX];
+  int8_t max_q;
+  argmax_i8(bins, dfl_len, &max_q);
+  for (int i = 0; i < dfl_len; i++) {
+    exps[i] = exp_lut[max_q - bins[i]];
   }
-  memset(group, 0, sizeof(detect_result_group_t));
 
-  std::vector<float> filterBoxes;
-  std::vector<float> objProbs;
-  std::vector<int> classId;
+  float sum = 0.f;
+  float acc = 0.f;
+#if defined(POSTPROCESS_USE_NEON)
+  if (dfl_len == 16) {
+    static const float bin_idx[16] = {0, 1, 2,  3,  4,  5,  6,  7,
+                                      8, 9, 10, 11, 12, 13, 14, 15};
+    float32x4_t vsum = vdupq_n_f32(0.f);
+    float32x4_t vacc = vdupq_n_f32(0.f);
+    for (int i = 0; i < 16; i += 4) {
+      float32x4_t v = vld1q_f32(exps + i);
+      vsum = vaddq_f32(vsum, v);
+      vacc = vmlaq_f32(vacc, v, vld1q_f32(bin_idx + i));
+    }
+    float32x2_t s2 = vadd_f32(vget_low_f32(vsum), vget_high_f32(vsum));
+    float32x2_t a2 = vadd_f32(vget_low_f32(vacc), vget_high_f32(vacc));
+    sum = vget_lane_f32(vpadd_f32(s2, s2), 0);
+    acc = vget_lane_f32(vpadd_f32(a2, a2), 0);
+    return acc / sum;
+  }
+#elif defined(POSTPROCESS_USE_SSE2)
+  if (dfl_len == 16) {
+    __m128i vidx = _mm_set_epi32(3, 2, 1, 0);
+    __m128 vsum = _mm_setzero_ps();
+    __m128 vacc = _mm_setzero_ps();
+    for (int i = 0; i < 16; i += 4) {
+      __m128 v = _mm_loadu_ps(exps + i);
+      vsum = _mm_add_ps(vsum, v);
+      vacc = _mm_add_ps(vacc, _mm_mul_ps(v, _mm_cvtepi32_ps(vidx)));
+      vidx = _mm_add_epi32(vidx, _mm_set1_epi32(4));
+    }
+    float s4[4], a4[4];
+    _mm_storeu_ps(s4, vsum);
+    _mm_storeu_ps(a4, vacc);
+    sum = (s4[0] + s4[1]) + (s4[2] + s4[3]);
+    acc = (a4[0] + a4[1]) + (a4[2] + a4[3]);
+    return acc / sum;
+  }
+#endif
+
+  for (int i = 0; i < dfl_len; i++) {
+    sum += exps[i];
+    acc += exps[i] * i;
+  }
+  return acc / sum;
+}
+
+/*
+ * anchor free (yolov8/yolo11) branch in native NHWC: a DFL box tensor, a class
+ * tensor and an optional per cell score sum used as an early skip
+ */
+static int process_anchor_free_nhwc(const post_tensor_t *box,
+                                    const post_tensor_t *cls,
+                                    const post_tensor_t *score_sum, int stride,
+                                    int class_num_max,
+                                    const qnt_param_t *box_qnt,
+                                    const qnt_param_t *cls_qnt,
+                                    const qnt_param_t *sum_qnt,
+                                    std::vector<float> &boxes,
+                                    std::vector<float> &boxScores,
+                                    std::vector<int> &classId) {
+  int validCount = 0;
+  int dfl_len = box->channels / 4;
+  int class_num =
+      cls->channels < class_num_max ? cls->channels : class_num_max;
+
+  for (int h = 0; h < cls->grid_h; h++) {
+    for (int w = 0; w < cls->grid_w; w++) {
+      int cell = h * cls->grid_w + w;
+
+      if (score_sum &&
+          score_sum->data[cell * score_sum->channels] < sum_qnt->sum_thres_i8) {
+        continue;
+      }
+
+      int8_t maxClassProbs;
+      int maxClassId = argmax_i8(cls->data + cell * cls->channels, class_num,
+                                 &maxClassProbs);
+      if (maxClassProbs < cls_qnt->prob_thres_q) {
+        continue;
+      }
+
+      const int8_t *box_ptr = box->data + cell * box->channels;
+      float dist[4];
+      for (int side = 0; side < 4; side++) {
+        dist[side] = dfl_expectation(box_ptr + side * dfl_len, dfl_len,
+                                     box_qnt->exp_lut);
+      }
+
+      float x1 = (w + 0.5f - dist[0]) * stride;
+      float y1 = (h + 0.5f - dist[1]) * stride;
+      float x2 = (w + 0.5f + dist[2]) * stride;
+      float y2 = (h + 0.5f + dist[3]) * stride;
+
+      boxes.push_back(x1);
+      boxes.push_back(y1);
+      boxes.push_back(x2 - x1);
+      boxes.push_back(y2 - y1);
+      boxScores.push_back(cls_qnt->prob_lut[maxClassProbs + 128]);
+      classId.push_back(maxClassId);
+      validCount++;
+    }
+  }
+
+  return validCount;
+}
+
+/* nms the decoded candidates in ws and fill the result group */
+static int post_process_finish(int validCount, int model_in_h, int model_in_w,
+                               float nms_threshold, float scale_w,
+                               float scale_h, post_process_workspace_t *ws,
+                               detect_result_group_t *group) {
+  std::vector<float> &filterBoxes = ws->filterBoxes;
+  std::vector<float> &objProbs = ws->objProbs;
+  std::vector<int> &classId = ws->classId;
 
-  // stride 8
-  int stride0 = 8;
-  int grid_h0 = model_in_h / stride0;
-  int grid_w0 = model_in_w / stride0;
-  int validCount0 = 0;
-  validCount0 =
-      process_native_nhwc(input0, (int *)anchor0, grid_h0, grid_w0, model_in_h,
-                          model_in_w, stride0, filterBoxes, objProbs, classId,
-                          conf_threshold, qnt_zps[0], qnt_scales[0]);
-
-  // stride 16
-  int stride1 = 16;
-  int grid_h1 = model_in_h / stride1;
-  int grid_w1 = model_in_w / stride1;
-  int validCount1 = 0;
-  validCount1 =
-      process_native_nhwc(input1, (int *)anchor1, grid_h1, grid_w1, model_in_h,
-                          model_in_w, stride1, filterBoxes, objProbs, classId,
-                          conf_threshold, qnt_zps[1], qnt_scales[1]);
-
-  // stride 32
-  int stride2 = 32;
-  int grid_h2 = model_in_h / stride2;
-  int grid_w2 = model_in_w / stride2;
-  int validCount2 = 0;
-  validCount2 =
-      process_native_nhwc(input2, (int *)anchor2, grid_h2, grid_w2, model_in_h,
-                          model_in_w, stride2, filterBoxes, objProbs, classId,
-                          conf_threshold, qnt_zps[2], qnt_scales[2]);
-
-  int validCount = validCount0 + validCount1 + validCount2;
   // no object detect
   if (validCount <= 0) {
+    workspace_account(ws);
     return 0;
   }
 
-  std::vector<int> indexArray;
-  for (int i = 0; i < validCount; ++i) {
-    indexArray.push_back(i);
-  }
+  std::vector<int> &indexArray = ws->indexArray;
+  int sortedCount = validCount;
+  if (nms_method == NMS_METHOD_TOPK_BATCHED) {
+    sortedCount = nms_topk_batched(validCount, filterBoxes, objProbs, classId,
+                                   indexArray, nms_threshold, ws);
+  } else if (nms_method == NMS_METHOD_SPATIAL_GRID ||
+             nms_method == NMS_METHOD_SPATIAL_GRID_AGNOSTIC) {
+    sortedCount = nms_spatial_grid(
+        validCount, filterBoxes, objProbs, classId, indexArray, nms_threshold,
+        nms_method == NMS_METHOD_SPATIAL_GRID_AGNOSTIC, model_in_h, model_in_w,
+        ws);
+  } else {
+    indexArray.resize(validCount);
+    for (int i = 0; i < validCount; ++i) {
+      indexArray[i] = i;
+    }
 
-  quick_sort_indice_inverse(objProbs, 0, validCount - 1, indexArray);
+    // the legacy sort works in place, keep objProbs indexed by candidate
+    std::vector<float> &sortedProbs = ws->sortedProbs;
+    sortedProbs.assign(objProbs.begin(), objProbs.end());
+    quick_sort_indice_inverse(sortedProbs, 0, validCount - 1, indexArray);
 
-  std::set<int> class_set(std::begin(classId), std::end(classId));
+    std::vector<char> &classSeen = ws->classSeen;
+    classSeen.assign(ws->labels->count, 0);
+    for (int i = 0; i < validCount; ++i) {
+      classSeen[classId[i]] = 1;
+    }
 
-  for (auto c : class_set) {
-    nms(validCount, filterBoxes, classId, indexArray, c, nms_threshold);
+    for (int c = 0; c < ws->labels->count; ++c) {
+      if (classSeen[c]) {
+        nms(validCount, filterBoxes, classId, indexArray, c, nms_threshold);
+      }
+    }
   }
 
   int last_count = 0;
   group->count = 0;
   /* box valid detect target */
-  for (int i = 0; i < validCount; ++i) {
+  for (int i = 0; i < sortedCount; ++i) {
 
     if (indexArray[i] == -1 || last_count >= OBJ_NUMB_MAX_SIZE) {
       continue;
@@ -430,7 +1352,7 @@ int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h,
     float x2 = x1 + filterBoxes[n * 4 + 2];
     float y2 = y1 + filterBoxes[n * 4 + 3];
     int id = classId[n];
-    float obj_conf = objProbs[i];
+    float obj_conf = objProbs[n];
 
     group->results[last_count].box.left =
         (int)(clamp(x1, 0, model_in_w) / scale_w);
@@ -441,16 +1363,113 @@ int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h,
     group->results[last_count].box.bottom =
         (int)(clamp(y2, 0, model_in_h) / scale_h);
     group->results[last_count].prop = obj_conf;
-    char *label = labels[id];
-    strncpy(group->results[last_count].name, label, OBJ_NAME_MAX_SIZE);
-
-    // printf("result %2d: (%4d, %4d, %4d, %4d), %s\n", i,
-    // group->results[last_count].box.left, group->results[last_count].box.top,
-    //        group->results[last_count].box.right,
-    //        group->results[last_count].box.bottom, label);
+    group->results[last_count].class_id = id;
     last_count++;
   }
   group->count = last_count;
 
+  workspace_account(ws);
+
   return 0;
 }
+
+int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h,
+                 int model_in_w, float nms_threshold, float scale_w,
+                 float scale_h, const qnt_param_t *qnts,
+                 post_process_workspace_t *ws, detect_result_group_t *group) {
+  memset(group, 0, sizeof(detect_result_group_t));
+  if (!ws->labels || ws->labels->count <= 0) {
+    return -1;
+  }
+  group->labels = ws->labels;
+
+  // reset only, capacity is kept across frames
+  std::vector<float> &filterBoxes = ws->filterBoxes;
+  std::vector<float> &objProbs = ws->objProbs;
+  std::vector<int> &classId = ws->classId;
+  filterBoxes.clear();
+  objProbs.clear();
+  classId.clear();
+
+  const int class_num = ws->labels->count;
+  decode_func_t kernel = select_decode_kernel(class_num, ws->layout);
+  int validCount = 0;
+  if (ws->pool && ws->model_in_h == model_in_h &&
+      ws->model_in_w == model_in_w) {
+    validCount =
+        post_process_pool_decode(ws->pool, kernel, ws->layout, ws->c2,
+                                 class_num, input0, input1, input2, qnts,
+                                 filterBoxes, objProbs, classId);
+  } else {
+    // stride 8
+    int stride0 = 8;
+    int grid_h0 = model_in_h / stride0;
+    int grid_w0 = model_in_w / stride0;
+    int validCount0 = 0;
+    validCount0 =
+        kernel(input0, anchor0, grid_h0, grid_w0, 0, grid_h0, 0, 3, stride0,
+               ws->c2, class_num, filterBoxes, objProbs, classId, &qnts[0]);
+
+    // stride 16
+    int stride1 = 16;
+    int grid_h1 = model_in_h / stride1;
+    int grid_w1 = model_in_w / stride1;
+    int validCount1 = 0;
+    validCount1 =
+        kernel(input1, anchor1, grid_h1, grid_w1, 0, grid_h1, 0, 3, stride1,
+               ws->c2, class_num, filterBoxes, objProbs, classId, &qnts[1]);
+
+    // stride 32
+    int stride2 = 32;
+    int grid_h2 = model_in_h / stride2;
+    int grid_w2 = model_in_w / stride2;
+    int validCount2 = 0;
+    validCount2 =
+        kernel(input2, anchor2, grid_h2, grid_w2, 0, grid_h2, 0, 3, stride2,
+               ws->c2, class_num, filterBoxes, objProbs, classId, &qnts[2]);
+
+    validCount = validCount0 + validCount1 + validCount2;
+  }
+
+  return post_process_finish(validCount, model_in_h, model_in_w, nms_threshold,
+                             scale_w, scale_h, ws, group);
+}
+
+int post_process_anchor_free(const post_tensor_t *outputs, int n_output,
+                             int model_in_h, int model_in_w,
+                             float nms_threshold, float scale_w, float scale_h,
+                             const qnt_param_t *qnts,
+                             post_process_workspace_t *ws,
+                             detect_result_group_t *group) {
+  memset(group, 0, sizeof(detect_result_group_t));
+  if (!ws->labels || ws->labels->count <= 0) {
+    return -1;
+  }
+  group->labels = ws->labels;
+
+  std::vector<float> &filterBoxes = ws->filterBoxes;
+  std::vector<float> &objProbs = ws->objProbs;
+  std::vector<int> &classId = ws->classId;
+  filterBoxes.clear();
+  objProbs.clear();
+  classId.clear();
+
+  int validCount = 0;
+  int per_branch = n_output / 3;
+  for (int b = 0; b < 3; b++) {
+    int box_idx = b * per_branch;
+    int cls_idx = box_idx + 1;
+    int sum_idx = box_idx + 2;
+    int stride = model_in_h / outputs[cls_idx].grid_h;
+
+    validCount += process_anchor_free_nhwc(
+        &outputs[box_idx], &outputs[cls_idx],
+        per_branch == 3 ? &outputs[sum_idx] : NULL, stride, ws->labels->count,
+        &qnts[box_idx], &qnts[cls_idx],
+        per_branch == 3 ? &qnts[sum_idx] : NULL, filterBoxes, objProbs,
+        classId);
+  }
+
+  return post_process_finish(validCount, model_in_h, model_in_w, nms_threshold,
+                             scale_w, scale_h, ws, group);
+}
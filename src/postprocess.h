@@ -1,13 +1,17 @@
 #ifndef _RKNN_ZERO_COPY_DEMO_POSTPROCESS_H_
 #define _RKNN_ZERO_COPY_DEMO_POSTPROCESS_H_
 
+#include <stddef.h>
 #include <stdint.h>
 #include <vector>
 
-#define OBJ_NAME_MAX_SIZE 16
 #define OBJ_NUMB_MAX_SIZE 64
+#define OBJ_CLASS_NUM_MAX 100
 #define NMS_THRESH 0.45
 #define BOX_THRESH 0.25
+// output tensors of a detection head, 3 branches of box/class/score sum
+#define POST_TENSOR_MAX 9
+#define DFL_LEN_MAX 32
 
 typedef struct _BOX_RECT {
   int left;
@@ -16,8 +20,15 @@ typedef struct _BOX_RECT {
   int bottom;
 } BOX_RECT;
 
+/* class names of one model, loaded once and read only afterwards */
+typedef struct __label_table_t {
+  int count;
+  char *names[OBJ_CLASS_NUM_MAX];
+  struct __label_table_t *next; /* shared tables, see label_table_get */
+} label_table_t;
+
 typedef struct __detect_result_t {
-  char name[OBJ_NAME_MAX_SIZE];
+  int class_id;
   BOX_RECT box;
   float prop;
 } detect_result_t;
@@ -25,12 +36,136 @@ typedef struct __detect_result_t {
 typedef struct _detect_result_group_t {
   int id;
   int count;
+  const label_table_t *labels; /* resolves class_id, from label_table_get */
   detect_result_t results[OBJ_NUMB_MAX_SIZE];
 } detect_result_group_t;
 
+/* memory layout of the anchor based output tensors */
+enum { POST_LAYOUT_NCHW = 0, POST_LAYOUT_NHWC, POST_LAYOUT_NC1HWC2 };
+
+typedef struct __post_process_pool_t post_process_pool_t;
+
+/*
+ * per runner post process scratch, reserved once from the model grid and only
+ * cleared between frames. realloc_count counts the frames that still had to
+ * grow a buffer, it stays 0 in steady state.
+ */
+typedef struct __post_process_workspace_t {
+  std::vector<float> filterBoxes;
+  std::vector<float> objProbs;
+  std::vector<int> classId;
+  std::vector<int> indexArray;
+  std::vector<float> sortedProbs;
+  std::vector<char> classSeen;
+  std::vector<int> bucket;
+  std::vector<int> fill;
+  std::vector<int> rank;
+  std::vector<float> xmin;
+  std::vector<float> ymin;
+  std::vector<float> xmax;
+  std::vector<float> ymax;
+  std::vector<char> removed;
+  std::vector<int> cellStart;
+  std::vector<int> cellFill;
+  std::vector<int> cellItems;
+  std::vector<int> visited;
+  int model_in_h;
+  int model_in_w;
+  int threads;
+  int layout;
+  int c2; /* channel block of POST_LAYOUT_NC1HWC2 */
+  const label_table_t *labels;
+  post_process_pool_t *pool;
+  size_t capacity;
+  unsigned long realloc_count;
+} post_process_workspace_t;
+
+typedef enum {
+  NMS_METHOD_LEGACY = 0,           /* full quicksort, one pass per class */
+  NMS_METHOD_TOPK_BATCHED,         /* top K partial sort, class bucketed */
+  NMS_METHOD_SPATIAL_GRID,         /* top K, neighbours from a box grid */
+  NMS_METHOD_SPATIAL_GRID_AGNOSTIC /* as above, ignoring class ids */
+} nms_method_e;
+
+/* class scores of anchor free heads, exported with or without the sigmoid */
+typedef enum {
+  POST_ACTIVATION_AUTO = 0, /* guessed per tensor from the quant params */
+  POST_ACTIVATION_SIGMOID,  /* raw logits, the decode applies the sigmoid */
+  POST_ACTIVATION_NONE      /* sigmoid already in the graph */
+} post_activation_e;
+
+/* per output tensor quantization and its thresholds in the int8 domain */
+typedef struct __qnt_param_t {
+  int32_t zp;
+  float scale;
+  int8_t box_thres_i8;
+  int32_t score_thres_i32;
+  /* anchor free heads: class probability and DFL exp(-d * scale) by int8 */
+  int32_t prob_thres_q;
+  /* anchor free score sum, a plain sum of class scores, no activation */
+  int8_t sum_thres_i8;
+  /* prob_lut is the tensor as is, no sigmoid applied */
+  int8_t prob_activated;
+  float prob_lut[256];
+  float exp_lut[256];
+} qnt_param_t;
+
+typedef enum {
+  YOLO_HEAD_UNKNOWN = 0,
+  YOLO_HEAD_ANCHOR_BASED, /* yolov5, 3 outputs of 3 * (classes + 5) */
+  YOLO_HEAD_ANCHOR_FREE   /* yolov8/yolo11, DFL box + class (+ score sum) */
+} yolo_head_e;
+
+/* one int8 NHWC output tensor */
+typedef struct __post_tensor_t {
+  int8_t *data;
+  int grid_h;
+  int grid_w;
+  int channels;
+} post_tensor_t;
+
+int label_table_load(label_table_t *table, const char *path);
+void label_table_release(label_table_t *table);
+/* name of class_id, never NULL */
+const char *label_table_name(const label_table_t *table, int class_id);
+/*
+ * shared table with the names in path, equal files share one table. tables
+ * live until label_table_cleanup, results of a swapped out model may still be
+ * queued for display after the model is gone.
+ */
+const label_table_t *label_table_get(const char *path);
+void label_table_cleanup(void);
+
+void qnt_param_init(qnt_param_t *qnt, int32_t zp, float scale,
+                    float conf_threshold);
+
+post_process_workspace_t *post_process_workspace_create(int model_in_h,
+                                                        int model_in_w);
+void post_process_workspace_destroy(post_process_workspace_t *ws);
+/* decode the branches as row bands on threads workers, 1 decodes inline */
+int post_process_workspace_set_threads(post_process_workspace_t *ws,
+                                       int threads);
+
+void post_process_set_nms_method(nms_method_e method);
+/* decode every class count with the generic kernel, for benchmarking */
+void post_process_set_decode_generic(int generic);
+/* class activation for qnt_param_init calls from now on, auto by default */
+void post_process_set_class_activation(post_activation_e activation);
+
+/* tell the head layout from the output count and shapes */
+yolo_head_e post_process_detect_head(const post_tensor_t *outputs,
+                                     int n_output);
+
 int post_process(int8_t *input0, int8_t *input1, int8_t *input2, int model_in_h,
-                 int model_in_w, float conf_threshold, float nms_threshold,
-                 float scale_w, float scale_h, std::vector<int32_t> &qnt_zps,
-                 std::vector<float> &qnt_scales, detect_result_group_t *group);
+                 int model_in_w, float nms_threshold, float scale_w,
+                 float scale_h, const qnt_param_t *qnts,
+                 post_process_workspace_t *ws, detect_result_group_t *group);
+
+int post_process_anchor_free(const post_tensor_t *outputs, int n_output,
+                             int model_in_h, int model_in_w,
+                             float nms_threshold, float scale_w, float scale_h,
+                             const qnt_param_t *qnts,
+                             post_process_workspace_t *ws,
+                             detect_result_group_t *group);
 
 #endif //_RKNN_ZERO_COPY_DEMO_POSTPROCESS_H_
@@ -0,0 +1,249 @@
+#include "ptr_ring.h"
+#include <linux/futex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static long long ring_now_ns(void) {
+  struct timespec ts;
+  // waits must not stretch or end early when the wall clock is set
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int ring_can_dequeue(ptr_ring_t *ring) {
+  unsigned long pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  ptr_ring_cell_t *cell = &ring->cells[pos & ring->mask];
+  return __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+static int ring_can_enqueue(ptr_ring_t *ring) {
+  unsigned long pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  ptr_ring_cell_t *cell = &ring->cells[pos & ring->mask];
+  return __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) == pos;
+}
+
+/*
+ * sleeps on word until the other side wakes us or the deadline passes,
+ * 0 once the deadline passed. the other side only looks at parked after
+ * it made progress, so parked goes up before the last look at the ring.
+ */
+static int ring_park(ptr_ring_t *ring, int *word, int *parked,
+                     int (*ready)(ptr_ring_t *), long long deadline) {
+  long long left = deadline - ring_now_ns();
+  if (left <= 0) {
+    return 0;
+  }
+
+  int seen = __atomic_load_n(word, __ATOMIC_ACQUIRE);
+  __atomic_fetch_add(parked, 1, __ATOMIC_SEQ_CST);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (!ready(ring)) {
+    // relative timeout, measured on CLOCK_MONOTONIC by the kernel
+    struct timespec ts;
+    ts.tv_sec = left / 1000000000;
+    ts.tv_nsec = left % 1000000000;
+    syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, seen, &ts, NULL, 0);
+  }
+  __atomic_fetch_sub(parked, 1, __ATOMIC_SEQ_CST);
+
+  return 1;
+}
+
+static void ring_wake(int *word, int *parked) {
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(parked, __ATOMIC_RELAXED) == 0) {
+    return;
+  }
+  __atomic_fetch_add(word, 1, __ATOMIC_RELEASE);
+  syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static int ring_try_enqueue(ptr_ring_t *ring, void *data) {
+  unsigned long pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+  ptr_ring_cell_t *cell;
+
+  for (;;) {
+    cell = &ring->cells[pos & ring->mask];
+    unsigned long seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    long diff = (long)(seq - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return -1; // full
+    } else {
+      pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  cell->data = data;
+  __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+static void *ring_try_dequeue(ptr_ring_t *ring) {
+  unsigned long pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  ptr_ring_cell_t *cell;
+
+  for (;;) {
+    cell = &ring->cells[pos & ring->mask];
+    unsigned long seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+    long diff = (long)(seq - (pos + 1));
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return NULL; // empty
+    } else {
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+
+  void *data = cell->data;
+  // hand the cell to the producer one lap ahead
+  __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+  return data;
+}
+
+int ptr_ring_init(ptr_ring_t *ring, int max_size) {
+  // one cell would read the same sequence for free and full
+  unsigned long size = 2;
+
+  while (size < (unsigned long)max_size) {
+    size <<= 1;
+  }
+
+  ring->cells = (ptr_ring_cell_t *)malloc(size * sizeof(ptr_ring_cell_t));
+  if (!ring->cells) {
+    printf("ptr ring: alloc %lu cells failed\n", size);
+    return -1;
+  }
+  for (unsigned long i = 0; i < size; i++) {
+    ring->cells[i].seq = i;
+    ring->cells[i].data = NULL;
+  }
+  ring->mask = size - 1;
+  ring->drop = NULL;
+  ring->pending_max = size;
+  ring->dropped = 0;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->not_empty = 0;
+  ring->consumers_parked = 0;
+  ring->not_full = 0;
+  ring->producers_parked = 0;
+
+  return 0;
+}
+
+int ptr_ring_init_mailbox(ptr_ring_t *ring, int max_size,
+                          ptr_ring_drop_func drop) {
+  if (ptr_ring_init(ring, max_size) != 0) {
+    return -1;
+  }
+  ring->drop = drop;
+  ring->pending_max = max_size > 0 ? max_size : 1;
+
+  return 0;
+}
+
+static unsigned long ring_pending(ptr_ring_t *ring) {
+  unsigned long head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) - head;
+}
+
+static void ring_drop_oldest(ptr_ring_t *ring) {
+  // a consumer may take the oldest first, then there is room anyway
+  void *stale = ring_try_dequeue(ring);
+  if (stale) {
+    __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+    ring->drop(stale);
+  }
+}
+
+/* pushes out the oldest entries until data fits, never parks */
+static void ring_enqueue_latest(ptr_ring_t *ring, void *data) {
+  // trimmed before data goes in, so data itself is never the one dropped.
+  // a mailbox of frames would pin a camera buffer per spare cell otherwise
+  while (ring_pending(ring) >= ring->pending_max) {
+    ring_drop_oldest(ring);
+  }
+  while (ring_try_enqueue(ring, data) != 0) {
+    ring_drop_oldest(ring);
+  }
+}
+
+int ptr_ring_enqueue(ptr_ring_t *ring, void *data, int timeout_ms) {
+  long long deadline = 0;
+
+  if (ring->drop) {
+    ring_enqueue_latest(ring, data);
+    ring_wake(&ring->not_empty, &ring->consumers_parked);
+    return 0;
+  }
+
+  while (ring_try_enqueue(ring, data) != 0) {
+    if (deadline == 0) {
+      deadline = ring_now_ns() + (long long)timeout_ms * 1000000;
+    }
+    if (!ring_park(ring, &ring->not_full, &ring->producers_parked,
+                   ring_can_enqueue, deadline)) {
+      return 1; // Timeout reached
+    }
+  }
+  ring_wake(&ring->not_empty, &ring->consumers_parked);
+
+  return 0;
+}
+
+void *ptr_ring_dequeue(ptr_ring_t *ring, int timeout_ms) {
+  long long deadline = 0;
+  void *data;
+
+  while ((data = ring_try_dequeue(ring)) == NULL) {
+    if (deadline == 0) {
+      deadline = ring_now_ns() + (long long)timeout_ms * 1000000;
+    }
+    if (!ring_park(ring, &ring->not_empty, &ring->consumers_parked,
+                   ring_can_dequeue, deadline)) {
+      return NULL; // Timeout reached
+    }
+  }
+
+  if (ring->drop) {
+    // a mailbox hands out the newest entry only
+    void *newer;
+    while ((newer = ring_try_dequeue(ring)) != NULL) {
+      __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+      ring->drop(data);
+      data = newer;
+    }
+    return data;
+  }
+  ring_wake(&ring->not_full, &ring->producers_parked);
+
+  return data;
+}
+
+int ptr_ring_capacity(const ptr_ring_t *ring) { return ring->mask + 1; }
+
+void ptr_ring_cleanup(ptr_ring_t *ring) {
+  if (ring->drop) {
+    // entries still pending hold whatever drop releases
+    void *stale;
+    while ((stale = ring_try_dequeue(ring)) != NULL) {
+      ring->dropped++;
+      ring->drop(stale);
+    }
+    printf("ptr ring: mailbox dropped %lu stale entries\n", ring->dropped);
+  }
+  free(ring->cells);
+  ring->cells = NULL;
+}
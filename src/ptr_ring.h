@@ -0,0 +1,71 @@
+#ifndef __ptr_ring_H__
+#define __ptr_ring_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PTR_RING_CACHE_LINE 64
+
+typedef struct {
+  unsigned long seq;
+  void *data;
+} ptr_ring_cell_t;
+
+/* releases an entry pushed out of a mailbox */
+typedef void (*ptr_ring_drop_func)(void *data);
+
+/*
+ * bounded queue of pointers, a drop-in for ptr_queue_t on the hot paths.
+ * any number of producers and consumers, no lock on enqueue/dequeue: each
+ * cell carries a sequence number telling whose turn it is. a side only
+ * enters the kernel when it has to wait, and the other side only wakes it
+ * when it announced it is parked. the capacity is max_size rounded up to a
+ * power of two, at least 2.
+ *
+ * in mailbox mode enqueue never waits: it drops the oldest entries until
+ * fewer than max_size are pending, and dequeue drops all but the newest.
+ */
+typedef struct {
+  ptr_ring_cell_t *cells;
+  unsigned long mask;
+  ptr_ring_drop_func drop; /* set in mailbox mode */
+  unsigned long pending_max; /* mailbox entries kept, may be below capacity */
+  // producer and consumer positions on lines of their own
+  unsigned long tail __attribute__((aligned(PTR_RING_CACHE_LINE)));
+  unsigned long head __attribute__((aligned(PTR_RING_CACHE_LINE)));
+  // futex words, bumped on a wakeup, and the number of threads parked
+  int not_empty __attribute__((aligned(PTR_RING_CACHE_LINE)));
+  int consumers_parked;
+  int not_full __attribute__((aligned(PTR_RING_CACHE_LINE)));
+  int producers_parked;
+  // mailbox drops, counted by both sides so kept off their lines
+  unsigned long dropped __attribute__((aligned(PTR_RING_CACHE_LINE)));
+} ptr_ring_t;
+
+int ptr_ring_init(ptr_ring_t *ring, int max_size);
+
+/* latest-wins ring, drop releases the entries it pushes out */
+int ptr_ring_init_mailbox(ptr_ring_t *ring, int max_size,
+                          ptr_ring_drop_func drop);
+
+/*
+ * 0 on success, 1 if the ring stayed full for timeout_ms. data not NULL.
+ * a mailbox always succeeds at once.
+ */
+int ptr_ring_enqueue(ptr_ring_t *ring, void *data, int timeout_ms);
+
+/* NULL if the ring stayed empty for timeout_ms */
+void *ptr_ring_dequeue(ptr_ring_t *ring, int timeout_ms);
+
+/* entries the ring can hold, max_size rounded up to a power of two */
+int ptr_ring_capacity(const ptr_ring_t *ring);
+
+/* a mailbox drops its pending entries, a plain ring forgets them */
+void ptr_ring_cleanup(ptr_ring_t *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*__ptr_ring_H__*/
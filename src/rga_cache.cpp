@@ -0,0 +1,71 @@
+#include "rga_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "rga/im2d.hpp"
+
+void rga_cache_init(rga_cache_t *cache) {
+  memset(cache, 0, sizeof(rga_cache_t));
+  pthread_mutex_init(&cache->mutex, NULL);
+}
+
+uint32_t rga_cache_import(rga_cache_t *cache, const void *owner, int fd,
+                          int size, int format) {
+  uint32_t handle = 0;
+
+  pthread_mutex_lock(&cache->mutex);
+  for (int i = 0; i < cache->num; i++) {
+    rga_cache_entry_t *entry = &cache->entries[i];
+    if (entry->fd == fd && entry->size == size && entry->format == format &&
+        entry->owner == owner) {
+      cache->hits++;
+      handle = entry->handle;
+      pthread_mutex_unlock(&cache->mutex);
+      return handle;
+    }
+  }
+
+  cache->misses++;
+  if (cache->num >= RGA_CACHE_MAX) {
+    pthread_mutex_unlock(&cache->mutex);
+    printf("rga cache: full, fd %d not imported\n", fd);
+    return 0;
+  }
+
+  // rare, only the first frame of each buffer gets here
+  handle = importbuffer_fd(fd, size);
+  if (handle) {
+    rga_cache_entry_t *entry = &cache->entries[cache->num++];
+    entry->owner = owner;
+    entry->fd = fd;
+    entry->size = size;
+    entry->format = format;
+    entry->handle = handle;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+
+  return handle;
+}
+
+void rga_cache_release(rga_cache_t *cache, const void *owner) {
+  int kept = 0;
+
+  pthread_mutex_lock(&cache->mutex);
+  for (int i = 0; i < cache->num; i++) {
+    rga_cache_entry_t *entry = &cache->entries[i];
+    if (!owner || entry->owner == owner) {
+      releasebuffer_handle(entry->handle);
+    } else {
+      cache->entries[kept++] = *entry;
+    }
+  }
+  cache->num = kept;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+void rga_cache_cleanup(rga_cache_t *cache) {
+  rga_cache_release(cache, NULL);
+  printf("rga cache: %lu hits, %lu misses\n", cache->hits, cache->misses);
+  pthread_mutex_destroy(&cache->mutex);
+}
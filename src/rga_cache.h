@@ -0,0 +1,43 @@
+#ifndef __RGA_CACHE_H__
+#define __RGA_CACHE_H__
+
+#include <pthread.h>
+#include <stdint.h>
+
+// v4l2 buffers twice (npu and display size), drm buffers and some spare
+#define RGA_CACHE_MAX 32
+
+typedef struct {
+  const void *owner;
+  int fd;
+  int size;
+  int format;
+  uint32_t handle; /* rga_buffer_handle_t */
+} rga_cache_entry_t;
+
+/*
+ * rga handles of long lived dma-bufs, imported on first use and released
+ * only when their owner (the camera, the display) goes away, instead of an
+ * import and a release ioctl per buffer and frame. the key includes size
+ * and format, an fd closed and reused for another buffer must not hit.
+ */
+typedef struct {
+  rga_cache_entry_t entries[RGA_CACHE_MAX];
+  int num;
+  unsigned long hits;
+  unsigned long misses;
+  pthread_mutex_t mutex;
+} rga_cache_t;
+
+void rga_cache_init(rga_cache_t *cache);
+
+/* cached handle of fd, owned by the cache, 0 on failure */
+uint32_t rga_cache_import(rga_cache_t *cache, const void *owner, int fd,
+                          int size, int format);
+
+/* releases the handles of owner, all of them if owner is NULL */
+void rga_cache_release(rga_cache_t *cache, const void *owner);
+
+void rga_cache_cleanup(rga_cache_t *cache);
+
+#endif /*__RGA_CACHE_H__*/
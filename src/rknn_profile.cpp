@@ -0,0 +1,273 @@
+#include "rknn_profile.h"
+
+#include <algorithm>
+#include <map>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+
+// samples kept per series for the percentiles
+#define PROFILE_SAMPLES_MAX 100000
+
+/*
+ * a uniform sample of every value seen (reservoir sampling), so the
+ * percentiles of a long run cover all of it and not its first minutes
+ */
+typedef struct {
+  std::vector<int> samples;
+  unsigned long seen;
+} profile_series_t;
+
+typedef struct {
+  FILE *fp;
+  char path[256];
+  long max_bytes;
+  int detail_period;
+  unsigned long frames;
+  unsigned int seed;
+  profile_series_t run_us;
+  profile_series_t wall_us;
+  std::map<std::string, profile_series_t> layer_us;
+  pthread_mutex_t mutex;
+} rknn_profile_t;
+
+static rknn_profile_t *profile = NULL;
+
+static long long profile_time_us() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int profile_file_open(rknn_profile_t *prof) {
+  prof->fp = fopen(prof->path, "w");
+  if (!prof->fp) {
+    printf("open profile file %s failed\n", prof->path);
+    return -1;
+  }
+  fprintf(prof->fp, "kind,frame,time,name,us\n");
+  return 0;
+}
+
+/*
+ * keep the current and one previous file. if the new file cannot be opened
+ * the csv stops there and only the percentiles are kept.
+ */
+static void profile_file_rotate(rknn_profile_t *prof) {
+  if (!prof->fp || ftell(prof->fp) < prof->max_bytes) {
+    return;
+  }
+
+  char old_path[sizeof(prof->path) + 2];
+  snprintf(old_path, sizeof(old_path), "%s.1", prof->path);
+  fclose(prof->fp);
+  rename(prof->path, old_path);
+  if (profile_file_open(prof) != 0) {
+    printf("npu profile file output stopped, percentiles only\n");
+  }
+}
+
+static void profile_sample(rknn_profile_t *prof, profile_series_t &series,
+                           int us) {
+  series.seen++;
+  if (series.samples.size() < PROFILE_SAMPLES_MAX) {
+    series.samples.push_back(us);
+    return;
+  }
+  // the n-th value replaces a kept one with probability MAX / n
+  unsigned long slot =
+      (((unsigned long)rand_r(&prof->seed) << 31) ^ rand_r(&prof->seed)) %
+      series.seen;
+  if (slot < PROFILE_SAMPLES_MAX) {
+    series.samples[slot] = us;
+  }
+}
+
+/*
+ * the detail report is a text table, one row per layer starting with the
+ * layer id. the time column is located from the "Time(us)" header.
+ */
+static void profile_parse_detail(rknn_profile_t *prof, const char *text,
+                                 long long now) {
+  int time_col = -1;
+  const char *line = text;
+
+  while (line && *line) {
+    const char *end = strchr(line, '\n');
+    std::string row(line, end ? end - line : strlen(line));
+    line = end ? end + 1 : NULL;
+
+    std::vector<std::string> cols;
+    size_t pos = 0;
+    while ((pos = row.find_first_not_of(" \t", pos)) != std::string::npos) {
+      size_t stop = row.find_first_of(" \t", pos);
+      cols.push_back(row.substr(pos, stop - pos));
+      pos = stop;
+    }
+    if (cols.empty()) {
+      continue;
+    }
+
+    if (time_col < 0) {
+      for (size_t i = 0; i < cols.size(); i++) {
+        if (cols[i] == "Time(us)") {
+          time_col = i;
+        }
+      }
+      continue;
+    }
+
+    if ((int)cols.size() <= time_col ||
+        cols[0].find_first_not_of("0123456789") != std::string::npos) {
+      continue;
+    }
+
+    // zero padded id keeps the summary in layer order
+    char name_buf[64];
+    snprintf(name_buf, sizeof(name_buf), "%04d:%s", atoi(cols[0].c_str()),
+             cols.size() > 1 ? cols[1].c_str() : "");
+    std::string name = name_buf;
+    int us = atoi(cols[time_col].c_str());
+    profile_sample(prof, prof->layer_us[name], us);
+    if (prof->fp) {
+      fprintf(prof->fp, "layer,%lu,%lld,%s,%d\n", prof->frames, now,
+              name.c_str(), us);
+    }
+  }
+}
+
+int rknn_profile_open(const char *path, int detail_period, long max_bytes) {
+  if (profile) {
+    return 0;
+  }
+
+  rknn_profile_t *prof = new rknn_profile_t();
+  snprintf(prof->path, sizeof(prof->path), "%s", path);
+  prof->detail_period = detail_period;
+  prof->max_bytes = max_bytes;
+  prof->seed = 1;
+  if (profile_file_open(prof) != 0) {
+    delete prof;
+    return -1;
+  }
+  pthread_mutex_init(&prof->mutex, NULL);
+  profile = prof;
+  printf("npu profiling to %s, layer detail every %d frames\n", path,
+         detail_period);
+
+  return 0;
+}
+
+int rknn_profile_enabled(void) { return profile != NULL; }
+
+void rknn_profile_frame(const infer_backend_t *backend, rknn_context ctx,
+                        long long wall_us) {
+  rknn_profile_t *prof = profile;
+  rknn_perf_run perf_run;
+  rknn_perf_detail perf_detail;
+
+  if (!prof) {
+    return;
+  }
+
+  memset(&perf_run, 0, sizeof(perf_run));
+  if (backend->query(ctx, RKNN_QUERY_PERF_RUN, &perf_run, sizeof(perf_run)) !=
+      RKNN_SUCC) {
+    perf_run.run_duration = -1;
+  }
+
+  pthread_mutex_lock(&prof->mutex);
+  long long now = profile_time_us();
+  prof->frames++;
+  profile_sample(prof, prof->wall_us, wall_us);
+  if (prof->fp) {
+    fprintf(prof->fp, "wall,%lu,%lld,total,%lld\n", prof->frames, now,
+            wall_us);
+  }
+  if (perf_run.run_duration >= 0) {
+    profile_sample(prof, prof->run_us, perf_run.run_duration);
+    if (prof->fp) {
+      fprintf(prof->fp, "run,%lu,%lld,total,%lld\n", prof->frames, now,
+              (long long)perf_run.run_duration);
+    }
+  }
+
+  // the detail report is costly, only every detail_period frames
+  if (prof->detail_period > 0 && prof->frames % prof->detail_period == 1) {
+    memset(&perf_detail, 0, sizeof(perf_detail));
+    if (backend->query(ctx, RKNN_QUERY_PERF_DETAIL, &perf_detail,
+                       sizeof(perf_detail)) == RKNN_SUCC &&
+        perf_detail.perf_data) {
+      profile_parse_detail(prof, perf_detail.perf_data, now);
+    }
+  }
+
+  profile_file_rotate(prof);
+  pthread_mutex_unlock(&prof->mutex);
+}
+
+static int percentile(std::vector<int> &samples, int pct) {
+  size_t k = (samples.size() - 1) * pct / 100;
+  std::nth_element(samples.begin(), samples.begin() + k, samples.end());
+  return samples[k];
+}
+
+static void profile_print(const char *name, profile_series_t &series) {
+  if (series.samples.empty()) {
+    return;
+  }
+  printf("%-32s %8lu %8d %8d %8d\n", name, series.seen,
+         percentile(series.samples, 50), percentile(series.samples, 95),
+         percentile(series.samples, 99));
+}
+
+int rknn_profile_percentile(const char *name, int pct) {
+  rknn_profile_t *prof = profile;
+  profile_series_t *series = NULL;
+  int us = -1;
+
+  if (!prof) {
+    return -1;
+  }
+  pthread_mutex_lock(&prof->mutex);
+  if (strcmp(name, "total (wall)") == 0) {
+    series = &prof->wall_us;
+  } else if (strcmp(name, "total (npu)") == 0) {
+    series = &prof->run_us;
+  } else if (prof->layer_us.count(name)) {
+    series = &prof->layer_us[name];
+  }
+  if (series && !series->samples.empty()) {
+    us = percentile(series->samples, pct);
+  }
+  pthread_mutex_unlock(&prof->mutex);
+
+  return us;
+}
+
+void rknn_profile_close(void) {
+  rknn_profile_t *prof = profile;
+  if (!prof) {
+    return;
+  }
+  profile = NULL;
+
+  printf("npu profile, %lu frames, us:\n", prof->frames);
+  printf("%-32s %8s %8s %8s %8s\n", "name", "count", "p50", "p95", "p99");
+  profile_print("total (wall)", prof->wall_us);
+  profile_print("total (npu)", prof->run_us);
+  std::map<std::string, profile_series_t>::iterator it;
+  for (it = prof->layer_us.begin(); it != prof->layer_us.end(); ++it) {
+    profile_print(it->first.c_str(), it->second);
+  }
+
+  if (prof->fp) {
+    fclose(prof->fp);
+  }
+  pthread_mutex_destroy(&prof->mutex);
+  delete prof;
+}
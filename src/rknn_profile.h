@@ -0,0 +1,24 @@
+#ifndef __RKNN_PROFILE_H__
+#define __RKNN_PROFILE_H__
+
+#include "infer_backend.h"
+
+/*
+ * npu profiling. contexts created while it is open get
+ * RKNN_FLAG_COLLECT_PERF_MASK, every run logs RKNN_QUERY_PERF_RUN and every
+ * detail_period runs the per layer RKNN_QUERY_PERF_DETAIL to a csv file,
+ * rotated to path.1 past max_bytes. close prints p50/p95/p99, taken from a
+ * uniform sample of the whole run.
+ */
+int rknn_profile_open(const char *path, int detail_period, long max_bytes);
+int rknn_profile_enabled(void);
+void rknn_profile_frame(const infer_backend_t *backend, rknn_context ctx,
+                        long long wall_us);
+/*
+ * pct percentile in us of a series as close prints it: "total (wall)",
+ * "total (npu)" or a layer. -1 when profiling is off or nothing was seen.
+ */
+int rknn_profile_percentile(const char *name, int pct);
+void rknn_profile_close(void);
+
+#endif /*__RKNN_PROFILE_H__*/
@@ -1,14 +1,24 @@
 #include "rknn_runner.h"
+#include "infer_backend.h"
+#include "rknn_profile.h"
 #include "postprocess.h"
 #include "rknn_api.h"
 
+#include <fcntl.h>
 #include <float.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <unistd.h>
 #include <vector>
 
+static int runner_mem_outside = 0;
+static int runner_async = 0;
+
 // 获取当前时间（微秒级）
 static long long get_timestamp() {
   struct timeval tv;
@@ -43,30 +53,64 @@ static void rknn_runner_dump_tensor_attr(rknn_tensor_attr *attrs, int num) {
   }
 }
 
+static void rknn_runner_fill_post_tensor(rknn_tensor_attr *attr,
+                                         post_tensor_t *tensor) {
+  if (attr->fmt == RKNN_TENSOR_NC1HWC2) {
+    // channels include the c2 padding of the last block
+    tensor->grid_h = attr->dims[2];
+    tensor->grid_w = attr->dims[3];
+    tensor->channels = attr->dims[1] * attr->dims[4];
+  } else if (attr->fmt == RKNN_TENSOR_NCHW) {
+    tensor->channels = attr->dims[1];
+    tensor->grid_h = attr->dims[2];
+    tensor->grid_w = attr->dims[3];
+  } else {
+    tensor->grid_h = attr->dims[1];
+    tensor->grid_w = attr->dims[2];
+    tensor->channels = attr->dims[3];
+  }
+}
+
 static void rknn_runner_internal_release(rknn_runner_t *runner) {
   if (!runner) {
     return;
   }
 
   if (!runner->rknn_ctx) {
+    pthread_mutex_destroy(&runner->run_lock);
     free(runner);
     return;
   }
 
-  if (runner->input_mems) {
-    for (uint32_t i = 0; i < runner->io_num.n_input; ++i) {
-      rknn_destroy_mem(runner->rknn_ctx, runner->input_mems[i]);
+  for (int n = 0; n < RKNN_RUNNER_IO_MAX; n++) {
+    rknn_runner_io_t *io = &runner->io[n];
+    if (io->input_mems) {
+      for (uint32_t i = 0; i < runner->io_num.n_input; ++i) {
+        if (io->input_mems[i]) {
+          runner->backend->destroy_mem(runner->rknn_ctx, io->input_mems[i]);
+        }
+      }
+
+      free(io->input_mems);
     }
 
-    free(runner->input_mems);
-  }
+    if (io->output_mems) {
+      for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
+        if (io->output_mems[i]) {
+          runner->backend->destroy_mem(runner->rknn_ctx, io->output_mems[i]);
+        }
+      }
 
-  if (runner->output_mems) {
-    for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
-      rknn_destroy_mem(runner->rknn_ctx, runner->output_mems[i]);
+      free(io->output_mems);
     }
+  }
+
+  if (runner->weight_mem) {
+    runner->backend->destroy_mem(runner->rknn_ctx, runner->weight_mem);
+  }
 
-    free(runner->output_mems);
+  if (runner->internal_mem) {
+    runner->backend->destroy_mem(runner->rknn_ctx, runner->internal_mem);
   }
 
   if (runner->input_attrs) {
@@ -77,63 +121,290 @@ static void rknn_runner_internal_release(rknn_runner_t *runner) {
     free(runner->output_attrs);
   }
 
-  rknn_destroy(runner->rknn_ctx);
+  if (runner->output_qnts) {
+    free(runner->output_qnts);
+  }
 
+  if (runner->post_ws) {
+    post_process_workspace_destroy(runner->post_ws);
+  }
+
+  if (runner->record) {
+    fclose(runner->record);
+  }
+
+  runner->backend->destroy(runner->rknn_ctx);
+
+  // outside memory goes after the context that used it
+  for (int n = 0; n < RKNN_RUNNER_IO_MAX; n++) {
+    rknn_runner_io_t *io = &runner->io[n];
+    if (io->input_bufs) {
+      for (uint32_t i = 0; i < runner->io_num.n_input; ++i) {
+        dma_buffer_free(&io->input_bufs[i]);
+      }
+      free(io->input_bufs);
+    }
+
+    if (io->output_bufs) {
+      for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
+        dma_buffer_free(&io->output_bufs[i]);
+      }
+      free(io->output_bufs);
+    }
+  }
+  dma_buffer_free(&runner->weight_buf);
+  dma_buffer_free(&runner->internal_buf);
+
+  pthread_mutex_destroy(&runner->run_lock);
   free(runner);
 }
 
-rknn_runner_t *rknn_runner_create(char *model_path, rknn_cb_func func) {
-  return rknn_runner_create(model_path, RKNN_TENSOR_UINT8, RKNN_TENSOR_NHWC,
-                            func);
+static int rknn_runner_query_output_attrs(rknn_runner_t *runner,
+                                          rknn_tensor_format output_fmt) {
+  int ret = -1;
+  // NC1HWC2 is what the npu writes, NHWC costs a conversion in the driver
+  rknn_query_cmd cmd = output_fmt == RKNN_TENSOR_NC1HWC2
+                           ? RKNN_QUERY_NATIVE_NC1HWC2_OUTPUT_ATTR
+                           : RKNN_QUERY_NATIVE_NHWC_OUTPUT_ATTR;
+
+  memset(runner->output_attrs, 0,
+         runner->io_num.n_output * sizeof(rknn_tensor_attr));
+  for (uint32_t i = 0; i < runner->io_num.n_output; i++) {
+    runner->output_attrs[i].index = i;
+    // query info
+    ret = runner->backend->query(runner->rknn_ctx, cmd,
+                                 &(runner->output_attrs[i]),
+                                 sizeof(rknn_tensor_attr));
+    if (ret != RKNN_SUCC) {
+      printf("rknn_query fail! ret=%d\n", ret);
+      return -1;
+    }
+  }
+
+  return 0;
 }
 
-rknn_runner_t *rknn_runner_create(char *model_path,
-                                  rknn_tensor_type tensor_type,
-                                  rknn_tensor_format tensor_fmt,
-                                  rknn_cb_func func) {
-  int ret = -1;
-  rknn_runner_t *runner = NULL;
-  rknn_tensor_type input_type = tensor_type;
-  rknn_tensor_format input_layout = tensor_fmt;
+/*
+ * map the model instead of letting rknn_init read it into a heap copy, the
+ * pages come straight from the page cache and go away once the context is
+ * set up and has its weights in memory of its own. private and writable so
+ * the runtime may patch its view without touching the file.
+ */
+static void *rknn_runner_map_model(const char *model_path, uint32_t *size) {
+  struct stat st;
 
-  if (model_path == NULL) {
-    printf("input model path is invalid\n");
+  int fd = open(model_path, O_RDONLY);
+  if (fd < 0) {
+    printf("open model %s failed\n", model_path);
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    close(fd);
+    return NULL;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+                    0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    printf("mmap model %s failed\n", model_path);
     return NULL;
   }
+  madvise(data, st.st_size, MADV_WILLNEED);
+  *size = st.st_size;
+
+  return data;
+}
 
-  runner = (rknn_runner_t *)malloc(sizeof(rknn_runner_t));
+static rknn_runner_t *rknn_runner_alloc(rknn_cb_func func) {
+  rknn_runner_t *runner = (rknn_runner_t *)malloc(sizeof(rknn_runner_t));
   if (runner == NULL) {
     printf("allocate rknn runner oom\n");
     return NULL;
   }
+  memset(runner, 0, sizeof(rknn_runner_t));
 
   runner->post = func;
+  runner->backend = infer_backend_current();
+  runner->io_bound = -1;
+  runner->core_mask = RKNN_NPU_CORE_AUTO;
+  runner->mem_outside = runner_mem_outside;
+  runner->async = runner_async && !rknn_profile_enabled();
+  pthread_mutex_init(&runner->run_lock, NULL);
 
-  ret = rknn_init(&runner->rknn_ctx, model_path, 0, 0, NULL);
-  if (ret < 0) {
-    printf("rknn_init fail! ret=%d\n", ret);
-    free(runner);
+  return runner;
+}
+
+/* a runtime allocated mem, or one wrapping a new dma buffer in buf */
+static rknn_tensor_mem *rknn_runner_create_mem(rknn_runner_t *runner,
+                                               dma_buffer_t *buf,
+                                               uint32_t size) {
+  if (!runner->mem_outside) {
+    return runner->backend->create_mem(runner->rknn_ctx, size);
+  }
+
+  if (dma_buffer_alloc(buf, size) != 0) {
+    printf("dma buffer of %u bytes failed\n", size);
     return NULL;
   }
 
+  return runner->backend->create_mem_from_fd(runner->rknn_ctx, buf->fd,
+                                             buf->va, size, 0);
+}
+
+/* weight and internal memory of a RKNN_FLAG_MEM_ALLOC_OUTSIDE context */
+static int rknn_runner_set_outside_mem(rknn_runner_t *runner) {
+  rknn_mem_size mem_size;
+  int ret = -1;
+
+  if (rknn_runner_mem_size(runner, &mem_size) != 0) {
+    return -1;
+  }
+
+  // a shared context runs on the buffer of the owner, wrapped for its own
+  dma_buffer_t *weight = &runner->weight_buf;
+  if (runner->weight_parent) {
+    weight = &runner->weight_parent->weight_buf;
+  } else if (mem_size.total_weight_size &&
+             dma_buffer_alloc(weight, mem_size.total_weight_size) != 0) {
+    printf("dma buffer for %u bytes of weights failed\n",
+           mem_size.total_weight_size);
+    return -1;
+  }
+  if (weight->size) {
+    runner->weight_mem = runner->backend->create_mem_from_fd(
+        runner->rknn_ctx, weight->fd, weight->va, weight->size, 0);
+    if (!runner->weight_mem) {
+      return -1;
+    }
+    ret = runner->backend->set_weight_mem(runner->rknn_ctx, runner->weight_mem);
+    if (ret < 0) {
+      printf("rknn_set_weight_mem fail! ret=%d\n", ret);
+      return -1;
+    }
+  }
+
+  if (mem_size.total_internal_size) {
+    runner->internal_mem = rknn_runner_create_mem(
+        runner, &runner->internal_buf, mem_size.total_internal_size);
+    if (!runner->internal_mem) {
+      return -1;
+    }
+    ret = runner->backend->set_internal_mem(runner->rknn_ctx,
+                                            runner->internal_mem);
+    if (ret < 0) {
+      printf("rknn_set_internal_mem fail! ret=%d\n", ret);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+static int rknn_runner_create_io(rknn_runner_t *runner, rknn_runner_io_t *io) {
+  io->runner = runner;
+  io->index = io - runner->io;
+
+  if (runner->mem_outside) {
+    io->input_bufs = (dma_buffer_t *)calloc(runner->io_num.n_input,
+                                            sizeof(dma_buffer_t));
+    io->output_bufs = (dma_buffer_t *)calloc(runner->io_num.n_output,
+                                             sizeof(dma_buffer_t));
+    if (io->input_bufs == NULL || io->output_bufs == NULL) {
+      printf("allocat io dma buffers falied\n");
+      return -1;
+    }
+  }
+
+  // Create input tensor memory
+  io->input_mems = (rknn_tensor_mem **)calloc(runner->io_num.n_input,
+                                              sizeof(rknn_tensor_mem *));
+  if (io->input_mems == NULL) {
+    printf("allocat input_mems falied\n");
+    return -1;
+  }
+
+  io->input_mems[0] = rknn_runner_create_mem(
+      runner, io->input_bufs ? &io->input_bufs[0] : NULL,
+      runner->input_attrs[0].size_with_stride);
+  if (io->input_mems[0] == NULL) {
+    printf("rknn_create_mem input fail!\n");
+    return -1;
+  }
+
+  // Create output tensor memory
+  io->output_mems = (rknn_tensor_mem **)calloc(runner->io_num.n_output,
+                                               sizeof(rknn_tensor_mem *));
+  if (io->output_mems == NULL) {
+    printf("allocat output_mems falied\n");
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
+    io->output_mems[i] = rknn_runner_create_mem(
+        runner, io->output_bufs ? &io->output_bufs[i] : NULL,
+        runner->output_attrs[i].size_with_stride);
+    if (io->output_mems[i] == NULL) {
+      printf("rknn_create_mem output %d fail!\n", i);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+/* point the context at the mems of io, the next rknn_run uses them */
+static int rknn_runner_bind_io(rknn_runner_t *runner, rknn_runner_io_t *io) {
+  int ret = -1;
+
+  // Set input tensor memory
+  ret = runner->backend->set_io_mem(runner->rknn_ctx, io->input_mems[0],
+                                    &runner->input_attrs[0]);
+  if (ret < 0) {
+    printf("rknn_set_io_mem fail! ret=%d\n", ret);
+    return -1;
+  }
+  // Set output tensor memory
+  for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
+    // set output memory and attribute
+    ret = runner->backend->set_io_mem(runner->rknn_ctx, io->output_mems[i],
+                                      &runner->output_attrs[i]);
+    if (ret < 0) {
+      printf("rknn_set_io_mem fail! ret=%d\n", ret);
+      return -1;
+    }
+  }
+  runner->io_bound = io->index;
+
+  return 0;
+}
+
+/* everything after rknn_init, shared by created and duplicated runners */
+static int rknn_runner_setup(rknn_runner_t *runner) {
+  int ret = -1;
+
   // Get sdk and driver version
   rknn_sdk_version sdk_ver;
-  ret = rknn_query(runner->rknn_ctx, RKNN_QUERY_SDK_VERSION, &sdk_ver,
-                   sizeof(sdk_ver));
+  ret = runner->backend->query(runner->rknn_ctx, RKNN_QUERY_SDK_VERSION,
+                               &sdk_ver, sizeof(sdk_ver));
   if (ret != RKNN_SUCC) {
     printf("rknn_query fail! ret=%d\n", ret);
-    return NULL;
+    return -1;
   }
 
   printf("rknn_api/rknnrt version: %s, driver version: %s\n",
          sdk_ver.api_version, sdk_ver.drv_version);
 
+  if (runner->mem_outside && rknn_runner_set_outside_mem(runner) != 0) {
+    return -1;
+  }
+
   // Get Model Input Output Info
-  ret = rknn_query(runner->rknn_ctx, RKNN_QUERY_IN_OUT_NUM, &runner->io_num,
-                   sizeof(runner->io_num));
+  ret = runner->backend->query(runner->rknn_ctx, RKNN_QUERY_IN_OUT_NUM,
+                               &runner->io_num, sizeof(runner->io_num));
   if (ret != RKNN_SUCC) {
     printf("rknn_query fail! ret=%d\n", ret);
-    return NULL;
+    return -1;
   }
   printf("model input num: %d, output num: %d\n", runner->io_num.n_input,
          runner->io_num.n_output);
@@ -143,107 +414,448 @@ rknn_runner_t *rknn_runner_create(char *model_path,
                                                    sizeof(rknn_tensor_attr));
   if (runner->input_attrs == NULL) {
     printf("allocat input_attrs falied\n");
-    goto release;
+    return -1;
   }
   memset(runner->input_attrs, 0,
          runner->io_num.n_input * sizeof(rknn_tensor_attr));
   for (uint32_t i = 0; i < runner->io_num.n_input; i++) {
     runner->input_attrs[i].index = i;
     // query info
-    ret = rknn_query(runner->rknn_ctx, RKNN_QUERY_INPUT_ATTR,
-                     &(runner->input_attrs[i]), sizeof(rknn_tensor_attr));
+    ret = runner->backend->query(runner->rknn_ctx, RKNN_QUERY_INPUT_ATTR,
+                                 &(runner->input_attrs[i]),
+                                 sizeof(rknn_tensor_attr));
     if (ret < 0) {
       printf("rknn_init error! ret=%d\n", ret);
-      return NULL;
+      return -1;
     }
   }
   rknn_runner_dump_tensor_attr(runner->input_attrs, runner->io_num.n_input);
 
+  // post process scratch is sized from the model grid, dims as queried
+  if (runner->input_attrs[0].fmt == RKNN_TENSOR_NCHW) {
+    runner->post_ws = post_process_workspace_create(
+        runner->input_attrs[0].dims[2], runner->input_attrs[0].dims[3]);
+  } else {
+    runner->post_ws = post_process_workspace_create(
+        runner->input_attrs[0].dims[1], runner->input_attrs[0].dims[2]);
+  }
+
   printf("output tensors:\n");
   runner->output_attrs = (rknn_tensor_attr *)malloc(runner->io_num.n_output *
                                                     sizeof(rknn_tensor_attr));
   if (runner->output_attrs == NULL) {
     printf("allocat output_attrs falied\n");
-    goto release;
+    return -1;
   }
 
-  memset(runner->output_attrs, 0,
-         runner->io_num.n_output * sizeof(rknn_tensor_attr));
-  for (uint32_t i = 0; i < runner->io_num.n_output; i++) {
-    runner->output_attrs[i].index = i;
-    // query info
-    ret = rknn_query(runner->rknn_ctx, RKNN_QUERY_NATIVE_NHWC_OUTPUT_ATTR,
-                     &(runner->output_attrs[i]), sizeof(rknn_tensor_attr));
-    if (ret != RKNN_SUCC) {
-      printf("rknn_query fail! ret=%d\n", ret);
-      return NULL;
+  if (rknn_runner_query_output_attrs(runner, runner->output_fmt) != 0) {
+    return -1;
+  }
+
+  // only the anchor based decoder reads NC1HWC2
+  if (runner->output_fmt == RKNN_TENSOR_NC1HWC2 &&
+      runner->io_num.n_output != 3) {
+    printf("native NC1HWC2 output needs an anchor based head, use NHWC\n");
+    if (rknn_runner_query_output_attrs(runner, RKNN_TENSOR_NHWC) != 0) {
+      return -1;
     }
   }
   rknn_runner_dump_tensor_attr(runner->output_attrs, runner->io_num.n_output);
 
+  // build the int8 threshold table once, post process scores against it
+  runner->output_qnts =
+      (qnt_param_t *)malloc(runner->io_num.n_output * sizeof(qnt_param_t));
+  if (runner->output_qnts == NULL) {
+    printf("allocat output_qnts falied\n");
+    return -1;
+  }
+
+  for (uint32_t i = 0; i < runner->io_num.n_output; i++) {
+    qnt_param_init(&runner->output_qnts[i], runner->output_attrs[i].zp,
+                   runner->output_attrs[i].scale, BOX_THRESH);
+  }
+
+  if (runner->io_num.n_output <= POST_TENSOR_MAX) {
+    post_tensor_t tensors[POST_TENSOR_MAX];
+    for (uint32_t i = 0; i < runner->io_num.n_output; i++) {
+      rknn_runner_fill_post_tensor(&runner->output_attrs[i], &tensors[i]);
+    }
+    runner->head = post_process_detect_head(tensors, runner->io_num.n_output);
+  }
+  if (runner->head == YOLO_HEAD_UNKNOWN) {
+    printf("unknown detect head, decode as anchor based\n");
+    runner->head = YOLO_HEAD_ANCHOR_BASED;
+  }
+  if (runner->output_attrs[0].fmt == RKNN_TENSOR_NC1HWC2) {
+    runner->post_ws->layout = POST_LAYOUT_NC1HWC2;
+    runner->post_ws->c2 = runner->output_attrs[0].dims[4];
+  } else if (runner->output_attrs[0].fmt == RKNN_TENSOR_NCHW) {
+    runner->post_ws->layout = POST_LAYOUT_NCHW;
+  } else {
+    runner->post_ws->layout = POST_LAYOUT_NHWC;
+  }
+  printf("detect head: %s\n", runner->head == YOLO_HEAD_ANCHOR_FREE
+                                  ? "anchor free"
+                                  : "anchor based");
+  if (runner->head == YOLO_HEAD_ANCHOR_FREE) {
+    // the first class tensor, the same export made all of them
+    printf("class scores: %s\n", runner->output_qnts[1].prob_activated
+                                      ? "sigmoid in the model"
+                                      : "raw, sigmoid in the decode");
+  }
+
   // Get custom string
-  ret = rknn_query(runner->rknn_ctx, RKNN_QUERY_CUSTOM_STRING,
-                   &runner->custom_string, sizeof(rknn_custom_string));
+  ret = runner->backend->query(runner->rknn_ctx, RKNN_QUERY_CUSTOM_STRING,
+                               &runner->custom_string,
+                               sizeof(rknn_custom_string));
   if (ret != RKNN_SUCC) {
     printf("rknn_query fail! ret=%d\n", ret);
-    return NULL;
+    return -1;
   }
   printf("custom string: %s\n", runner->custom_string.string);
 
   // default input type is int8 (normalize and quantize need compute in
   // outside) if set uint8, will fuse normalize and quantize to npu
-  runner->input_attrs[0].type = input_type;
+  runner->input_attrs[0].type = runner->input_type;
   // default fmt is NHWC, npu only support NHWC in zero copy mode
-  runner->input_attrs[0].fmt = input_layout;
+  runner->input_attrs[0].fmt = runner->input_layout;
 
-  // Create input tensor memory
-  runner->input_mems = (rknn_tensor_mem **)malloc(runner->io_num.n_input *
-                                                  sizeof(rknn_tensor_mem *));
-  if (runner->input_mems == NULL) {
-    printf("allocat input_mems falied\n");
-    goto release;
+  if (rknn_runner_create_io(runner, &runner->io[0]) != 0) {
+    return -1;
   }
+  runner->io_depth = 1;
 
-  runner->input_mems[0] = rknn_create_mem(
-      runner->rknn_ctx, runner->input_attrs[0].size_with_stride);
+  if (rknn_runner_bind_io(runner, &runner->io[0]) != 0) {
+    return -1;
+  }
 
-  // Create output tensor memory
-  runner->output_mems = (rknn_tensor_mem **)malloc(runner->io_num.n_output *
-                                                   sizeof(rknn_tensor_mem *));
-  if (runner->output_mems == NULL) {
-    printf("allocat output_mems falied\n");
-    goto release;
+  return 0;
+}
+
+rknn_runner_t *rknn_runner_create(char *model_path, rknn_cb_func func) {
+  return rknn_runner_create(model_path, RKNN_TENSOR_UINT8, RKNN_TENSOR_NHWC,
+                            RKNN_TENSOR_NHWC, func);
+}
+
+rknn_runner_t *rknn_runner_create(char *model_path,
+                                  rknn_tensor_type tensor_type,
+                                  rknn_tensor_format tensor_fmt,
+                                  rknn_tensor_format output_fmt,
+                                  rknn_cb_func func) {
+  return rknn_runner_create(model_path, NULL, tensor_type, tensor_fmt,
+                            output_fmt, func);
+}
+
+int rknn_runner_mem_size(rknn_runner_t *runner, rknn_mem_size *mem_size) {
+  memset(mem_size, 0, sizeof(rknn_mem_size));
+  int ret = runner->backend->query(runner->rknn_ctx, RKNN_QUERY_MEM_SIZE,
+                                   mem_size, sizeof(rknn_mem_size));
+  if (ret != RKNN_SUCC) {
+    printf("rknn_query mem size fail! ret=%d\n", ret);
+    return -1;
   }
 
-  for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
-    runner->output_mems[i] = rknn_create_mem(
-        runner->rknn_ctx, runner->output_attrs[i].size_with_stride);
+  return 0;
+}
+
+static void rknn_runner_dump_mem_size(rknn_runner_t *runner) {
+  rknn_mem_size mem_size;
+  if (rknn_runner_mem_size(runner, &mem_size) != 0) {
+    return;
+  }
+
+  printf("rknn memory: weight %u KB, internal %u KB, dma total %llu KB\n",
+         mem_size.total_weight_size / 1024,
+         mem_size.total_internal_size / 1024,
+         (unsigned long long)mem_size.total_dma_allocated_size / 1024);
+}
+
+rknn_runner_t *rknn_runner_create(char *model_path, rknn_runner_t *parent,
+                                  rknn_tensor_type tensor_type,
+                                  rknn_tensor_format tensor_fmt,
+                                  rknn_tensor_format output_fmt,
+                                  rknn_cb_func func) {
+  int ret = -1;
+  rknn_runner_t *runner = NULL;
+  rknn_init_extend extend;
+
+  if (model_path == NULL) {
+    printf("input model path is invalid\n");
+    return NULL;
+  }
+
+  runner = rknn_runner_alloc(func);
+  if (runner == NULL) {
+    return NULL;
+  }
+
+  runner->input_type = tensor_type;
+  runner->input_layout = tensor_fmt;
+  runner->output_fmt = output_fmt;
+
+  // duplicated contexts inherit the flags of their parent
+  uint32_t flag = rknn_profile_enabled() ? RKNN_FLAG_COLLECT_PERF_MASK : 0;
+  memset(&extend, 0, sizeof(extend));
+  if (parent) {
+    // the weights stay in the cma memory of parent, only internal and io
+    // buffers are allocated for this context
+    runner->backend = parent->backend;
+    runner->mem_outside = parent->mem_outside;
+    runner->async = parent->async;
+    runner->weight_parent = parent;
+    flag |= RKNN_FLAG_SHARE_WEIGHT_MEM;
+    extend.ctx = parent->rknn_ctx;
+  }
+  if (runner->mem_outside) {
+    flag |= RKNN_FLAG_MEM_ALLOC_OUTSIDE;
+  }
+  if (runner->async) {
+    flag |= RKNN_FLAG_ASYNC_MASK;
+  }
+
+  uint32_t model_size = 0;
+  void *model = rknn_runner_map_model(model_path, &model_size);
+  if (model) {
+    long long start = get_timestamp();
+    ret = runner->backend->init(&runner->rknn_ctx, model, model_size, flag,
+                                parent ? &extend : NULL);
+    printf("rknn_init %s, %u bytes, %lld us\n", model_path, model_size,
+           get_timestamp() - start);
+  } else {
+    ret = runner->backend->init(&runner->rknn_ctx, model_path, 0, flag,
+                                parent ? &extend : NULL);
   }
-  // Set input tensor memory
-  ret = rknn_set_io_mem(runner->rknn_ctx, runner->input_mems[0],
-                        &runner->input_attrs[0]);
   if (ret < 0) {
-    printf("rknn_set_io_mem fail! ret=%d\n", ret);
+    printf("rknn_init fail! ret=%d\n", ret);
     goto release;
   }
-  // Set output tensor memory
-  for (uint32_t i = 0; i < runner->io_num.n_output; ++i) {
-    // set output memory and attribute
-    ret = rknn_set_io_mem(runner->rknn_ctx, runner->output_mems[i],
-                          &runner->output_attrs[i]);
-    if (ret < 0) {
-      printf("rknn_set_io_mem fail! ret=%d\n", ret);
-      goto release;
-    }
+
+  // with memory allocated outside, init may still refer to the model and
+  // only copies the weights out when set_weight_mem binds their buffer
+  ret = rknn_runner_setup(runner);
+  if (model) {
+    munmap(model, model_size);
+    model = NULL;
+  }
+  if (ret != 0) {
+    goto release;
   }
+  if (parent) {
+    runner->labels = parent->labels;
+    runner->post_ws->labels = parent->labels;
+  }
+  rknn_runner_dump_mem_size(runner);
 
   return runner;
 
 release:
+  if (model) {
+    munmap(model, model_size);
+  }
   rknn_runner_internal_release(runner);
   return NULL;
 }
 
+int rknn_runner_set_io_depth(rknn_runner_t *runner, int depth) {
+  if (depth < 1 || depth > RKNN_RUNNER_IO_MAX) {
+    printf("invalid io depth %d\n", depth);
+    return -1;
+  }
+
+  while (runner->io_depth < depth) {
+    if (rknn_runner_create_io(runner, &runner->io[runner->io_depth]) != 0) {
+      return -1;
+    }
+    runner->io_depth++;
+  }
+
+  return 0;
+}
+
+/*
+ * outside buffers are cached cpu mappings, the runtime does not maintain
+ * them. cpu access goes between a DMA_BUF_SYNC_START and its _END: the
+ * input around a cpu copy into it, which the end flushes, and the outputs
+ * from after a successful run, which the start invalidates, until the post
+ * callback read them. rga fills the input without the cpu.
+ */
+static void rknn_runner_cpu_begin(dma_buffer_t *bufs, uint32_t num) {
+  for (uint32_t i = 0; bufs && i < num; i++) {
+    if (bufs[i].size) {
+      dma_sync_device_to_cpu(bufs[i].fd);
+    }
+  }
+}
+
+static void rknn_runner_cpu_end(dma_buffer_t *bufs, uint32_t num) {
+  for (uint32_t i = 0; bufs && i < num; i++) {
+    if (bufs[i].size) {
+      dma_sync_cpu_to_device(bufs[i].fd);
+    }
+  }
+}
+
+/* post callback of a successful run, then the outputs go back to the npu */
+static void rknn_runner_post_outputs(rknn_runner_io_t *io) {
+  rknn_runner_t *runner = io->runner;
+  if (runner->post) {
+    runner->post(io);
+  }
+  rknn_runner_cpu_end(io->output_bufs, runner->io_num.n_output);
+}
+
+void rknn_runner_set_mem_outside(int enable) { runner_mem_outside = enable; }
+
+void rknn_runner_set_async(int enable) { runner_async = enable; }
+
+/*
+ * the npu is busy while any run of the context is queued. with runs queued
+ * back to back a stretch may never end, so it is counted at every finish.
+ * both under the run lock.
+ */
+static void rknn_runner_busy_begin(rknn_runner_t *runner) {
+  if (runner->runs_queued++ == 0) {
+    runner->busy_mark_us = get_timestamp();
+  }
+}
+
+static void rknn_runner_busy_end(rknn_runner_t *runner) {
+  long long now = get_timestamp();
+  // read without the run lock by rknn_runner_pool_duty_cycle
+  __atomic_fetch_add(&runner->busy_us,
+                     (unsigned long)(now - runner->busy_mark_us),
+                     __ATOMIC_RELAXED);
+  runner->busy_mark_us = now;
+  runner->runs_queued--;
+}
+
+int rknn_runner_run(rknn_runner_io_t *io) {
+  rknn_runner_t *runner = io->runner;
+  int ret = 0;
+
+  // io sets of one context take turns, rebinding is only a pointer update
+  pthread_mutex_lock(&runner->run_lock);
+  if (runner->io_bound != io->index) {
+    ret = rknn_runner_bind_io(runner, io);
+  }
+  if (ret == 0) {
+    rknn_runner_busy_begin(runner);
+    long long start = get_timestamp();
+    if (runner->async) {
+      // the run keeps the mems bound now, the next io set can be bound and
+      // queued behind it while this thread waits
+      memset(&io->run_ext, 0, sizeof(rknn_run_extend));
+      ret = runner->backend->submit(runner->rknn_ctx, &io->run_ext);
+      if (ret >= 0) {
+        pthread_mutex_unlock(&runner->run_lock);
+        ret = runner->backend->wait(runner->rknn_ctx, &io->run_ext);
+        pthread_mutex_lock(&runner->run_lock);
+      }
+    } else {
+      ret = runner->backend->run(runner->rknn_ctx);
+    }
+    long long run_us = get_timestamp() - start;
+    rknn_runner_busy_end(runner);
+    if (ret < 0) {
+      printf("rknn run error %d\n", ret);
+    } else {
+      // ended once the post callback is done with them
+      rknn_runner_cpu_begin(io->output_bufs, runner->io_num.n_output);
+      if (!runner->async) {
+        rknn_profile_frame(runner->backend, runner->rknn_ctx, run_us);
+      }
+      if (runner->record) {
+        infer_backend_mock_record_frame(runner->record,
+                                        runner->io_num.n_output,
+                                        runner->output_attrs, io->output_mems);
+      }
+    }
+  }
+  pthread_mutex_unlock(&runner->run_lock);
+
+  return ret < 0 ? -1 : 0;
+}
+
+int rknn_runner_warmup(rknn_runner_t *runner, int runs) {
+  int ret = 0;
+  long long start = get_timestamp();
+
+  // first runs pay for lazy allocations in the driver, keep them out of the
+  // profile and the recording
+  pthread_mutex_lock(&runner->run_lock);
+  for (int n = 0; n < runner->io_depth && ret == 0; n++) {
+    ret = rknn_runner_bind_io(runner, &runner->io[n]);
+    for (int i = 0; i < runs && ret == 0; i++) {
+      if (runner->backend->run(runner->rknn_ctx) < 0) {
+        printf("rknn warm up run failed\n");
+        ret = -1;
+      }
+    }
+  }
+  pthread_mutex_unlock(&runner->run_lock);
+
+  if (ret == 0) {
+    printf("rknn warm up %d runs on %d io sets, %lld us\n", runs,
+           runner->io_depth, get_timestamp() - start);
+  }
+
+  return ret;
+}
+
+rknn_runner_t *rknn_runner_dup(rknn_runner_t *parent,
+                               rknn_core_mask core_mask) {
+  rknn_runner_t *runner = NULL;
+
+  if (!parent) {
+    return NULL;
+  }
+
+  runner = rknn_runner_alloc(parent->post);
+  if (runner == NULL) {
+    return NULL;
+  }
+  runner->backend = parent->backend;
+
+  runner->input_type = parent->input_type;
+  runner->input_layout = parent->input_layout;
+  runner->output_fmt = parent->output_fmt;
+  runner->mem_outside = parent->mem_outside;
+  runner->async = parent->async;
+  runner->weight_parent = parent;
+
+  // weights are shared with the parent, only io and runtime state are new
+  int ret =
+      runner->backend->dup_context(&parent->rknn_ctx, &runner->rknn_ctx);
+  if (ret < 0) {
+    printf("rknn_dup_context fail! ret=%d\n", ret);
+    rknn_runner_internal_release(runner);
+    return NULL;
+  }
+
+  if (rknn_runner_setup(runner) != 0) {
+    rknn_runner_internal_release(runner);
+    return NULL;
+  }
+  runner->labels = parent->labels;
+  runner->post_ws->labels = parent->labels;
+
+  rknn_runner_set_core_mask(runner, core_mask);
+
+  return runner;
+}
+
+int rknn_runner_set_core_mask(rknn_runner_t *runner, rknn_core_mask core_mask) {
+  int ret = runner->backend->set_core_mask(runner->rknn_ctx, core_mask);
+  if (ret < 0) {
+    // single core npus like rv1106 reject any mask
+    printf("rknn_set_core_mask %d fail! ret=%d\n", core_mask, ret);
+    return -1;
+  }
+  runner->core_mask = core_mask;
+
+  return 0;
+}
+
 int rknn_runner_process(rknn_runner_t *runner, uint8_t *input_data) {
   int ret = -1;
   if (!runner) {
@@ -255,8 +867,9 @@ int rknn_runner_process(rknn_runner_t *runner, uint8_t *input_data) {
   int width = runner->input_attrs[0].dims[2];
   int stride = runner->input_attrs[0].w_stride;
   if (input_data) {
+    rknn_runner_cpu_begin(runner->io[0].input_bufs, runner->io_num.n_input);
     if (width == stride) {
-      memcpy(runner->input_mems[0]->virt_addr, input_data,
+      memcpy(runner->io[0].input_mems[0]->virt_addr, input_data,
              width * runner->input_attrs[0].dims[1] *
                  runner->input_attrs[0].dims[3]);
     } else {
@@ -264,7 +877,7 @@ int rknn_runner_process(rknn_runner_t *runner, uint8_t *input_data) {
       int channel = runner->input_attrs[0].dims[3];
       // copy from src to dst with stride
       uint8_t *src_ptr = input_data;
-      uint8_t *dst_ptr = (uint8_t *)runner->input_mems[0]->virt_addr;
+      uint8_t *dst_ptr = (uint8_t *)runner->io[0].input_mems[0]->virt_addr;
       // width-channel elements
       int src_wc_elems = width * channel;
       int dst_wc_elems = stride * channel;
@@ -274,19 +887,32 @@ int rknn_runner_process(rknn_runner_t *runner, uint8_t *input_data) {
         dst_ptr += dst_wc_elems;
       }
     }
+    rknn_runner_cpu_end(runner->io[0].input_bufs, runner->io_num.n_input);
   }
 
-  ret = rknn_run(runner->rknn_ctx, NULL);
+  ret = rknn_runner_run(&runner->io[0]);
   if (ret < 0) {
-    printf("rknn run error %d\n", ret);
     return -1;
   }
+  rknn_runner_post_outputs(&runner->io[0]);
 
-  if (runner->post) {
-    runner->post(runner);
+  return 0;
+}
+
+int rknn_runner_get_post_tensors(rknn_runner_io_t *io, post_tensor_t *tensors,
+                                 int max_num) {
+  rknn_runner_t *runner = io->runner;
+  int num = runner->io_num.n_output;
+  if (num > max_num) {
+    num = max_num;
   }
 
-  return 0;
+  for (int i = 0; i < num; i++) {
+    rknn_runner_fill_post_tensor(&runner->output_attrs[i], &tensors[i]);
+    tensors[i].data = (int8_t *)io->output_mems[i]->virt_addr;
+  }
+
+  return num;
 }
 
 int rknn_runner_destroy(rknn_runner_t *runner) {
@@ -294,3 +920,199 @@ int rknn_runner_destroy(rknn_runner_t *runner) {
   return 0;
 }
 
+int rknn_runner_record(rknn_runner_t *runner, const char *record_path) {
+  FILE *fp = infer_backend_mock_record_open(
+      record_path, runner->io_num.n_input, runner->input_attrs,
+      runner->io_num.n_output, runner->output_attrs);
+  if (!fp) {
+    return -1;
+  }
+
+  pthread_mutex_lock(&runner->run_lock);
+  runner->record = fp;
+  pthread_mutex_unlock(&runner->run_lock);
+
+  return 0;
+}
+
+int rknn_runner_load_labels(rknn_runner_t *runner, const char *label_path) {
+  if (!runner || !label_path) {
+    return -1;
+  }
+
+  // shared, results may outlive the runner
+  const label_table_t *labels = label_table_get(label_path);
+  if (!labels) {
+    return -1;
+  }
+  runner->labels = labels;
+  runner->post_ws->labels = labels;
+
+  return 0;
+}
+
+
+static int rknn_runner_pool_run(void *ctx) {
+  return rknn_runner_run((rknn_runner_io_t *)ctx);
+}
+
+static void rknn_runner_pool_post(void *ctx) {
+  rknn_runner_post_outputs((rknn_runner_io_t *)ctx);
+}
+
+rknn_runner_pool_t *rknn_runner_pool_create(rknn_runner_t *parent, int num,
+                                            int io_depth) {
+  rknn_runner_pool_t *pool = NULL;
+  void *slots[NPU_POOL_MAX];
+  rknn_core_mask parent_mask;
+
+  if (!parent || num <= 0 || num > RKNN_RUNNER_POOL_MAX) {
+    printf("invalid rknn runner pool size %d\n", num);
+    return NULL;
+  }
+
+  pool = (rknn_runner_pool_t *)malloc(sizeof(rknn_runner_pool_t));
+  if (pool == NULL) {
+    printf("allocate rknn runner pool oom\n");
+    return NULL;
+  }
+  memset(pool, 0, sizeof(rknn_runner_pool_t));
+
+  // one context per core, a single context keeps the core choice it had
+  pool->runners[0] = parent;
+  pool->num = 1;
+  parent_mask = parent->core_mask;
+  if (num > 1) {
+    rknn_runner_set_core_mask(parent, RKNN_NPU_CORE_0);
+  }
+  for (int i = 1; i < num; i++) {
+    pool->runners[i] =
+        rknn_runner_dup(parent, (rknn_core_mask)(RKNN_NPU_CORE_0 << i));
+    if (pool->runners[i] == NULL) {
+      printf("duplicate rknn runner %d failed, run with %d\n", i, pool->num);
+      break;
+    }
+    pool->num++;
+  }
+  if (pool->num == 1 && parent->core_mask != parent_mask) {
+    rknn_runner_set_core_mask(parent, parent_mask);
+  }
+
+  // a second io set lets the next frame be prepared while one runs, and is
+  // the output set the post stage decodes from meanwhile
+  for (int i = 0; i < pool->num; i++) {
+    pool->runners[i]->pool = pool;
+    if (rknn_runner_set_io_depth(pool->runners[i], io_depth) != 0) {
+      goto release;
+    }
+  }
+
+  // consecutive frames go to different contexts first, then io sets
+  for (int n = 0; n < io_depth; n++) {
+    for (int i = 0; i < pool->num; i++) {
+      slots[n * pool->num + i] = &pool->runners[i]->io[n];
+    }
+  }
+
+  if (npu_pool_init(&pool->npu, slots, pool->num * io_depth,
+                    rknn_runner_pool_run, rknn_runner_pool_post) != 0) {
+    goto release;
+  }
+  pool->duty_start_us = get_timestamp();
+  printf("rknn runner pool with %d contexts, %d io sets each\n", pool->num,
+         io_depth);
+  for (int i = 0; i < pool->num; i++) {
+    rknn_runner_dump_mem_size(pool->runners[i]);
+  }
+
+  return pool;
+
+release:
+  for (int i = pool->num - 1; i > 0; i--) {
+    rknn_runner_destroy(pool->runners[i]);
+  }
+  // the parent stays with the caller, not with a pool that is gone, and on
+  // the cores it ran on before
+  parent->pool = NULL;
+  if (parent->core_mask != parent_mask) {
+    rknn_runner_set_core_mask(parent, parent_mask);
+  }
+  free(pool);
+  return NULL;
+}
+
+int rknn_runner_pool_warmup(rknn_runner_pool_t *pool, int runs) {
+  for (int i = 0; i < pool->num; i++) {
+    if (rknn_runner_warmup(pool->runners[i], runs) != 0) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+float rknn_runner_pool_duty_cycle(rknn_runner_pool_t *pool) {
+  long long now = get_timestamp();
+  unsigned long busy = 0;
+  float duty = 0;
+
+  for (int i = 0; i < pool->num; i++) {
+    busy += __atomic_load_n(&pool->runners[i]->busy_us, __ATOMIC_RELAXED);
+  }
+  if (now > pool->duty_start_us) {
+    duty = (float)(busy - pool->duty_busy_us) /
+           ((now - pool->duty_start_us) * pool->num);
+  }
+  pool->duty_busy_us = busy;
+  pool->duty_start_us = now;
+
+  return duty;
+}
+
+int rknn_runner_pool_report(rknn_runner_pool_t *pool, long long post_us,
+                            int frames, rknn_runner_pool_report_t *report) {
+  long long now = get_timestamp();
+
+  if (pool->report_start_us == 0) {
+    pool->report_start_us = now;
+    rknn_runner_pool_duty_cycle(pool);
+    return 0;
+  }
+
+  pool->report_post_us_sum += post_us;
+  if (post_us > pool->report_post_us_max) {
+    pool->report_post_us_max = post_us;
+  }
+  if (++pool->report_frames < frames) {
+    return 0;
+  }
+
+  report->fps = now > pool->report_start_us
+                    ? pool->report_frames * 1000000.0f /
+                          (now - pool->report_start_us)
+                    : 0;
+  report->duty = rknn_runner_pool_duty_cycle(pool);
+  report->post_us_avg = pool->report_post_us_sum / pool->report_frames;
+  report->post_us_max = pool->report_post_us_max;
+  pool->report_frames = 0;
+  pool->report_start_us = now;
+  pool->report_post_us_sum = 0;
+  pool->report_post_us_max = 0;
+
+  return 1;
+}
+
+int rknn_runner_pool_destroy(rknn_runner_pool_t *pool) {
+  if (!pool) {
+    return -1;
+  }
+
+  npu_pool_cleanup(&pool->npu);
+  // the parent goes last, the others run on its weights
+  for (int i = pool->num - 1; i >= 0; i--) {
+    rknn_runner_destroy(pool->runners[i]);
+  }
+  free(pool);
+
+  return 0;
+}
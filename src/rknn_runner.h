@@ -25,6 +25,7 @@ extern "C" {
 
 #include "rknn_api.h"
 #include <float.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,30 +34,173 @@ extern "C" {
 }
 #endif
 
+#include "dma_alloc.h"
+#include "infer_backend.h"
+#include "npu_pool.h"
+#include "postprocess.h"
+
+// io sets per context and contexts per pool
+#define RKNN_RUNNER_IO_MAX 3
+#define RKNN_RUNNER_POOL_MAX 3
+
+/* called with the rknn_runner_io_t whose outputs are ready */
 typedef void (*rknn_cb_func)(void *);
 
-typedef struct __rknn_runner_s {
+typedef struct __rknn_runner_s rknn_runner_t;
+typedef struct __rknn_runner_pool_s rknn_runner_pool_t;
+
+/* one set of input/output mems, frames of a runner alternate between them */
+typedef struct __rknn_runner_io_s {
+  rknn_runner_t *runner;
+  int index;
+  unsigned long frame; /* set by the producer, follows the frame to post */
+  rknn_run_extend run_ext; /* the queued run of an async runner */
+  rknn_tensor_mem **input_mems;
+  rknn_tensor_mem **output_mems;
+  /* backing of the mems when allocated outside, NULL otherwise */
+  dma_buffer_t *input_bufs;
+  dma_buffer_t *output_bufs;
+} rknn_runner_io_t;
+
+struct __rknn_runner_s {
+  const infer_backend_t *backend;
   rknn_context rknn_ctx;
   rknn_tensor_type input_type;
   rknn_tensor_format input_layout;
+  rknn_tensor_format output_fmt;
   rknn_sdk_version sdk_ver;
   rknn_input_output_num io_num;
   rknn_tensor_attr *input_attrs;
   rknn_tensor_attr *output_attrs;
   rknn_custom_string custom_string;
-  rknn_tensor_mem **input_mems;
-  rknn_tensor_mem **output_mems;
+  rknn_runner_io_t io[RKNN_RUNNER_IO_MAX];
+  int io_depth;
+  int io_bound; /* io set the context currently points at */
+  int async; /* runs are queued and waited for without the run lock */
+  rknn_core_mask core_mask; /* last one set, RKNN_NPU_CORE_AUTO at first */
+  pthread_mutex_t run_lock;
+  qnt_param_t *output_qnts;
+  post_process_workspace_t *post_ws;
+  const label_table_t *labels;
+  yolo_head_e head;
   rknn_cb_func post;
-} rknn_runner_t;
+  FILE *record; /* outputs appended here for the mock backend */
+  int mem_outside; /* every npu buffer comes from the dma heap */
+  rknn_runner_t *weight_parent; /* owner of the weights when shared */
+  dma_buffer_t weight_buf;
+  dma_buffer_t internal_buf;
+  rknn_tensor_mem *weight_mem;
+  rknn_tensor_mem *internal_mem;
+  rknn_runner_pool_t *pool; /* NULL unless run by a pool */
+  unsigned long busy_us; /* time in run, wraps, only differences count */
+  int runs_queued; /* under run_lock, with the start of the busy stretch */
+  long long busy_mark_us;
+};
+
+/*
+ * runners created after this allocate weight, internal and io memory from
+ * the dma heap (RKNN_FLAG_MEM_ALLOC_OUTSIDE). the io sets then carry
+ * dma_buffer_t, whose rga handles are imported once.
+ */
+void rknn_runner_set_mem_outside(int enable);
+
+/*
+ * runners created after this get RKNN_FLAG_ASYNC_MASK and queue their runs:
+ * the next io set of a context is submitted while the npu still works on
+ * the previous one, instead of after its outputs came back. not while
+ * profiling, per layer timings need one run at a time.
+ */
+void rknn_runner_set_async(int enable);
 
 rknn_runner_t *rknn_runner_create(char *model_path, rknn_cb_func func);
 
+/* output_fmt RKNN_TENSOR_NC1HWC2 decodes the npu native layout directly */
 rknn_runner_t *rknn_runner_create(char *model_path,
                                   rknn_tensor_type tensor_type,
                                   rknn_tensor_format tensor_fmt,
+                                  rknn_tensor_format output_fmt,
+                                  rknn_cb_func func);
+
+/*
+ * a context of its own on the weights of parent, created with
+ * RKNN_FLAG_SHARE_WEIGHT_MEM. model_path is the same network, possibly built
+ * for another input size. destroy it before parent.
+ */
+rknn_runner_t *rknn_runner_create(char *model_path, rknn_runner_t *parent,
+                                  rknn_tensor_type tensor_type,
+                                  rknn_tensor_format tensor_fmt,
+                                  rknn_tensor_format output_fmt,
                                   rknn_cb_func func);
 
+/* weight, internal and dma memory of the context, RKNN_QUERY_MEM_SIZE */
+int rknn_runner_mem_size(rknn_runner_t *runner, rknn_mem_size *mem_size);
+
+/* a context on the weights of parent, pinned to core_mask */
+rknn_runner_t *rknn_runner_dup(rknn_runner_t *parent,
+                               rknn_core_mask core_mask);
+int rknn_runner_set_core_mask(rknn_runner_t *runner, rknn_core_mask core_mask);
+
 int rknn_runner_destroy(rknn_runner_t *runner);
+/* append the outputs of every run to record_path, replayable by mock */
+int rknn_runner_record(rknn_runner_t *runner, const char *record_path);
+/* class names of the model, results only carry the class id */
+int rknn_runner_load_labels(rknn_runner_t *runner, const char *label_path);
 int rknn_runner_process(rknn_runner_t *runner, uint8_t *input_data);
+/* adds io sets up to depth, 1 is the set made at create */
+int rknn_runner_set_io_depth(rknn_runner_t *runner, int depth);
+/*
+ * inference on the mems of io, without the post callback, blocks until done.
+ * for the pool and rknn_runner_process, which end the cpu access to the
+ * outputs it begins once the callback returns.
+ */
+int rknn_runner_run(rknn_runner_io_t *io);
+/* runs every io set, outputs and timings are thrown away */
+int rknn_runner_warmup(rknn_runner_t *runner, int runs);
+int rknn_runner_get_post_tensors(rknn_runner_io_t *io, post_tensor_t *tensors,
+                                 int max_num);
+
+/*
+ * runners pinned one per npu core, each with io_depth io sets. frames go
+ * round robin over the io sets and the post callbacks run in submit order.
+ */
+struct __rknn_runner_pool_s {
+  rknn_runner_t *runners[RKNN_RUNNER_POOL_MAX];
+  int num;
+  npu_pool_t npu;
+  unsigned long duty_busy_us;
+  long long duty_start_us;
+  /* post callback only: frames reported on and their post time so far */
+  int report_frames;
+  long long report_start_us;
+  long long report_post_us_sum;
+  long long report_post_us_max;
+};
+
+/* one report window of a pool, see rknn_runner_pool_report */
+typedef struct {
+  float fps;
+  float duty; /* rknn_runner_pool_duty_cycle over the window */
+  long long post_us_avg;
+  long long post_us_max;
+} rknn_runner_pool_report_t;
+
+/* owns parent on success, load the labels on it beforehand */
+rknn_runner_pool_t *rknn_runner_pool_create(rknn_runner_t *parent, int num,
+                                            int io_depth);
+int rknn_runner_pool_destroy(rknn_runner_pool_t *pool);
+/* warm up every runner, call before the first frame is submitted */
+int rknn_runner_pool_warmup(rknn_runner_pool_t *pool, int runs);
+/*
+ * share of time the contexts spent in run since the previous call, 0..1
+ * averaged over the contexts. call from a single thread, the post callback.
+ */
+float rknn_runner_pool_duty_cycle(rknn_runner_pool_t *pool);
+/*
+ * counts a posted frame whose decode took post_us. the first call opens the
+ * window, every frames calls after it fill report and return 1. call from
+ * the post callback, each pool has a post thread and a window of its own.
+ */
+int rknn_runner_pool_report(rknn_runner_pool_t *pool, long long post_us,
+                            int frames, rknn_runner_pool_report_t *report);
 
 #endif /*__RKNN_RUNNER_H__*/
@@ -24,6 +24,7 @@ struct buffer {
   size_t length;
   int export_fd;
   int sequence;
+  image_pkt_t pkt; /* handed out while the buffer is dequeued */
 };
 
 struct v4l2_buffer buf;
@@ -340,31 +341,31 @@ void v4l2_device_destroy(v4l2_device_t *v4l2_device) {
 static void v4l2_device_buffer_unref(void *priv, void *pkt) {
   v4l2_device_priv_t *v4l2_priv = (v4l2_device_priv_t *)priv;
   image_pkt_t *img_pkt = (image_pkt_t *)pkt;
-  int i = 0;
-  for (i = 0; i < v4l2_priv->n_buffers; ++i) {
-    if (img_pkt->dma_fd == v4l2_priv->buffers[i].export_fd) {
-      struct v4l2_buffer buf;
-      CLEAR(buf);
-      buf.type = v4l2_priv->buf_type;
-      buf.memory = V4L2_MEMORY_MMAP;
-      buf.index = i;
-      buf.m.fd = img_pkt->dma_fd;
-
-      if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == v4l2_priv->buf_type) {
-        struct v4l2_plane planes[FMT_NUM_PLANES];
-        buf.m.planes = planes;
-        buf.length = FMT_NUM_PLANES;
-      }
-      if (-1 == xioctl(v4l2_priv->fd, VIDIOC_QBUF, &buf)) {
-        errno_exit("VIDIOC_QBUF");
-      }
-      return;
-    }
+  struct v4l2_buffer buf;
+
+  if (img_pkt->index < 0 ||
+      (unsigned int)img_pkt->index >= v4l2_priv->n_buffers) {
+    printf("[V4l2 Device] unref v4l2 buffer failed!\n");
+    return;
+  }
+
+  CLEAR(buf);
+  buf.type = v4l2_priv->buf_type;
+  buf.memory = V4L2_MEMORY_MMAP;
+  buf.index = img_pkt->index;
+  buf.m.fd = img_pkt->dma_fd;
+
+  if (V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE == v4l2_priv->buf_type) {
+    struct v4l2_plane planes[FMT_NUM_PLANES];
+    buf.m.planes = planes;
+    buf.length = FMT_NUM_PLANES;
+  }
+  if (-1 == xioctl(v4l2_priv->fd, VIDIOC_QBUF, &buf)) {
+    errno_exit("VIDIOC_QBUF");
   }
-  printf("[V4l2 Device] unref v4l2 buffer failed!\n");
 }
 
-int v4l2_device_read(v4l2_device_t *v4l2_device, image_pkt_t *image_pkt) {
+static int v4l2_fill_pkt(v4l2_device_t *v4l2_device, image_pkt_t *image_pkt) {
   v4l2_device_priv_t *v4l2_priv = NULL;
   struct v4l2_buffer buf;
   int bytesused;
@@ -390,7 +391,17 @@ int v4l2_device_read(v4l2_device_t *v4l2_device, image_pkt_t *image_pkt) {
   else
     bytesused = buf.bytesused;
 
+  // the buffer's own packet, unless the caller brought one, which the last
+  // unref frees
+  if (!image_pkt) {
+    image_pkt = &v4l2_priv->buffers[buf.index].pkt;
+    image_pkt->pooled = 1;
+  } else {
+    image_pkt->pooled = 0;
+  }
+  image_pkt->ref_count = 1;
   image_pkt->creator = v4l2_priv;
+  image_pkt->index = buf.index;
   image_pkt->dma_fd = v4l2_priv->buffers[buf.index].export_fd;
   image_pkt->ts = buf.timestamp;
   image_pkt->vir_addr = v4l2_priv->buffers[buf.index].start;
@@ -399,6 +410,23 @@ int v4l2_device_read(v4l2_device_t *v4l2_device, image_pkt_t *image_pkt) {
   image_pkt->height = v4l2_device->height;
   image_pkt->unref = v4l2_device_buffer_unref;
 
-  return 0;
+  return buf.index;
+}
+
+int v4l2_device_read(v4l2_device_t *v4l2_device, image_pkt_t *image_pkt) {
+  if (!image_pkt) {
+    return -1;
+  }
+  return v4l2_fill_pkt(v4l2_device, image_pkt) < 0 ? -1 : 0;
+}
+
+image_pkt_t *v4l2_device_dequeue(v4l2_device_t *v4l2_device) {
+  int index = v4l2_fill_pkt(v4l2_device, NULL);
+  if (index < 0) {
+    return NULL;
+  }
+  v4l2_device_priv_t *v4l2_priv = (v4l2_device_priv_t *)v4l2_device->priv;
+
+  return &v4l2_priv->buffers[index].pkt;
 }
 
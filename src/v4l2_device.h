@@ -21,8 +21,19 @@ int v4l2_device_init(v4l2_device_t *v4l2_device);
 v4l2_device_t *v4l2_device_create(const char *vdev_name, const char *format,
                                   int width, int height, int buf_num);
 void v4l2_device_destroy(v4l2_device_t *v4l2_device);
+/*
+ * next frame in image_pkt, a malloc'd packet with one reference for the
+ * caller. the last unref requeues the buffer and frees the packet.
+ */
 int v4l2_device_read(v4l2_device_t *v4l2_device, image_pkt_t *image_pkt);
 
+/*
+ * next frame in the packet preallocated for its buffer, with one reference
+ * for the caller, NULL on failure. the packet is recycled with the buffer
+ * on its last unref, capture allocates nothing per frame.
+ */
+image_pkt_t *v4l2_device_dequeue(v4l2_device_t *v4l2_device);
+
 #ifdef __cplusplus
 }
 #endif
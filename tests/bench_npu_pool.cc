@@ -0,0 +1,122 @@
+#include "infer_backend.h"
+#include "postprocess.h"
+#include "rknn_runner.h"
+#include "test_common.h"
+#include "yolo_fixture.h"
+#include "yolo_fixture_record.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * frames per second of a single runner against runner pools, on the mock
+ * backend replaying an 80 class 640x640 scene. run takes the mock latency,
+ * the producer sleeps the preprocess time and the post callback decodes for
+ * real. a single runner does the three one after the other, a pool
+ * overlaps the runs of its contexts and io sets with both. async pools
+ * queue the run of the next io set behind the current one.
+ *
+ * usage: bench_npu_pool [frames] [run_us] [preprocess_us]
+ */
+#define RECORD "bench_npu_pool.rec"
+#define LABELS "bench_npu_pool_labels.txt"
+
+static int preprocess_us;
+
+static void bench_post(void *arg) {
+  rknn_runner_io_t *io = (rknn_runner_io_t *)arg;
+  rknn_runner_t *runner = io->runner;
+  detect_result_group_t group;
+
+  post_process((int8_t *)io->output_mems[0]->virt_addr,
+               (int8_t *)io->output_mems[1]->virt_addr,
+               (int8_t *)io->output_mems[2]->virt_addr,
+               runner->input_attrs[0].dims[1], runner->input_attrs[0].dims[2],
+               NMS_THRESH, 1, 1, runner->output_qnts, runner->post_ws, &group);
+}
+
+static rknn_runner_t *bench_runner(void) {
+  rknn_runner_t *runner = rknn_runner_create((char *)RECORD, bench_post);
+  if (runner && rknn_runner_load_labels(runner, LABELS) != 0) {
+    rknn_runner_destroy(runner);
+    return NULL;
+  }
+  return runner;
+}
+
+static void bench_single(int frames) {
+  rknn_runner_t *runner = bench_runner();
+  if (!runner) {
+    return;
+  }
+
+  long long start = test_now_us();
+  for (int i = 0; i < frames; i++) {
+    usleep(preprocess_us);
+    rknn_runner_process(runner, NULL);
+  }
+  long long us = test_now_us() - start;
+
+  printf("single runner:            %6.1f fps\n", frames * 1e6 / us);
+  rknn_runner_destroy(runner);
+}
+
+static void bench_pool(int num, int io_depth, int async, int frames) {
+  rknn_runner_set_async(async);
+  rknn_runner_t *parent = bench_runner();
+  if (!parent) {
+    return;
+  }
+  rknn_runner_pool_t *pool = rknn_runner_pool_create(parent, num, io_depth);
+  if (!pool) {
+    rknn_runner_destroy(parent);
+    return;
+  }
+
+  rknn_runner_pool_duty_cycle(pool);
+  long long start = test_now_us();
+  for (int i = 0; i < frames; i++) {
+    int slot = npu_pool_acquire(&pool->npu, 1000);
+    if (slot < 0) {
+      continue;
+    }
+    usleep(preprocess_us);
+    npu_pool_submit(&pool->npu, slot);
+  }
+  npu_pool_drain(&pool->npu);
+  long long us = test_now_us() - start;
+
+  printf("%d contexts, %d io sets each%s: %6.1f fps, npu duty %3.0f%%\n",
+         num, io_depth, async ? ", async" : "", frames * 1e6 / us,
+         rknn_runner_pool_duty_cycle(pool) * 100);
+  rknn_runner_pool_destroy(pool);
+}
+
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 200;
+  int run_us = argc > 2 ? atoi(argv[2]) : 20000;
+  preprocess_us = argc > 3 ? atoi(argv[3]) : 5000;
+  yolo_fixture_t fx;
+
+  yolo_fixture_init(&fx, 640, 80, 0.001f, 1);
+  yolo_fixture_add_objects(&fx, 10, 1);
+  if (yolo_fixture_record(RECORD, &fx, 0) != 0 ||
+      yolo_fixture_write_labels(LABELS, 80) != 0) {
+    return 1;
+  }
+  infer_backend_select("mock");
+  infer_backend_mock_set_latency(run_us);
+  printf("run %d us, preprocess %d us\n", run_us, preprocess_us);
+
+  bench_single(frames);
+  bench_pool(1, 1, 0, frames);
+  bench_pool(1, 2, 0, frames);
+  bench_pool(1, 2, 1, frames);
+  bench_pool(2, 2, 0, frames);
+  bench_pool(2, 2, 1, frames);
+  bench_pool(3, 2, 1, frames);
+
+  label_table_cleanup();
+  remove(RECORD);
+  remove(LABELS);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "postprocess.h"
+#include "test_common.h"
+#include "yolo_fixture.h"
+#include <stdlib.h>
+
+/*
+ * post_process time per frame on synthetic yolov5 outputs of a 640x640
+ * model, for 80 and 1 classes in a quiet and a busy scene. the quiet scene
+ * is mostly the decode scan, the busy one adds the argmax of every anchor
+ * that passed the box gate and nms. then the quiet 80 class scene again,
+ * decoded on 1 to 4 threads.
+ *
+ * last, the decode kernels specialized on 80, 2 and 1 classes against the
+ * generic one on the same scene, for NHWC and NCHW outputs.
+ *
+ * usage: bench_postprocess [frames]
+ */
+static long long bench_scene(int class_num, float busy, int threads,
+                             int layout, int frames) {
+  yolo_fixture_t fx;
+  detect_result_group_t group;
+  std::vector<int8_t> inputs[YOLO_FIXTURE_BRANCHES];
+
+  yolo_fixture_init(&fx, 640, class_num, busy, 1);
+  for (int b = 0; b < YOLO_FIXTURE_BRANCHES; b++) {
+    inputs[b] =
+        layout == POST_LAYOUT_NCHW ? yolo_fixture_nchw(&fx, b) : fx.nhwc[b];
+  }
+  post_process_workspace_t *ws = post_process_workspace_create(640, 640);
+  post_process_workspace_set_threads(ws, threads);
+  ws->labels = &fx.labels;
+  ws->layout = layout;
+
+  for (int i = 0; i < 10; i++) {
+    post_process(inputs[0].data(), inputs[1].data(), inputs[2].data(), 640,
+                 640, NMS_THRESH, 1, 1, fx.qnts, ws, &group);
+  }
+
+  long long start = test_now_us();
+  for (int i = 0; i < frames; i++) {
+    post_process(inputs[0].data(), inputs[1].data(), inputs[2].data(), 640,
+                 640, NMS_THRESH, 1, 1, fx.qnts, ws, &group);
+  }
+  long long us = (test_now_us() - start) / frames;
+
+  printf("%2d classes, %4.1f%% busy, %d threads, %s: %6lld us/frame, "
+         "%zu candidates, %d boxes\n",
+         class_num, busy * 100, threads,
+         layout == POST_LAYOUT_NCHW ? "nchw" : "nhwc", us,
+         ws->objProbs.size(), group.count);
+  post_process_workspace_destroy(ws);
+
+  return us;
+}
+
+int main(int argc, char **argv) {
+  int frames = argc > 1 ? atoi(argv[1]) : 200;
+
+  bench_scene(80, 0.001f, 1, POST_LAYOUT_NHWC, frames);
+  bench_scene(80, 0.05f, 1, POST_LAYOUT_NHWC, frames);
+  bench_scene(1, 0.001f, 1, POST_LAYOUT_NHWC, frames);
+  bench_scene(1, 0.05f, 1, POST_LAYOUT_NHWC, frames);
+
+  for (int threads = 2; threads <= 4; threads++) {
+    bench_scene(80, 0.001f, threads, POST_LAYOUT_NHWC, frames);
+  }
+
+  const int specialized[] = {80, 2, 1};
+  const int layouts[] = {POST_LAYOUT_NHWC, POST_LAYOUT_NCHW};
+  for (int l = 0; l < 2; l++) {
+    for (int i = 0; i < 3; i++) {
+      long long fixed =
+          bench_scene(specialized[i], 0.001f, 1, layouts[l], frames);
+      post_process_set_decode_generic(1);
+      long long generic =
+          bench_scene(specialized[i], 0.001f, 1, layouts[l], frames);
+      post_process_set_decode_generic(0);
+      printf("  specialized %lld us, generic %lld us\n", fixed, generic);
+    }
+  }
+
+  return 0;
+}
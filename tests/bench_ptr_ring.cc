@@ -0,0 +1,155 @@
+#include "ptr_queue.h"
+#include "ptr_ring.h"
+#include "test_common.h"
+#include <algorithm>
+#include <pthread.h>
+#include <stdlib.h>
+#include <vector>
+
+/*
+ * ptr_ring against the mutex and condvar ptr_queue it replaced on the
+ * pipeline queues. a ping-pong with one message in flight, where the
+ * waiting side parks every time, then throughput and enqueue to dequeue
+ * latency with 1 to 4 producers into one consumer, on the capacities the
+ * pipeline uses.
+ *
+ * usage: bench_ptr_ring [messages]
+ */
+typedef struct {
+  int ring;
+  ptr_queue_t queue;
+  ptr_ring_t ptr_ring;
+} bench_queue_t;
+
+static void bench_init(bench_queue_t *q, int ring, int capacity) {
+  q->ring = ring;
+  if (ring) {
+    ptr_ring_init(&q->ptr_ring, capacity);
+  } else {
+    ptr_queue_init(&q->queue, capacity);
+  }
+}
+
+static void bench_cleanup(bench_queue_t *q) {
+  if (q->ring) {
+    ptr_ring_cleanup(&q->ptr_ring);
+  } else {
+    ptr_queue_cleanup(&q->queue);
+  }
+}
+
+static int bench_enqueue(bench_queue_t *q, void *data, int timeout_ms) {
+  return q->ring ? ptr_ring_enqueue(&q->ptr_ring, data, timeout_ms)
+                 : ptr_queue_enqueue(&q->queue, data, timeout_ms);
+}
+
+static void *bench_dequeue(bench_queue_t *q, int timeout_ms) {
+  return q->ring ? ptr_ring_dequeue(&q->ptr_ring, timeout_ms)
+                 : ptr_queue_dequeue(&q->queue, timeout_ms);
+}
+
+static const char *bench_name(int ring) {
+  return ring ? "ptr_ring " : "ptr_queue";
+}
+
+static bench_queue_t ping, pong;
+static int round_trips;
+
+static void *pong_thread(void *arg) {
+  for (int i = 0; i < round_trips; i++) {
+    bench_enqueue(&pong, bench_dequeue(&ping, 1000), 1000);
+  }
+  return NULL;
+}
+
+static void bench_ping_pong(int ring) {
+  std::vector<long long> us(round_trips);
+  pthread_t tid;
+  int msg;
+
+  bench_init(&ping, ring, 2);
+  bench_init(&pong, ring, 2);
+  pthread_create(&tid, NULL, pong_thread, NULL);
+  for (int i = 0; i < round_trips; i++) {
+    long long start = test_now_us();
+    bench_enqueue(&ping, &msg, 1000);
+    bench_dequeue(&pong, 1000);
+    us[i] = test_now_us() - start;
+  }
+  pthread_join(tid, NULL);
+  bench_cleanup(&ping);
+  bench_cleanup(&pong);
+
+  std::sort(us.begin(), us.end());
+  printf("%s ping-pong round trip: p50 %4lld us, p99 %4lld us\n",
+         bench_name(ring), us[round_trips / 2], us[round_trips * 99 / 100]);
+}
+
+typedef struct {
+  bench_queue_t *q;
+  std::vector<long long> stamps;
+} bench_producer_t;
+
+static void *produce(void *arg) {
+  bench_producer_t *producer = (bench_producer_t *)arg;
+
+  for (size_t i = 0; i < producer->stamps.size(); i++) {
+    producer->stamps[i] = test_now_us();
+    while (bench_enqueue(producer->q, &producer->stamps[i], 1000) != 0) {
+    }
+  }
+  return NULL;
+}
+
+static void bench_throughput(int ring, int producers, int capacity,
+                             int messages) {
+  bench_queue_t q;
+  bench_producer_t producer[4];
+  pthread_t tids[4];
+  int per_producer = messages / producers;
+  std::vector<long long> latency(per_producer * producers);
+
+  bench_init(&q, ring, capacity);
+  long long start = test_now_us();
+  for (int p = 0; p < producers; p++) {
+    producer[p].q = &q;
+    producer[p].stamps.resize(per_producer);
+    pthread_create(&tids[p], NULL, produce, &producer[p]);
+  }
+  for (size_t i = 0; i < latency.size(); i++) {
+    long long *stamp = (long long *)bench_dequeue(&q, 1000);
+    latency[i] = stamp ? test_now_us() - *stamp : 1000000;
+  }
+  long long us = test_now_us() - start;
+  for (int p = 0; p < producers; p++) {
+    pthread_join(tids[p], NULL);
+  }
+  bench_cleanup(&q);
+
+  std::sort(latency.begin(), latency.end());
+  printf("%s %d producers, capacity %2d: %5.2f Mmsg/s, latency p50 %5lld "
+         "us, p99 %5lld us\n",
+         bench_name(ring), producers, capacity,
+         (double)latency.size() / us, latency[latency.size() / 2],
+         latency[latency.size() * 99 / 100]);
+}
+
+int main(int argc, char **argv) {
+  int messages = argc > 1 ? atoi(argv[1]) : 200000;
+  const int capacities[] = {2, 4, 16};
+
+  round_trips = messages / 10;
+  for (int ring = 0; ring < 2; ring++) {
+    bench_ping_pong(ring);
+  }
+
+  for (int c = 0; c < 3; c++) {
+    for (int producers = 1; producers <= 4; producers *= 2) {
+      for (int ring = 0; ring < 2; ring++) {
+        bench_throughput(ring, producers, capacities[c], messages);
+      }
+    }
+  }
+
+  return 0;
+}
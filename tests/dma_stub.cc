@@ -0,0 +1,76 @@
+#include "dma_alloc.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * heap backed dma buffers for host builds, enough for runners created with
+ * rknn_runner_set_mem_outside on the mock backend. there is no device to
+ * sync with and no rga to import into. each buffer gets a fd of its own
+ * only to check that every cpu access start is ended once.
+ */
+#define DMA_STUB_FD_BASE 1000
+#define DMA_STUB_FD_MAX 256
+
+static pthread_mutex_t stub_lock = PTHREAD_MUTEX_INITIALIZER;
+static int stub_next_fd;
+static int stub_open[DMA_STUB_FD_MAX];
+static int stub_unpaired;
+
+/* syncs out of order so far, and cpu accesses started and not ended */
+int dma_stub_unpaired(void) { return stub_unpaired; }
+
+int dma_stub_open(void) {
+  int open = 0;
+  pthread_mutex_lock(&stub_lock);
+  for (int i = 0; i < DMA_STUB_FD_MAX; i++) {
+    open += stub_open[i];
+  }
+  pthread_mutex_unlock(&stub_lock);
+  return open;
+}
+
+static int stub_sync(int fd, int start) {
+  int index = fd - DMA_STUB_FD_BASE;
+  if (index < 0 || index >= DMA_STUB_FD_MAX) {
+    return -1;
+  }
+  pthread_mutex_lock(&stub_lock);
+  // a start while started or an end without one
+  if (stub_open[index] == start) {
+    stub_unpaired++;
+  }
+  stub_open[index] = start;
+  pthread_mutex_unlock(&stub_lock);
+  return 0;
+}
+
+int dma_buffer_alloc(dma_buffer_t *buf, size_t size) {
+  memset(buf, 0, sizeof(dma_buffer_t));
+  buf->va = calloc(1, size);
+  if (!buf->va) {
+    return -1;
+  }
+  // fds come round again, far more buffers than ever live at once
+  pthread_mutex_lock(&stub_lock);
+  buf->fd = DMA_STUB_FD_BASE + stub_next_fd++ % DMA_STUB_FD_MAX;
+  stub_open[buf->fd - DMA_STUB_FD_BASE] = 0;
+  pthread_mutex_unlock(&stub_lock);
+  buf->size = size;
+
+  return 0;
+}
+
+void dma_buffer_free(dma_buffer_t *buf) {
+  if (buf->size) {
+    free(buf->va);
+    memset(buf, 0, sizeof(dma_buffer_t));
+  }
+}
+
+uint32_t dma_buffer_rga_handle(dma_buffer_t *buf) { return 0; }
+
+int dma_sync_device_to_cpu(int fd) { return stub_sync(fd, 1); }
+
+int dma_sync_cpu_to_device(int fd) { return stub_sync(fd, 0); }
@@ -0,0 +1,318 @@
+#include "postprocess.h"
+#include "test_common.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * the anchor free (yolov8) decode against a float reference: plain expf
+ * softmax for the DFL boxes, sigmoid or identity for the class scores and
+ * the score sum compared as is. synthetic int8 NHWC heads of a 320x320
+ * model, with and without the score sum tensor, with activated and raw
+ * class tensors. candidates are compared before nms, in decode order.
+ * last, post_process_detect_head on good and broken output sets, and the
+ * class activation set by hand over the guess from the quant params.
+ */
+#define MODEL_IN 320
+#define CLASS_NUM 5
+#define DFL_LEN 16
+#define BRANCHES 3
+
+typedef struct {
+  int grid[BRANCHES];
+  std::vector<int8_t> box[BRANCHES];
+  std::vector<int8_t> cls[BRANCHES];
+  std::vector<int8_t> sum[BRANCHES];
+  qnt_param_t box_qnt;
+  qnt_param_t cls_qnt;
+  qnt_param_t sum_qnt;
+  int activated;
+} head_t;
+
+static float deqnt(int8_t q, const qnt_param_t *qnt) {
+  return ((float)q - qnt->zp) * qnt->scale;
+}
+
+static int8_t qnt(float f, const qnt_param_t *qnt) {
+  float q = roundf(f / qnt->scale) + qnt->zp;
+  return (int8_t)(q < -128 ? -128 : (q > 127 ? 127 : q));
+}
+
+static float cls_prob(int8_t q, const head_t *head) {
+  float val = deqnt(q, &head->cls_qnt);
+  return head->activated ? val : 1.0f / (1.0f + expf(-val));
+}
+
+static float random_range(float lo, float hi, unsigned int *seed) {
+  return lo + (hi - lo) * (rand_r(seed) % 10000) / 10000.0f;
+}
+
+/* a class score kept clear of BOX_THRESH, so rounding can not flip it */
+static int8_t cls_value(const head_t *head, int high, unsigned int *seed) {
+  float prob = high ? random_range(0.4f, 0.95f, seed)
+                    : random_range(0.02f, 0.15f, seed);
+  float val = head->activated ? prob : logf(prob / (1.0f - prob));
+  return qnt(val, &head->cls_qnt);
+}
+
+/*
+ * 4% of the cells hold an object, a quarter of those with a score sum below
+ * the threshold that the decoder must skip on the sum alone
+ */
+static void head_init(head_t *head, int activated, unsigned int seed) {
+  head->activated = activated;
+  qnt_param_init(&head->box_qnt, 0, 0.1f, BOX_THRESH);
+  if (activated) {
+    qnt_param_init(&head->cls_qnt, -128, 1.0f / 255, BOX_THRESH);
+  } else {
+    qnt_param_init(&head->cls_qnt, 0, 0.05f, BOX_THRESH);
+  }
+  // a sum over CLASS_NUM scores, its range does not look activated
+  qnt_param_init(&head->sum_qnt, -128, (float)CLASS_NUM / 255, BOX_THRESH);
+
+  for (int b = 0; b < BRANCHES; b++) {
+    int grid = MODEL_IN / (8 << b);
+    int cells = grid * grid;
+    head->grid[b] = grid;
+    head->box[b].resize(cells * 4 * DFL_LEN);
+    head->cls[b].resize(cells * CLASS_NUM);
+    head->sum[b].resize(cells);
+
+    for (int cell = 0; cell < cells; cell++) {
+      for (int i = 0; i < 4 * DFL_LEN; i++) {
+        head->box[b][cell * 4 * DFL_LEN + i] =
+            (int8_t)(rand_r(&seed) % 121 - 60);
+      }
+
+      int object = rand_r(&seed) % 100 < 4;
+      int best = rand_r(&seed) % CLASS_NUM;
+      float sum = 0.f;
+      for (int c = 0; c < CLASS_NUM; c++) {
+        int8_t q = cls_value(head, object && c == best, &seed);
+        head->cls[b][cell * CLASS_NUM + c] = q;
+        sum += cls_prob(q, head);
+      }
+      if (object && rand_r(&seed) % 4 == 0) {
+        sum = 0.1f;
+      }
+      head->sum[b][cell] = qnt(sum, &head->sum_qnt);
+    }
+  }
+}
+
+static void head_tensors(head_t *head, int with_sum, post_tensor_t *tensors,
+                         qnt_param_t *qnts, int *n_output) {
+  int n = 0;
+  for (int b = 0; b < BRANCHES; b++) {
+    post_tensor_t box = {head->box[b].data(), head->grid[b], head->grid[b],
+                         4 * DFL_LEN};
+    post_tensor_t cls = {head->cls[b].data(), head->grid[b], head->grid[b],
+                         CLASS_NUM};
+    tensors[n] = box;
+    qnts[n++] = head->box_qnt;
+    tensors[n] = cls;
+    qnts[n++] = head->cls_qnt;
+    if (with_sum) {
+      post_tensor_t sum = {head->sum[b].data(), head->grid[b], head->grid[b],
+                           1};
+      tensors[n] = sum;
+      qnts[n++] = head->sum_qnt;
+    }
+  }
+  *n_output = n;
+}
+
+static float reference_dfl(const int8_t *bins, const qnt_param_t *box_qnt) {
+  float exps[DFL_LEN];
+  float max_val = -1e30f;
+  float sum = 0.f;
+  float acc = 0.f;
+
+  for (int i = 0; i < DFL_LEN; i++) {
+    max_val = fmaxf(max_val, deqnt(bins[i], box_qnt));
+  }
+  for (int i = 0; i < DFL_LEN; i++) {
+    exps[i] = expf(deqnt(bins[i], box_qnt) - max_val);
+    sum += exps[i];
+    acc += exps[i] * i;
+  }
+  return acc / sum;
+}
+
+static void reference_decode(const head_t *head, int with_sum,
+                             std::vector<float> &boxes,
+                             std::vector<float> &scores,
+                             std::vector<int> &classes) {
+  for (int b = 0; b < BRANCHES; b++) {
+    int grid = head->grid[b];
+    int stride = MODEL_IN / grid;
+    for (int h = 0; h < grid; h++) {
+      for (int w = 0; w < grid; w++) {
+        int cell = h * grid + w;
+        if (with_sum &&
+            deqnt(head->sum[b][cell], &head->sum_qnt) < BOX_THRESH) {
+          continue;
+        }
+
+        int best = 0;
+        float best_prob = -1.f;
+        for (int c = 0; c < CLASS_NUM; c++) {
+          float prob = cls_prob(head->cls[b][cell * CLASS_NUM + c], head);
+          if (prob > best_prob) {
+            best = c;
+            best_prob = prob;
+          }
+        }
+        if (best_prob <= BOX_THRESH) {
+          continue;
+        }
+
+        const int8_t *bins = &head->box[b][cell * 4 * DFL_LEN];
+        float dist[4];
+        for (int side = 0; side < 4; side++) {
+          dist[side] = reference_dfl(bins + side * DFL_LEN, &head->box_qnt);
+        }
+        float x1 = (w + 0.5f - dist[0]) * stride;
+        float y1 = (h + 0.5f - dist[1]) * stride;
+        float x2 = (w + 0.5f + dist[2]) * stride;
+        float y2 = (h + 0.5f + dist[3]) * stride;
+        boxes.push_back(x1);
+        boxes.push_back(y1);
+        boxes.push_back(x2 - x1);
+        boxes.push_back(y2 - y1);
+        scores.push_back(best_prob);
+        classes.push_back(best);
+      }
+    }
+  }
+}
+
+static void check_decode(int activated, int with_sum, unsigned int seed) {
+  head_t head;
+  post_tensor_t tensors[POST_TENSOR_MAX];
+  qnt_param_t qnts[POST_TENSOR_MAX];
+  detect_result_group_t group;
+  label_table_t labels;
+  int n_output;
+  std::vector<float> boxes, scores;
+  std::vector<int> classes;
+
+  head_init(&head, activated, seed);
+  head_tensors(&head, with_sum, tensors, qnts, &n_output);
+  TEST_CHECK(post_process_detect_head(tensors, n_output) ==
+             YOLO_HEAD_ANCHOR_FREE);
+
+  memset(&labels, 0, sizeof(labels));
+  labels.count = CLASS_NUM;
+  post_process_workspace_t *ws =
+      post_process_workspace_create(MODEL_IN, MODEL_IN);
+  ws->labels = &labels;
+  post_process_anchor_free(tensors, n_output, MODEL_IN, MODEL_IN, NMS_THRESH,
+                           1, 1, qnts, ws, &group);
+  reference_decode(&head, with_sum, boxes, scores, classes);
+
+  int same = ws->classId == classes && ws->objProbs.size() == scores.size();
+  for (size_t i = 0; same && i < scores.size(); i++) {
+    same = fabsf(ws->objProbs[i] - scores[i]) < 1e-5f;
+  }
+  // expectations of exact and looked up exponentials, in model pixels
+  for (size_t i = 0; same && i < boxes.size(); i++) {
+    same = fabsf(ws->filterBoxes[i] - boxes[i]) < 1e-2f;
+  }
+  if (!same) {
+    printf("activated %d, score sum %d: %zu candidates, reference %zu\n",
+           activated, with_sum, ws->objProbs.size(), scores.size());
+  }
+  TEST_CHECK(scores.size() > 50);
+  TEST_CHECK(same);
+  TEST_CHECK(group.count > 0);
+
+  post_process_workspace_destroy(ws);
+}
+
+static void check_detect_head(void) {
+  int8_t data[1] = {0};
+  post_tensor_t tensors[POST_TENSOR_MAX];
+
+  // yolov5: three outputs, whatever their shape
+  for (int b = 0; b < 3; b++) {
+    post_tensor_t t = {data, 80 >> b, 80 >> b, 255};
+    tensors[b] = t;
+  }
+  TEST_CHECK(post_process_detect_head(tensors, 3) == YOLO_HEAD_ANCHOR_BASED);
+
+  // yolov8: box and class per branch, optionally the score sum
+  for (int with_sum = 0; with_sum <= 1; with_sum++) {
+    int per_branch = 2 + with_sum;
+    for (int b = 0; b < 3; b++) {
+      int grid = 80 >> b;
+      post_tensor_t box = {data, grid, grid, 4 * DFL_LEN};
+      post_tensor_t cls = {data, grid, grid, 80};
+      post_tensor_t sum = {data, grid, grid, 1};
+      tensors[b * per_branch] = box;
+      tensors[b * per_branch + 1] = cls;
+      if (with_sum) {
+        tensors[b * per_branch + 2] = sum;
+      }
+    }
+    int n_output = 3 * per_branch;
+    TEST_CHECK(post_process_detect_head(tensors, n_output) ==
+               YOLO_HEAD_ANCHOR_FREE);
+
+    // box channels that are no DFL, class grid off the box grid
+    tensors[0].channels = 4 * DFL_LEN + 1;
+    TEST_CHECK(post_process_detect_head(tensors, n_output) ==
+               YOLO_HEAD_UNKNOWN);
+    tensors[0].channels = 4 * DFL_LEN;
+    tensors[per_branch + 1].grid_h = 20;
+    TEST_CHECK(post_process_detect_head(tensors, n_output) ==
+               YOLO_HEAD_UNKNOWN);
+    tensors[per_branch + 1].grid_h = 40;
+    if (with_sum) {
+      tensors[2].channels = 2;
+      TEST_CHECK(post_process_detect_head(tensors, n_output) ==
+                 YOLO_HEAD_UNKNOWN);
+    }
+  }
+
+  TEST_CHECK(post_process_detect_head(tensors, 5) == YOLO_HEAD_UNKNOWN);
+}
+
+static void check_class_activation(void) {
+  qnt_param_t looks_activated, looks_raw;
+  int8_t q = 64;
+
+  qnt_param_init(&looks_activated, -128, 1.0f / 255, BOX_THRESH);
+  qnt_param_init(&looks_raw, 0, 0.05f, BOX_THRESH);
+  TEST_CHECK(looks_activated.prob_activated);
+  TEST_CHECK(!looks_raw.prob_activated);
+
+  post_process_set_class_activation(POST_ACTIVATION_SIGMOID);
+  qnt_param_init(&looks_activated, -128, 1.0f / 255, BOX_THRESH);
+  TEST_CHECK(!looks_activated.prob_activated);
+  float val = deqnt(q, &looks_activated);
+  TEST_CHECK(fabsf(looks_activated.prob_lut[q + 128] -
+                   1.0f / (1.0f + expf(-val))) < 1e-6f);
+
+  post_process_set_class_activation(POST_ACTIVATION_NONE);
+  qnt_param_init(&looks_raw, 0, 0.05f, BOX_THRESH);
+  TEST_CHECK(looks_raw.prob_activated);
+  TEST_CHECK(fabsf(looks_raw.prob_lut[q + 128] - deqnt(q, &looks_raw)) <
+             1e-6f);
+
+  post_process_set_class_activation(POST_ACTIVATION_AUTO);
+}
+
+int main() {
+  for (int activated = 0; activated <= 1; activated++) {
+    for (int with_sum = 0; with_sum <= 1; with_sum++) {
+      check_decode(activated, with_sum, 11 + activated * 2 + with_sum);
+    }
+  }
+  check_detect_head();
+  check_class_activation();
+
+  printf("test_anchor_free: %d failures\n", test_failures);
+  return test_failures != 0;
+}
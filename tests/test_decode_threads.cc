@@ -0,0 +1,73 @@
+#include "postprocess.h"
+#include "test_common.h"
+#include "yolo_fixture.h"
+
+/*
+ * decoding on the worker pool must hand nms the very candidates of the
+ * serial decode, in the same order, for every layout and thread count
+ */
+static void decode(post_process_workspace_t *ws, yolo_fixture_t *fx,
+                   std::vector<int8_t> *inputs) {
+  detect_result_group_t group;
+
+  ws->labels = &fx->labels;
+  post_process(inputs[0].data(), inputs[1].data(), inputs[2].data(),
+               fx->model_in, fx->model_in, NMS_THRESH, 1, 1, fx->qnts, ws,
+               &group);
+}
+
+static void check_layout(int class_num, int layout, int c2) {
+  yolo_fixture_t fx;
+  std::vector<int8_t> inputs[YOLO_FIXTURE_BRANCHES];
+
+  yolo_fixture_init(&fx, 640, class_num, 0.05f, 7);
+  yolo_fixture_add_objects(&fx, 10, 7);
+  for (int b = 0; b < YOLO_FIXTURE_BRANCHES; b++) {
+    if (layout == POST_LAYOUT_NCHW) {
+      inputs[b] = yolo_fixture_nchw(&fx, b);
+    } else if (layout == POST_LAYOUT_NC1HWC2) {
+      inputs[b] = yolo_fixture_nc1hwc2(&fx, b, c2);
+    } else {
+      inputs[b] = fx.nhwc[b];
+    }
+  }
+
+  post_process_workspace_t *serial = post_process_workspace_create(640, 640);
+  serial->layout = layout;
+  serial->c2 = c2;
+  decode(serial, &fx, inputs);
+  TEST_CHECK(serial->objProbs.size() > 100);
+
+  for (int threads = 2; threads <= 4; threads++) {
+    post_process_workspace_t *ws = post_process_workspace_create(640, 640);
+    post_process_workspace_set_threads(ws, threads);
+    ws->layout = layout;
+    ws->c2 = c2;
+    decode(ws, &fx, inputs);
+
+    int same = ws->filterBoxes == serial->filterBoxes &&
+               ws->objProbs == serial->objProbs &&
+               ws->classId == serial->classId;
+    if (!same) {
+      printf("%d classes, layout %d, %d threads: candidates differ\n",
+             class_num, layout, threads);
+    }
+    TEST_CHECK(same);
+    post_process_workspace_destroy(ws);
+  }
+
+  post_process_workspace_destroy(serial);
+}
+
+int main() {
+  const int class_nums[] = {80, 1, 7};
+
+  for (int i = 0; i < 3; i++) {
+    check_layout(class_nums[i], POST_LAYOUT_NHWC, 1);
+    check_layout(class_nums[i], POST_LAYOUT_NCHW, 1);
+    check_layout(class_nums[i], POST_LAYOUT_NC1HWC2, 16);
+  }
+
+  printf("test_decode_threads: %d failures\n", test_failures);
+  return test_failures != 0;
+}
@@ -0,0 +1,136 @@
+#include "det_pool.h"
+#include "test_common.h"
+#include <pthread.h>
+#include <unistd.h>
+
+/*
+ * the result groups of main.cpp: posts take two groups and queue them to
+ * the display and the uart. with the uart stalled and its queue full, the
+ * display holding its groups and a second model posting, every post still
+ * finds its groups at once. then the same with a slow uart on a thread.
+ */
+#define POSTS 1000
+#define HELD (2 + 1 + 2 * 2)
+
+static ptr_ring_t info_queue, uart_queue;
+static det_pool_t pool;
+
+/* the group handling of rknn_runner_post, 0 if it had to drop the frame */
+static int post(void) {
+  detect_result_group_t *group = det_pool_get(&pool);
+  detect_result_group_t *group_s = det_pool_get(&pool);
+  if (!group || !group_s) {
+    det_pool_put(&pool, group);
+    det_pool_put(&pool, group_s);
+    return 0;
+  }
+
+  if (ptr_ring_enqueue(&info_queue, group, 0)) {
+    det_pool_put(&pool, group);
+  }
+  if (ptr_ring_enqueue(&uart_queue, group_s, 0)) {
+    det_pool_put(&pool, group_s);
+  }
+  return 1;
+}
+
+static void setup(void) {
+  ptr_ring_t *queues[] = {&info_queue, &uart_queue};
+
+  TEST_CHECK(ptr_ring_init(&info_queue, 5) == 0);
+  TEST_CHECK(ptr_ring_init(&uart_queue, 10) == 0);
+  TEST_CHECK(det_pool_init(&pool, queues, 2, HELD) == 0);
+  // the rings hold 8 and 16, not the 5 and 10 asked for
+  TEST_CHECK(pool.num == 8 + 16 + HELD);
+}
+
+static void teardown(void) {
+  det_pool_cleanup(&pool);
+  ptr_ring_cleanup(&info_queue);
+  ptr_ring_cleanup(&uart_queue);
+}
+
+static void check_stalled_consumers(void) {
+  detect_result_group_t *held[HELD - 2];
+  int dropped = 0;
+  long long slowest = 0;
+
+  setup();
+  // shown and new display group, the uart's, and the other model's post
+  for (int i = 0; i < HELD - 2; i++) {
+    held[i] = det_pool_get(&pool);
+    TEST_CHECK(held[i] != NULL);
+  }
+
+  for (int i = 0; i < POSTS; i++) {
+    long long start = test_now_us();
+    dropped += !post();
+    long long us = test_now_us() - start;
+    slowest = us > slowest ? us : slowest;
+  }
+  TEST_CHECK(dropped == 0);
+  // a post that waited for a group or a queue slot takes 10 ms
+  TEST_CHECK(slowest < 5000);
+  TEST_CHECK(ptr_ring_dequeue(&uart_queue, 0) != NULL);
+
+  for (int i = 0; i < HELD - 2; i++) {
+    det_pool_put(&pool, held[i]);
+  }
+  teardown();
+}
+
+static volatile int uart_run;
+
+static void *slow_uart(void *arg) {
+  while (uart_run) {
+    detect_result_group_t *group =
+        (detect_result_group_t *)ptr_ring_dequeue(&uart_queue, 10);
+    if (group) {
+      usleep(2000);
+      det_pool_put(&pool, group);
+    }
+  }
+  return NULL;
+}
+
+static void *display(void *arg) {
+  detect_result_group_t *shown = NULL;
+  while (uart_run) {
+    detect_result_group_t *group =
+        (detect_result_group_t *)ptr_ring_dequeue(&info_queue, 10);
+    if (group) {
+      det_pool_put(&pool, shown);
+      shown = group;
+    }
+  }
+  det_pool_put(&pool, shown);
+  return NULL;
+}
+
+static void check_slow_uart(void) {
+  pthread_t uart_tid, disp_tid;
+  int dropped = 0;
+
+  setup();
+  uart_run = 1;
+  pthread_create(&uart_tid, NULL, slow_uart, NULL);
+  pthread_create(&disp_tid, NULL, display, NULL);
+  for (int i = 0; i < POSTS; i++) {
+    dropped += !post();
+    usleep(100);
+  }
+  uart_run = 0;
+  pthread_join(uart_tid, NULL);
+  pthread_join(disp_tid, NULL);
+
+  TEST_CHECK(dropped == 0);
+  teardown();
+}
+
+int main() {
+  check_stalled_consumers();
+  check_slow_uart();
+
+  printf("test_det_pool: %d failures\n", test_failures);
+  return test_failures != 0;
+}
@@ -0,0 +1,154 @@
+#include "postprocess.h"
+#include "rknn_runner.h"
+#include "test_common.h"
+#include "yolo_fixture.h"
+#include "yolo_fixture_record.h"
+
+/*
+ * decoding the npu native NC1HWC2 outputs must find what the NHWC decode
+ * finds, the CPU reference. first post_process alone over several c2 block
+ * sizes, then whole runners on the mock backend replaying the same scene
+ * recorded in either layout, so the attrs reach the workspace too.
+ */
+#define RECORD_NHWC "test_nc1hwc2_nhwc.rec"
+#define RECORD_NC1HWC2 "test_nc1hwc2_native.rec"
+#define LABELS "test_nc1hwc2_labels.txt"
+#define RUNNER_C2 16
+
+static int same_candidates(const post_process_workspace_t *a,
+                           const post_process_workspace_t *b) {
+  return a->filterBoxes == b->filterBoxes && a->objProbs == b->objProbs &&
+         a->classId == b->classId;
+}
+
+static int same_results(const detect_result_group_t *a,
+                        const detect_result_group_t *b) {
+  return a->count == b->count &&
+         memcmp(a->results, b->results,
+                a->count * sizeof(detect_result_t)) == 0;
+}
+
+static void decode(post_process_workspace_t *ws, yolo_fixture_t *fx,
+                   std::vector<int8_t> *inputs, detect_result_group_t *group) {
+  ws->labels = &fx->labels;
+  post_process(inputs[0].data(), inputs[1].data(), inputs[2].data(),
+               fx->model_in, fx->model_in, NMS_THRESH, 1, 1, fx->qnts, ws,
+               group);
+}
+
+static void check_decode(int class_num, int c2) {
+  yolo_fixture_t fx;
+  detect_result_group_t reference, native;
+  std::vector<int8_t> inputs[YOLO_FIXTURE_BRANCHES];
+
+  yolo_fixture_init(&fx, 640, class_num, 0.02f, 3);
+  yolo_fixture_add_objects(&fx, 10, 3);
+  for (int b = 0; b < YOLO_FIXTURE_BRANCHES; b++) {
+    inputs[b] = yolo_fixture_nc1hwc2(&fx, b, c2);
+  }
+
+  post_process_workspace_t *nhwc = post_process_workspace_create(640, 640);
+  decode(nhwc, &fx, fx.nhwc, &reference);
+  TEST_CHECK(reference.count > 0);
+
+  post_process_workspace_t *ws = post_process_workspace_create(640, 640);
+  ws->layout = POST_LAYOUT_NC1HWC2;
+  ws->c2 = c2;
+  decode(ws, &fx, inputs, &native);
+
+  int same = same_candidates(nhwc, ws) && same_results(&reference, &native);
+  if (!same) {
+    printf("%d classes, c2 %d: NC1HWC2 decode differs from NHWC\n",
+           class_num, c2);
+  }
+  TEST_CHECK(same);
+
+  post_process_workspace_destroy(ws);
+  post_process_workspace_destroy(nhwc);
+}
+
+static detect_result_group_t runner_group;
+
+static void runner_post(void *arg) {
+  rknn_runner_io_t *io = (rknn_runner_io_t *)arg;
+  rknn_runner_t *runner = io->runner;
+
+  post_process((int8_t *)io->output_mems[0]->virt_addr,
+               (int8_t *)io->output_mems[1]->virt_addr,
+               (int8_t *)io->output_mems[2]->virt_addr,
+               runner->input_attrs[0].dims[1], runner->input_attrs[0].dims[2],
+               NMS_THRESH, 1, 1, runner->output_qnts, runner->post_ws,
+               &runner_group);
+}
+
+static int run_recording(const char *path, rknn_tensor_format output_fmt,
+                         int layout, detect_result_group_t *group) {
+  rknn_runner_t *runner =
+      rknn_runner_create((char *)path, RKNN_TENSOR_UINT8, RKNN_TENSOR_NHWC,
+                         output_fmt, runner_post);
+  if (!runner) {
+    return -1;
+  }
+
+  int ret = -1;
+  if (runner->post_ws->layout == layout &&
+      (layout != POST_LAYOUT_NC1HWC2 || runner->post_ws->c2 == RUNNER_C2) &&
+      rknn_runner_load_labels(runner, LABELS) == 0 &&
+      rknn_runner_process(runner, NULL) == 0) {
+    *group = runner_group;
+    ret = 0;
+  }
+  rknn_runner_destroy(runner);
+
+  return ret;
+}
+
+static void check_runner(int class_num) {
+  yolo_fixture_t fx;
+  detect_result_group_t reference, native;
+
+  yolo_fixture_init(&fx, 640, class_num, 0.02f, 5);
+  yolo_fixture_add_objects(&fx, 10, 5);
+
+  TEST_CHECK(yolo_fixture_write_labels(LABELS, class_num) == 0);
+  TEST_CHECK(yolo_fixture_record(RECORD_NHWC, &fx, 0) == 0);
+  TEST_CHECK(yolo_fixture_record(RECORD_NC1HWC2, &fx, RUNNER_C2) == 0);
+  int nhwc_ret = run_recording(RECORD_NHWC, RKNN_TENSOR_NHWC,
+                               POST_LAYOUT_NHWC, &reference);
+  int native_ret = run_recording(RECORD_NC1HWC2, RKNN_TENSOR_NC1HWC2,
+                                 POST_LAYOUT_NC1HWC2, &native);
+  TEST_CHECK(nhwc_ret == 0 && native_ret == 0);
+  if (nhwc_ret == 0 && native_ret == 0) {
+    if (!same_results(&reference, &native)) {
+      printf("%d classes: native runner differs from NHWC runner\n",
+             class_num);
+    }
+    TEST_CHECK(reference.count > 0);
+    TEST_CHECK(same_results(&reference, &native));
+  }
+
+  remove(RECORD_NHWC);
+  remove(RECORD_NC1HWC2);
+  remove(LABELS);
+}
+
+int main() {
+  const int class_nums[] = {80, 1, 7};
+  const int c2s[] = {4, 8, 16, 32};
+
+  for (int i = 0; i < 3; i++) {
+    for (int j = 0; j < 4; j++) {
+      check_decode(class_nums[i], c2s[j]);
+    }
+  }
+
+  infer_backend_select("mock");
+  infer_backend_mock_set_latency(0);
+  for (int i = 0; i < 3; i++) {
+    check_runner(class_nums[i]);
+  }
+  label_table_cleanup();
+
+  printf("test_nc1hwc2: %d failures\n", test_failures);
+  return test_failures != 0;
+}
@@ -0,0 +1,282 @@
+#include "postprocess.h"
+#include "test_common.h"
+#include "yolo_fixture.h"
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+/*
+ * the top K engine against a plain greedy class aware nms over the same
+ * candidates, and against the legacy nms() where that one is well defined:
+ * one class (it compares class ids by rank) and no tied scores (its
+ * quicksort orders ties at random). the spatial grid engines must keep
+ * exactly the top K engine's set, class aware and agnostic, on dense scenes
+ * full of boxes across the 64 px cell borders and larger than a cell.
+ */
+
+// same math as postprocess.cc
+static float CalculateOverlap(float xmin0, float ymin0, float xmax0,
+                              float ymax0, float xmin1, float ymin1,
+                              float xmax1, float ymax1) {
+  float w = fmax(0.f, fmin(xmax0, xmax1) - fmax(xmin0, xmin1) + 1.0);
+  float h = fmax(0.f, fmin(ymax0, ymax1) - fmax(ymin0, ymin1) + 1.0);
+  float i = w * h;
+  float u = (xmax0 - xmin0 + 1.0) * (ymax0 - ymin0 + 1.0) +
+            (xmax1 - xmin1 + 1.0) * (ymax1 - ymin1 + 1.0) - i;
+  return u <= 0.f ? 0.f : (i / u);
+}
+
+static int clamp_coord(float val, int max) {
+  return val > 0 ? (val < max ? val : max) : 0;
+}
+
+/* best score first, lower candidate index first on ties */
+static void reference_nms(const post_process_workspace_t *ws, int model_in,
+                          float threshold, detect_result_group_t *group) {
+  const std::vector<float> &boxes = ws->filterBoxes;
+  const std::vector<float> &probs = ws->objProbs;
+  const std::vector<int> &classId = ws->classId;
+  std::vector<int> order(probs.size());
+
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&probs](int a, int b) { return probs[a] > probs[b]; });
+  // candidates past the top K are never looked at
+  if (order.size() > 1024) {
+    order.resize(1024);
+  }
+
+  std::vector<char> removed(order.size(), 0);
+  memset(group, 0, sizeof(detect_result_group_t));
+  for (size_t i = 0; i < order.size(); i++) {
+    if (removed[i]) {
+      continue;
+    }
+    int n = order[i];
+    float x1 = boxes[n * 4 + 0];
+    float y1 = boxes[n * 4 + 1];
+    float x2 = x1 + boxes[n * 4 + 2];
+    float y2 = y1 + boxes[n * 4 + 3];
+    for (size_t j = i + 1; j < order.size(); j++) {
+      int m = order[j];
+      if (removed[j] || classId[m] != classId[n]) {
+        continue;
+      }
+      float iou = CalculateOverlap(
+          x1, y1, x2, y2, boxes[m * 4 + 0], boxes[m * 4 + 1],
+          boxes[m * 4 + 0] + boxes[m * 4 + 2],
+          boxes[m * 4 + 1] + boxes[m * 4 + 3]);
+      if (iou > threshold) {
+        removed[j] = 1;
+      }
+    }
+
+    if (group->count < OBJ_NUMB_MAX_SIZE) {
+      detect_result_t *res = &group->results[group->count++];
+      res->box.left = clamp_coord(x1, model_in);
+      res->box.top = clamp_coord(y1, model_in);
+      res->box.right = clamp_coord(x2, model_in);
+      res->box.bottom = clamp_coord(y2, model_in);
+      res->prop = probs[n];
+      res->class_id = classId[n];
+    }
+  }
+}
+
+static int group_equal(const detect_result_group_t *a,
+                       const detect_result_group_t *b) {
+  if (a->count != b->count) {
+    return 0;
+  }
+  for (int i = 0; i < a->count; i++) {
+    const detect_result_t *x = &a->results[i];
+    const detect_result_t *y = &b->results[i];
+    if (x->class_id != y->class_id || x->prop != y->prop ||
+        x->box.left != y->box.left || x->box.top != y->box.top ||
+        x->box.right != y->box.right || x->box.bottom != y->box.bottom) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int has_tied_scores(const post_process_workspace_t *ws) {
+  std::vector<float> probs(ws->objProbs);
+  std::sort(probs.begin(), probs.end());
+  return std::adjacent_find(probs.begin(), probs.end()) != probs.end();
+}
+
+static void run(yolo_fixture_t *fx, post_process_workspace_t *ws,
+                nms_method_e method, detect_result_group_t *group) {
+  post_process_set_nms_method(method);
+  post_process(fx->nhwc[0].data(), fx->nhwc[1].data(), fx->nhwc[2].data(),
+               fx->model_in, fx->model_in, NMS_THRESH, 1, 1, fx->qnts, ws,
+               group);
+}
+
+static void check_topk(int class_num, float busy, unsigned int seed) {
+  yolo_fixture_t fx;
+  detect_result_group_t topk, reference;
+
+  yolo_fixture_init(&fx, 640, class_num, busy, seed);
+  yolo_fixture_add_objects(&fx, 20, seed);
+  post_process_workspace_t *ws = post_process_workspace_create(640, 640);
+  ws->labels = &fx.labels;
+
+  run(&fx, ws, NMS_METHOD_TOPK_BATCHED, &topk);
+  reference_nms(ws, 640, NMS_THRESH, &reference);
+  if (!group_equal(&topk, &reference)) {
+    printf("%d classes, busy %g, seed %u: top K differs from reference\n",
+           class_num, busy, seed);
+  }
+  TEST_CHECK(group_equal(&topk, &reference));
+  TEST_CHECK(topk.count > 0);
+
+  post_process_workspace_destroy(ws);
+}
+
+/* the top K order after nms, -1 for suppressed, as the engines leave it */
+static std::vector<int> reference_kept(const post_process_workspace_t *ws,
+                                       float threshold, int class_agnostic) {
+  const std::vector<float> &boxes = ws->filterBoxes;
+  const std::vector<float> &probs = ws->objProbs;
+  const std::vector<int> &classId = ws->classId;
+  std::vector<int> order(probs.size());
+
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&probs](int a, int b) { return probs[a] > probs[b]; });
+  if (order.size() > 1024) {
+    order.resize(1024);
+  }
+
+  for (size_t i = 0; i < order.size(); i++) {
+    int n = order[i];
+    if (n < 0) {
+      continue;
+    }
+    for (size_t j = i + 1; j < order.size(); j++) {
+      int m = order[j];
+      if (m < 0 || (!class_agnostic && classId[m] != classId[n])) {
+        continue;
+      }
+      float iou = CalculateOverlap(
+          boxes[n * 4 + 0], boxes[n * 4 + 1],
+          boxes[n * 4 + 0] + boxes[n * 4 + 2],
+          boxes[n * 4 + 1] + boxes[n * 4 + 3], boxes[m * 4 + 0],
+          boxes[m * 4 + 1], boxes[m * 4 + 0] + boxes[m * 4 + 2],
+          boxes[m * 4 + 1] + boxes[m * 4 + 3]);
+      if (iou > threshold) {
+        order[j] = -1;
+      }
+    }
+  }
+  return order;
+}
+
+static int cell_of(float v) { return (int)floorf(v) / 64; }
+
+static void check_grid(int class_num, float busy, unsigned int seed,
+                       int *straddling, int *large) {
+  yolo_fixture_t fx;
+  detect_result_group_t group;
+
+  yolo_fixture_init(&fx, 640, class_num, busy, seed);
+  yolo_fixture_add_objects(&fx, 20, seed);
+  post_process_workspace_t *ws = post_process_workspace_create(640, 640);
+  ws->labels = &fx.labels;
+
+  run(&fx, ws, NMS_METHOD_TOPK_BATCHED, &group);
+  std::vector<int> topk(ws->indexArray);
+  run(&fx, ws, NMS_METHOD_SPATIAL_GRID, &group);
+  std::vector<int> grid(ws->indexArray);
+  run(&fx, ws, NMS_METHOD_SPATIAL_GRID_AGNOSTIC, &group);
+  std::vector<int> agnostic(ws->indexArray);
+
+  // one class makes the agnostic set the class aware one
+  std::vector<int> agnostic_ref =
+      class_num == 1 ? topk : reference_kept(ws, NMS_THRESH, 1);
+  if (grid != topk || agnostic != agnostic_ref) {
+    printf("%d classes, busy %g, seed %u: grid %s, agnostic grid %s\n",
+           class_num, busy, seed, grid == topk ? "same" : "differs",
+           agnostic == agnostic_ref ? "same" : "differs");
+  }
+  TEST_CHECK(grid == topk);
+  TEST_CHECK(agnostic == agnostic_ref);
+
+  // boxes kept by either engine, xmax + 1 as in the overlap
+  for (size_t i = 0; i < ws->indexArray.size(); i++) {
+    int n = agnostic[i] >= 0 ? agnostic[i] : topk[i];
+    if (n < 0) {
+      continue;
+    }
+    const float *box = &ws->filterBoxes[n * 4];
+    *straddling += cell_of(box[0]) != cell_of(box[0] + box[2] + 1) ||
+                   cell_of(box[1]) != cell_of(box[1] + box[3] + 1);
+    *large += box[2] > 64 || box[3] > 64;
+  }
+
+  post_process_workspace_destroy(ws);
+}
+
+/* returns 1 if the scene was tie free and got compared */
+static int check_legacy(float busy, unsigned int seed) {
+  yolo_fixture_t fx;
+  detect_result_group_t topk, legacy;
+  int compared = 0;
+
+  yolo_fixture_init(&fx, 640, 1, busy, seed);
+  yolo_fixture_add_objects(&fx, 3, seed);
+  post_process_workspace_t *ws = post_process_workspace_create(640, 640);
+  ws->labels = &fx.labels;
+
+  run(&fx, ws, NMS_METHOD_LEGACY, &legacy);
+  if (!has_tied_scores(ws) && ws->objProbs.size() <= 1024) {
+    run(&fx, ws, NMS_METHOD_TOPK_BATCHED, &topk);
+    if (!group_equal(&topk, &legacy)) {
+      printf("busy %g, seed %u: top K differs from legacy\n", busy, seed);
+    }
+    TEST_CHECK(group_equal(&topk, &legacy));
+    compared = 1;
+  }
+
+  post_process_workspace_destroy(ws);
+  return compared;
+}
+
+int main() {
+  const float busy[] = {0.0005f, 0.02f, 0.3f};
+
+  for (int i = 0; i < 3; i++) {
+    for (unsigned int seed = 1; seed <= 3; seed++) {
+      check_topk(80, busy[i], seed);
+      check_topk(1, busy[i], seed);
+    }
+  }
+
+  int straddling = 0, large = 0;
+  for (int i = 1; i < 3; i++) {
+    for (unsigned int seed = 1; seed <= 3; seed++) {
+      check_grid(80, busy[i], seed, &straddling, &large);
+      check_grid(1, busy[i], seed, &straddling, &large);
+    }
+  }
+  TEST_CHECK(straddling > 1000);
+  TEST_CHECK(large > 1000);
+
+  int compared = 0;
+  for (unsigned int seed = 1; seed < 1000 && compared < 20; seed++) {
+    compared += check_legacy(0.0005f, seed);
+  }
+  TEST_CHECK(compared == 20);
+
+  post_process_set_nms_method(NMS_METHOD_TOPK_BATCHED);
+  printf("test_nms: %d legacy scenes compared, %d boxes across cells, %d "
+         "larger than a cell, %d failures\n",
+         compared, straddling, large, test_failures);
+  return test_failures != 0;
+}
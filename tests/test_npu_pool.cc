@@ -0,0 +1,451 @@
+#include "infer_backend.h"
+#include "npu_pool.h"
+#include "rknn_runner.h"
+#include "test_common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * npu_pool on stub contexts of random latency: every submitted frame posts
+ * exactly once and in submit order, whichever slot finishes first. failed
+ * runs are counted instead of posted, canceled slots never run, and after
+ * a drain every slot is idle again. with every slot taken an acquire sleeps
+ * out its timeout. then a runner pool on the mock backend, with runs queued
+ * asynchronously and not: every io set gets whole frames, and queued runs
+ * keep the npu busy between frames. the mock binds outputs by index, and
+ * rejects a mem that does not match the recording or a run with one unbound.
+ * a pool that fails to build hands the parent back on its old cores. with
+ * io memory allocated outside, every cpu access to it is started and ended
+ * exactly once. two pools posting side by side report on windows of their
+ * own.
+ */
+#define FRAMES 400
+
+typedef struct {
+  unsigned long frame;
+  unsigned int seed;
+} stub_ctx_t;
+
+static unsigned long posted;
+static unsigned long next_frame;
+static int out_of_order;
+
+static int failing(unsigned long frame) { return frame % 37 == 5; }
+
+static int stub_run(void *ctx) {
+  stub_ctx_t *stub = (stub_ctx_t *)ctx;
+  usleep(rand_r(&stub->seed) % 2000);
+  return failing(stub->frame) ? -1 : 0;
+}
+
+// the post thread is the only one touching the counters
+static void stub_post(void *ctx) {
+  stub_ctx_t *stub = (stub_ctx_t *)ctx;
+
+  // frames before it either posted or failed
+  while (next_frame < stub->frame && failing(next_frame)) {
+    next_frame++;
+  }
+  if (stub->frame != next_frame) {
+    out_of_order++;
+  }
+  next_frame = stub->frame + 1;
+  posted++;
+}
+
+static void check_pool(int num) {
+  stub_ctx_t stubs[NPU_POOL_MAX];
+  void *ctxs[NPU_POOL_MAX];
+  npu_pool_t pool;
+  unsigned long failed = 0;
+
+  for (int i = 0; i < num; i++) {
+    stubs[i].frame = 0;
+    stubs[i].seed = i + 1;
+    ctxs[i] = &stubs[i];
+  }
+  posted = 0;
+  next_frame = 0;
+  out_of_order = 0;
+  TEST_CHECK(npu_pool_init(&pool, ctxs, num, stub_run, stub_post) == 0);
+
+  for (unsigned long frame = 0; frame < FRAMES; frame++) {
+    int slot = npu_pool_acquire(&pool, 1000);
+    TEST_CHECK(slot >= 0);
+    if (slot < 0) {
+      break;
+    }
+    // a dropped frame gives its slot back, the next one takes it
+    if (frame % 50 == 7) {
+      npu_pool_cancel(&pool, slot);
+      slot = npu_pool_acquire(&pool, 1000);
+      TEST_CHECK(slot >= 0);
+      if (slot < 0) {
+        break;
+      }
+    }
+    ((stub_ctx_t *)npu_pool_ctx(&pool, slot))->frame = frame;
+    npu_pool_submit(&pool, slot);
+    failed += failing(frame);
+  }
+  npu_pool_drain(&pool);
+
+  if (posted + failed != FRAMES || out_of_order) {
+    printf("%d slots: %lu posted, %lu failed, %d out of order\n", num, posted,
+           pool.failed, out_of_order);
+  }
+  TEST_CHECK(posted == FRAMES - failed);
+  TEST_CHECK(pool.failed == failed);
+  TEST_CHECK(out_of_order == 0);
+
+  // no slot leaked, all are idle and the next one comes without waiting
+  for (int i = 0; i < num; i++) {
+    TEST_CHECK(pool.slots[i].state == NPU_SLOT_IDLE);
+  }
+  int slot = npu_pool_acquire(&pool, 0);
+  TEST_CHECK(slot >= 0);
+  if (slot >= 0) {
+    npu_pool_cancel(&pool, slot);
+  }
+
+  npu_pool_cleanup(&pool);
+}
+
+static void check_timeout(void) {
+  stub_ctx_t stub = {0, 1};
+  void *ctx = &stub;
+  npu_pool_t pool;
+
+  TEST_CHECK(npu_pool_init(&pool, &ctx, 1, stub_run, stub_post) == 0);
+  int slot = npu_pool_acquire(&pool, 0);
+  TEST_CHECK(slot == 0);
+
+  // the deadline is on the condvar clock, a mismatch returns early or late
+  long long start = test_now_us();
+  TEST_CHECK(npu_pool_acquire(&pool, 50) == -1);
+  long long us = test_now_us() - start;
+  if (us < 50000 || us > 500000) {
+    printf("acquire timed out after %lld us, not 50 ms\n", us);
+  }
+  TEST_CHECK(us >= 50000 && us < 500000);
+
+  npu_pool_cancel(&pool, slot);
+  npu_pool_cleanup(&pool);
+}
+
+#define ASYNC_RECORD "test_npu_pool.rec"
+#define ASYNC_RECORD_FRAMES 5
+#define ASYNC_OUTPUTS 2
+#define ASYNC_OUTPUT_SIZE 256
+#define ASYNC_RUN_US 2000
+
+static unsigned long async_posted;
+static int async_torn;
+static int async_seen[ASYNC_RECORD_FRAMES];
+
+/* recorded frame n fills every output byte with n */
+static int async_record(void) {
+  rknn_tensor_attr input_attr, output_attrs[ASYNC_OUTPUTS];
+  rknn_tensor_mem mems[ASYNC_OUTPUTS];
+  rknn_tensor_mem *mem_ptrs[ASYNC_OUTPUTS];
+  uint8_t data[ASYNC_OUTPUTS][ASYNC_OUTPUT_SIZE];
+
+  memset(&input_attr, 0, sizeof(input_attr));
+  input_attr.n_dims = 4;
+  input_attr.dims[0] = 1;
+  input_attr.dims[1] = 32;
+  input_attr.dims[2] = 32;
+  input_attr.dims[3] = 3;
+  input_attr.n_elems = 32 * 32 * 3;
+  input_attr.size = input_attr.size_with_stride = input_attr.n_elems;
+  input_attr.w_stride = 32;
+  input_attr.fmt = RKNN_TENSOR_NHWC;
+  input_attr.type = RKNN_TENSOR_UINT8;
+  memset(output_attrs, 0, sizeof(output_attrs));
+  for (int i = 0; i < ASYNC_OUTPUTS; i++) {
+    rknn_tensor_attr *attr = &output_attrs[i];
+    attr->index = i;
+    attr->n_dims = 4;
+    attr->dims[0] = 1;
+    attr->dims[1] = 4;
+    attr->dims[2] = 4;
+    attr->dims[3] = ASYNC_OUTPUT_SIZE / 16;
+    attr->n_elems = attr->size = attr->size_with_stride = ASYNC_OUTPUT_SIZE;
+    attr->fmt = RKNN_TENSOR_NHWC;
+    attr->type = RKNN_TENSOR_INT8;
+    attr->scale = 1;
+    snprintf(attr->name, sizeof(attr->name), "output%d", i);
+    memset(&mems[i], 0, sizeof(rknn_tensor_mem));
+    mems[i].virt_addr = data[i];
+    mems[i].size = ASYNC_OUTPUT_SIZE;
+    mem_ptrs[i] = &mems[i];
+  }
+
+  FILE *fp = infer_backend_mock_record_open(ASYNC_RECORD, 1, &input_attr,
+                                            ASYNC_OUTPUTS, output_attrs);
+  if (!fp) {
+    return -1;
+  }
+  for (int n = 0; n < ASYNC_RECORD_FRAMES; n++) {
+    memset(data, n, sizeof(data));
+    infer_backend_mock_record_frame(fp, ASYNC_OUTPUTS, output_attrs, mem_ptrs);
+  }
+  fclose(fp);
+
+  return 0;
+}
+
+// called in frame order from the post thread of the pool
+static void async_post(void *arg) {
+  rknn_runner_io_t *io = (rknn_runner_io_t *)arg;
+  uint8_t first = *(uint8_t *)io->output_mems[0]->virt_addr;
+
+  // outputs of another run landing in these mems would mix two frames
+  for (int i = 0; i < ASYNC_OUTPUTS; i++) {
+    uint8_t *out = (uint8_t *)io->output_mems[i]->virt_addr;
+    for (int j = 0; j < ASYNC_OUTPUT_SIZE; j++) {
+      async_torn += out[j] != first;
+    }
+  }
+  if (first < ASYNC_RECORD_FRAMES) {
+    async_seen[first]++;
+  }
+  async_torn += io->frame != async_posted;
+  async_posted++;
+}
+
+static void check_runner_pool(int async, int io_depth) {
+  rknn_runner_set_async(async);
+  rknn_runner_t *parent = rknn_runner_create((char *)ASYNC_RECORD, async_post);
+  TEST_CHECK(parent != NULL);
+  if (!parent) {
+    return;
+  }
+  TEST_CHECK(parent->async == async);
+  rknn_runner_pool_t *pool = rknn_runner_pool_create(parent, 1, io_depth);
+  TEST_CHECK(pool != NULL);
+  if (!pool) {
+    rknn_runner_destroy(parent);
+    return;
+  }
+
+  async_posted = 0;
+  async_torn = 0;
+  memset(async_seen, 0, sizeof(async_seen));
+  rknn_runner_pool_duty_cycle(pool);
+  for (unsigned long frame = 0; frame < FRAMES; frame++) {
+    int slot = npu_pool_acquire(&pool->npu, 1000);
+    TEST_CHECK(slot >= 0);
+    if (slot < 0) {
+      break;
+    }
+    ((rknn_runner_io_t *)npu_pool_ctx(&pool->npu, slot))->frame = frame;
+    npu_pool_submit(&pool->npu, slot);
+  }
+  npu_pool_drain(&pool->npu);
+  float duty = rknn_runner_pool_duty_cycle(pool);
+
+  TEST_CHECK(async_posted == FRAMES);
+  TEST_CHECK(pool->npu.failed == 0);
+  TEST_CHECK(async_torn == 0);
+  // the mock replays its frames in submit order, each as often
+  for (int n = 0; n < ASYNC_RECORD_FRAMES; n++) {
+    TEST_CHECK(async_seen[n] == FRAMES / ASYNC_RECORD_FRAMES);
+  }
+  // a producer that never waits keeps a queued run behind the current one
+  if (async && io_depth > 1 && duty < 0.9f) {
+    printf("async runner pool at depth %d: npu duty %.0f%%\n", io_depth,
+           duty * 100);
+    TEST_CHECK(duty >= 0.9f);
+  }
+  TEST_CHECK(duty <= 1.05f);
+
+  rknn_runner_pool_destroy(pool);
+  rknn_runner_set_async(0);
+}
+
+#define REPORT_FRAMES 10
+
+static rknn_runner_pool_t *report_pools[2];
+static int report_num[2];
+static int report_bad[2];
+
+// each pool calls from its own post thread, its counters are its own
+static void report_post(void *arg) {
+  rknn_runner_io_t *io = (rknn_runner_io_t *)arg;
+  rknn_runner_pool_t *pool = io->runner->pool;
+  rknn_runner_pool_report_t report;
+  int p = pool == report_pools[1];
+
+  if (rknn_runner_pool_report(pool, 100 + p, REPORT_FRAMES, &report)) {
+    report_num[p]++;
+    report_bad[p] += report.fps <= 0 || report.duty <= 0 ||
+                     report.duty > 1.05f || report.post_us_avg != 100 + p ||
+                     report.post_us_max != 100 + p;
+  }
+}
+
+static void check_pool_reports(void) {
+  for (int p = 0; p < 2; p++) {
+    rknn_runner_t *parent =
+        rknn_runner_create((char *)ASYNC_RECORD, report_post);
+    TEST_CHECK(parent != NULL);
+    report_pools[p] = parent ? rknn_runner_pool_create(parent, 1, 2) : NULL;
+    TEST_CHECK(report_pools[p] != NULL);
+    if (!report_pools[p]) {
+      rknn_runner_destroy(parent);
+      rknn_runner_pool_destroy(report_pools[0]);
+      return;
+    }
+    report_num[p] = 0;
+    report_bad[p] = 0;
+  }
+
+  // the first post opens the window, then a report every REPORT_FRAMES
+  for (unsigned long frame = 0; frame <= 4 * REPORT_FRAMES; frame++) {
+    for (int p = 0; p < 2; p++) {
+      npu_pool_t *npu = &report_pools[p]->npu;
+      int slot = npu_pool_acquire(npu, 1000);
+      if (slot < 0) {
+        break;
+      }
+      ((rknn_runner_io_t *)npu_pool_ctx(npu, slot))->frame = frame;
+      npu_pool_submit(npu, slot);
+    }
+  }
+
+  for (int p = 0; p < 2; p++) {
+    npu_pool_drain(&report_pools[p]->npu);
+    TEST_CHECK(report_num[p] == 4);
+    TEST_CHECK(report_bad[p] == 0);
+    rknn_runner_pool_destroy(report_pools[p]);
+  }
+}
+
+static void check_mock_outputs(void) {
+  const infer_backend_t *mock = &infer_backend_mock;
+  rknn_context ctx;
+  rknn_tensor_attr attrs[ASYNC_OUTPUTS];
+  rknn_tensor_mem *mems[ASYNC_OUTPUTS];
+
+  TEST_CHECK(mock->init(&ctx, (void *)ASYNC_RECORD, 0, 0, NULL) == RKNN_SUCC);
+  for (int i = 0; i < ASYNC_OUTPUTS; i++) {
+    memset(&attrs[i], 0, sizeof(rknn_tensor_attr));
+    attrs[i].index = i;
+    TEST_CHECK(mock->query(ctx, RKNN_QUERY_NATIVE_NHWC_OUTPUT_ATTR, &attrs[i],
+                           sizeof(rknn_tensor_attr)) == RKNN_SUCC);
+    mems[i] = mock->create_mem(ctx, attrs[i].size_with_stride);
+  }
+
+  // every output unbound, then only the first
+  TEST_CHECK(mock->run(ctx) == RKNN_ERR_OUTPUT_INVALID);
+  // a model of other output names still gets output n of the recording
+  snprintf(attrs[0].name, sizeof(attrs[0].name), "renamed");
+  TEST_CHECK(mock->set_io_mem(ctx, mems[0], &attrs[0]) == RKNN_SUCC);
+  TEST_CHECK(mock->run(ctx) == RKNN_ERR_OUTPUT_INVALID);
+
+  // size, type and mem size must match the recording
+  rknn_tensor_attr wrong = attrs[1];
+  wrong.size_with_stride /= 2;
+  TEST_CHECK(mock->set_io_mem(ctx, mems[1], &wrong) == RKNN_ERR_PARAM_INVALID);
+  wrong = attrs[1];
+  wrong.type = RKNN_TENSOR_FLOAT16;
+  TEST_CHECK(mock->set_io_mem(ctx, mems[1], &wrong) == RKNN_ERR_PARAM_INVALID);
+  TEST_CHECK(mock->set_io_mem(ctx, mems[0], &attrs[1]) == RKNN_SUCC);
+  rknn_tensor_mem *small = mock->create_mem(ctx, ASYNC_OUTPUT_SIZE / 2);
+  TEST_CHECK(mock->set_io_mem(ctx, small, &attrs[1]) == RKNN_ERR_PARAM_INVALID);
+  wrong = attrs[1];
+  wrong.index = ASYNC_OUTPUTS;
+  TEST_CHECK(mock->set_io_mem(ctx, mems[1], &wrong) == RKNN_ERR_PARAM_INVALID);
+
+  // recorded frame 0 is all zeros, 1 all ones
+  TEST_CHECK(mock->set_io_mem(ctx, mems[1], &attrs[1]) == RKNN_SUCC);
+  TEST_CHECK(mock->run(ctx) == RKNN_SUCC);
+  TEST_CHECK(mock->run(ctx) == RKNN_SUCC);
+  for (int i = 0; i < ASYNC_OUTPUTS; i++) {
+    TEST_CHECK(((uint8_t *)mems[i]->virt_addr)[ASYNC_OUTPUT_SIZE - 1] == 1);
+    mock->destroy_mem(ctx, mems[i]);
+  }
+  mock->destroy_mem(ctx, small);
+  mock->destroy(ctx);
+}
+
+// from dma_stub.cc
+int dma_stub_unpaired(void);
+int dma_stub_open(void);
+
+static void check_outside_sync(void) {
+  rknn_runner_set_mem_outside(1);
+  rknn_runner_t *parent = rknn_runner_create((char *)ASYNC_RECORD, async_post);
+  rknn_runner_set_mem_outside(0);
+  TEST_CHECK(parent != NULL);
+  if (!parent) {
+    return;
+  }
+  TEST_CHECK(parent->io[0].output_bufs != NULL);
+  uint8_t input[32 * 32 * 3] = {0};
+  TEST_CHECK(rknn_runner_process(parent, input) == 0);
+
+  rknn_runner_pool_t *pool = rknn_runner_pool_create(parent, 2, 2);
+  TEST_CHECK(pool != NULL);
+  if (!pool) {
+    rknn_runner_destroy(parent);
+    return;
+  }
+  async_posted = 0;
+  for (unsigned long frame = 0; frame < 40; frame++) {
+    int slot = npu_pool_acquire(&pool->npu, 1000);
+    if (slot < 0) {
+      break;
+    }
+    ((rknn_runner_io_t *)npu_pool_ctx(&pool->npu, slot))->frame = frame;
+    npu_pool_submit(&pool->npu, slot);
+  }
+  npu_pool_drain(&pool->npu);
+
+  TEST_CHECK(async_posted == 40);
+  TEST_CHECK(dma_stub_unpaired() == 0);
+  TEST_CHECK(dma_stub_open() == 0);
+  rknn_runner_pool_destroy(pool);
+}
+
+static void check_pool_failure(void) {
+  rknn_runner_t *parent = rknn_runner_create((char *)ASYNC_RECORD, async_post);
+  TEST_CHECK(parent != NULL);
+  if (!parent) {
+    return;
+  }
+  TEST_CHECK(rknn_runner_set_core_mask(parent, RKNN_NPU_CORE_2) == 0);
+
+  // pinned to core 0 for the pool, then the io depth is out of range
+  TEST_CHECK(rknn_runner_pool_create(parent, 2, RKNN_RUNNER_IO_MAX + 1) ==
+             NULL);
+  TEST_CHECK(parent->pool == NULL);
+  TEST_CHECK(parent->core_mask == RKNN_NPU_CORE_2);
+
+  rknn_runner_destroy(parent);
+}
+
+int main() {
+  check_pool(1);
+  check_pool(3);
+  check_pool(NPU_POOL_MAX);
+  check_timeout();
+
+  infer_backend_select("mock");
+  infer_backend_mock_set_latency(ASYNC_RUN_US);
+  TEST_CHECK(async_record() == 0);
+  check_runner_pool(0, 2);
+  check_runner_pool(1, 1);
+  check_runner_pool(1, 2);
+  check_runner_pool(1, 3);
+  check_mock_outputs();
+  check_pool_failure();
+  check_outside_sync();
+  check_pool_reports();
+  remove(ASYNC_RECORD);
+
+  printf("test_npu_pool: %d failures\n", test_failures);
+  return test_failures != 0;
+}
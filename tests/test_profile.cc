@@ -0,0 +1,79 @@
+#include "rknn_profile.h"
+#include "test_common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * the profile csv rotates past max_bytes. when the file cannot be opened
+ * again after the rename, frames go on with the percentiles only and close
+ * still prints them. on a run longer than the samples kept, the
+ * percentiles still cover all of it.
+ */
+static int profile_query(rknn_context ctx, rknn_query_cmd cmd, void *info,
+                         uint32_t size) {
+  if (cmd != RKNN_QUERY_PERF_RUN) {
+    return RKNN_ERR_PARAM_INVALID;
+  }
+  ((rknn_perf_run *)info)->run_duration = 1000;
+  return RKNN_SUCC;
+}
+
+static void check_rotate_failure(void) {
+  infer_backend_t backend;
+  char dir[] = "/tmp/test_profile.XXXXXX";
+  char path[64], old_path[80];
+
+  memset(&backend, 0, sizeof(backend));
+  backend.query = profile_query;
+  TEST_CHECK(mkdtemp(dir) != NULL);
+  snprintf(path, sizeof(path), "%s/profile.csv", dir);
+  snprintf(old_path, sizeof(old_path), "%s.1", path);
+
+  // every frame is past max_bytes, so every frame rotates
+  TEST_CHECK(rknn_profile_open(path, 0, 1) == 0);
+  rknn_profile_frame(&backend, 0, 1200);
+  TEST_CHECK(access(path, F_OK) == 0);
+  TEST_CHECK(access(old_path, F_OK) == 0);
+
+  // the rotation after this frame finds no directory to open the file in
+  unlink(path);
+  unlink(old_path);
+  TEST_CHECK(rmdir(dir) == 0);
+  for (int i = 0; i < 10; i++) {
+    rknn_profile_frame(&backend, 0, 1200);
+  }
+  TEST_CHECK(rknn_profile_enabled());
+  TEST_CHECK(access(path, F_OK) != 0);
+  rknn_profile_close();
+  TEST_CHECK(!rknn_profile_enabled());
+}
+
+static void check_long_run(void) {
+  infer_backend_t backend;
+
+  memset(&backend, 0, sizeof(backend));
+  backend.query = profile_query;
+  // ftell stays 0 on /dev/null, nothing rotates
+  TEST_CHECK(rknn_profile_open("/dev/null", 0, 1) == 0);
+  // a quarter of the run fast, then slow, four times the samples kept
+  for (int i = 0; i < 400000; i++) {
+    rknn_profile_frame(&backend, 0, i < 100000 ? 1000 : 3000);
+  }
+  int p10 = rknn_profile_percentile("total (wall)", 10);
+  int p50 = rknn_profile_percentile("total (wall)", 50);
+  TEST_CHECK(p10 == 1000);
+  TEST_CHECK(p50 == 3000);
+  TEST_CHECK(rknn_profile_percentile("total (npu)", 50) == 1000);
+  TEST_CHECK(rknn_profile_percentile("0001:conv", 50) == -1);
+  rknn_profile_close();
+  TEST_CHECK(rknn_profile_percentile("total (wall)", 50) == -1);
+}
+
+int main() {
+  check_rotate_failure();
+  check_long_run();
+
+  printf("test_profile: %d failures\n", test_failures);
+  return test_failures != 0;
+}
@@ -0,0 +1,218 @@
+#include "ptr_ring.h"
+#include "test_common.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <vector>
+
+/*
+ * ptr_ring under contention on a small ring, so both sides keep parking
+ * and waking on the futex words: every item arrives exactly once, in
+ * order per producer when one consumer takes them all, and no round trip
+ * of a ping-pong sleeps until its timeout, which a lost wakeup would. then
+ * the timeouts, the mailbox drops and the hot fields on lines of their own.
+ */
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 50000
+#define ROUND_TRIPS 20000
+
+typedef struct {
+  int producer;
+  int index;
+} ring_item_t;
+
+typedef struct {
+  ptr_ring_t *ring;
+  std::vector<int> *seen;
+  int single; /* one consumer, which also checks the order */
+  int out_of_order;
+  int stalls;
+} ring_stress_t;
+
+static ring_stress_t stress;
+
+static void *stress_produce(void *arg) {
+  std::vector<ring_item_t> *items = (std::vector<ring_item_t> *)arg;
+
+  // a missed wake leaves the producer asleep until close to the timeout
+  for (size_t i = 0; i < items->size(); i++) {
+    long long start = test_now_us();
+    if (ptr_ring_enqueue(stress.ring, &(*items)[i], 1000) != 0 ||
+        test_now_us() - start > 500000) {
+      __atomic_fetch_add(&stress.stalls, 1, __ATOMIC_RELAXED);
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* runs until the ring stays empty for 200 ms after the producers are done */
+static void *stress_consume(void *arg) {
+  int last[PRODUCERS] = {-1, -1, -1, -1};
+  ring_item_t *item;
+
+  while ((item = (ring_item_t *)ptr_ring_dequeue(stress.ring, 200)) != NULL) {
+    __atomic_fetch_add(
+        &(*stress.seen)[item->producer * ITEMS_PER_PRODUCER + item->index], 1,
+        __ATOMIC_RELAXED);
+    if (stress.single && item->index != last[item->producer] + 1) {
+      stress.out_of_order++;
+    }
+    last[item->producer] = item->index;
+  }
+  return NULL;
+}
+
+static void check_stress(int capacity, int consumers) {
+  ptr_ring_t ring;
+  std::vector<ring_item_t> items[PRODUCERS];
+  std::vector<int> seen(PRODUCERS * ITEMS_PER_PRODUCER, 0);
+  pthread_t producer_tids[PRODUCERS];
+  pthread_t consumer_tids[2];
+
+  TEST_CHECK(ptr_ring_init(&ring, capacity) == 0);
+  stress.ring = &ring;
+  stress.seen = &seen;
+  stress.single = consumers == 1;
+  stress.out_of_order = 0;
+  stress.stalls = 0;
+  for (int p = 0; p < PRODUCERS; p++) {
+    items[p].resize(ITEMS_PER_PRODUCER);
+    for (int i = 0; i < ITEMS_PER_PRODUCER; i++) {
+      items[p][i].producer = p;
+      items[p][i].index = i;
+    }
+  }
+
+  for (int c = 0; c < consumers; c++) {
+    pthread_create(&consumer_tids[c], NULL, stress_consume, NULL);
+  }
+  for (int p = 0; p < PRODUCERS; p++) {
+    pthread_create(&producer_tids[p], NULL, stress_produce, &items[p]);
+  }
+  for (int p = 0; p < PRODUCERS; p++) {
+    pthread_join(producer_tids[p], NULL);
+  }
+  for (int c = 0; c < consumers; c++) {
+    pthread_join(consumer_tids[c], NULL);
+  }
+
+  int wrong = 0;
+  for (size_t i = 0; i < seen.size(); i++) {
+    wrong += seen[i] != 1;
+  }
+  if (wrong || stress.out_of_order || stress.stalls) {
+    printf("capacity %d, %d consumers: %d items not seen once, %d out of "
+           "order, %d producers stalled\n",
+           capacity, consumers, wrong, stress.out_of_order, stress.stalls);
+  }
+  TEST_CHECK(wrong == 0);
+  TEST_CHECK(stress.out_of_order == 0);
+  TEST_CHECK(stress.stalls == 0);
+  ptr_ring_cleanup(&ring);
+}
+
+static ptr_ring_t ping, pong;
+
+static void *pong_thread(void *arg) {
+  for (int i = 0; i < ROUND_TRIPS; i++) {
+    void *msg = ptr_ring_dequeue(&ping, 1000);
+    if (!msg || ptr_ring_enqueue(&pong, msg, 1000) != 0) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+/* one message in flight, the waiting side parks on every round trip */
+static void check_ping_pong(void) {
+  pthread_t tid;
+  int msg;
+  int lost = 0;
+
+  ptr_ring_init(&ping, 2);
+  ptr_ring_init(&pong, 2);
+  pthread_create(&tid, NULL, pong_thread, NULL);
+  // a missed wake shows as a round trip sleeping out the timeout
+  for (int i = 0; i < ROUND_TRIPS && !lost; i++) {
+    long long start = test_now_us();
+    lost = ptr_ring_enqueue(&ping, &msg, 1000) != 0 ||
+           ptr_ring_dequeue(&pong, 1000) != &msg ||
+           test_now_us() - start > 500000;
+  }
+  pthread_join(tid, NULL);
+
+  TEST_CHECK(lost == 0);
+  ptr_ring_cleanup(&ping);
+  ptr_ring_cleanup(&pong);
+}
+
+static void check_timeouts(void) {
+  ptr_ring_t ring;
+  int a, b;
+
+  ptr_ring_init(&ring, 2);
+  long long start = test_now_us();
+  TEST_CHECK(ptr_ring_dequeue(&ring, 50) == NULL);
+  TEST_CHECK(test_now_us() - start >= 50000);
+
+  TEST_CHECK(ptr_ring_enqueue(&ring, &a, 0) == 0);
+  TEST_CHECK(ptr_ring_enqueue(&ring, &b, 0) == 0);
+  start = test_now_us();
+  TEST_CHECK(ptr_ring_enqueue(&ring, &a, 30) == 1);
+  TEST_CHECK(test_now_us() - start >= 30000);
+  TEST_CHECK(ptr_ring_enqueue(&ring, &a, 0) == 1);
+  TEST_CHECK(ptr_ring_dequeue(&ring, 0) == &a);
+  TEST_CHECK(ptr_ring_dequeue(&ring, 0) == &b);
+  ptr_ring_cleanup(&ring);
+}
+
+static int dropped_num;
+
+static void count_drop(void *data) { dropped_num++; }
+
+static void check_mailbox(void) {
+  ptr_ring_t ring;
+  int entries[4];
+
+  // the newest entry wins, the ones it pushed out go through drop
+  ptr_ring_init_mailbox(&ring, 1, count_drop);
+  dropped_num = 0;
+  for (int i = 0; i < 4; i++) {
+    TEST_CHECK(ptr_ring_enqueue(&ring, &entries[i], 0) == 0);
+  }
+  TEST_CHECK(ptr_ring_dequeue(&ring, 0) == &entries[3]);
+  TEST_CHECK(dropped_num == 3);
+
+  // entries still pending at cleanup are dropped too
+  ptr_ring_enqueue(&ring, &entries[0], 0);
+  ptr_ring_cleanup(&ring);
+  TEST_CHECK(dropped_num == 4);
+}
+
+#define RING_LINE(field) (offsetof(ptr_ring_t, field) / PTR_RING_CACHE_LINE)
+
+static void check_layout(void) {
+  size_t lines[] = {RING_LINE(cells),    RING_LINE(tail),
+                    RING_LINE(head),     RING_LINE(not_empty),
+                    RING_LINE(not_full), RING_LINE(dropped)};
+  int n = sizeof(lines) / sizeof(lines[0]);
+
+  for (int i = 0; i < n; i++) {
+    for (int j = i + 1; j < n; j++) {
+      TEST_CHECK(lines[i] != lines[j]);
+    }
+  }
+}
+
+int main() {
+  check_stress(3, 2);
+  check_stress(2, 1);
+  check_ping_pong();
+  check_timeouts();
+  check_mailbox();
+  check_layout();
+
+  printf("test_ptr_ring: %d failures\n", test_failures);
+  return test_failures != 0;
+}
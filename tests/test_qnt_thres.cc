@@ -0,0 +1,112 @@
+#include "postprocess.h"
+#include "test_common.h"
+#include <math.h>
+
+/*
+ * the int8 domain thresholds of qnt_param_init must keep and drop the same
+ * candidates as the float tests they replace, for every pair of int8 inputs
+ */
+typedef struct {
+  int32_t zp;
+  float scale;
+  float threshold;
+} qnt_case_t;
+
+static const qnt_case_t sigmoid_cases[] = {
+    {-128, 1.0f / 255, BOX_THRESH},
+    {-128, 1.0f / 255, 0.5f},
+    {-128, 0.00392157f, 0.45f},
+    {-128, 1.0f / 255, 0.2535f},
+    {-128, 0.0039f, 0.0f},
+    // the score threshold does not fit an int32, nothing may pass
+    {-128, 1e-6f, BOX_THRESH},
+};
+
+// logits, sigmoid applied by the decoder
+static const qnt_case_t logit_cases[] = {
+    {-20, 0.1f, BOX_THRESH},
+    {0, 0.05f, 0.5f},
+    {30, 0.2f, 0.9f},
+};
+
+static double deqnt(int q, const qnt_param_t *qnt) {
+  return (double)(q - qnt->zp) * qnt->scale;
+}
+
+static void check_score(const qnt_case_t *c) {
+  qnt_param_t qnt;
+  int mismatches = 0;
+
+  qnt_param_init(&qnt, c->zp, c->scale, c->threshold);
+  for (int box = -128; box <= 127; box++) {
+    for (int cls = -128; cls <= 127; cls++) {
+      double score = deqnt(box, &qnt) * deqnt(cls, &qnt);
+      // products within rounding of the threshold may go either way
+      if (fabs(score - c->threshold) <= 1e-9 * (c->threshold + 1)) {
+        continue;
+      }
+      int keep = (int32_t)(box - qnt.zp) * (int32_t)(cls - qnt.zp) >
+                 qnt.score_thres_i32;
+      if (keep != (score > c->threshold)) {
+        mismatches++;
+      }
+    }
+  }
+  if (mismatches) {
+    printf("zp %d scale %g threshold %g: %d score mismatches\n", c->zp,
+           c->scale, c->threshold, mismatches);
+  }
+  TEST_CHECK(mismatches == 0);
+}
+
+// class probabilities are at most 1, the box gate may only drop boxes whose
+// score can not pass with any class
+static void check_box_gate(const qnt_case_t *c) {
+  qnt_param_t qnt;
+
+  qnt_param_init(&qnt, c->zp, c->scale, c->threshold);
+  for (int box = -128; box <= 127; box++) {
+    if (deqnt(box, &qnt) > c->threshold) {
+      TEST_CHECK(box >= qnt.box_thres_i8);
+    }
+  }
+}
+
+static void check_prob(const qnt_case_t *c, int activated) {
+  qnt_param_t qnt;
+
+  qnt_param_init(&qnt, c->zp, c->scale, c->threshold);
+  for (int q = -128; q <= 127; q++) {
+    double prob = deqnt(q, &qnt);
+    if (!activated) {
+      prob = 1.0 / (1.0 + exp(-prob));
+    }
+    TEST_CHECK(fabs(qnt.prob_lut[q + 128] - prob) < 1e-5);
+    if (fabs(prob - c->threshold) > 1e-5) {
+      TEST_CHECK((q >= qnt.prob_thres_q) == (prob > c->threshold));
+    }
+  }
+}
+
+int main() {
+  int sigmoid_num = sizeof(sigmoid_cases) / sizeof(sigmoid_cases[0]);
+  int logit_num = sizeof(logit_cases) / sizeof(logit_cases[0]);
+
+  for (int i = 0; i < sigmoid_num; i++) {
+    check_score(&sigmoid_cases[i]);
+    check_box_gate(&sigmoid_cases[i]);
+    check_prob(&sigmoid_cases[i], 1);
+  }
+  for (int i = 0; i < logit_num; i++) {
+    check_score(&logit_cases[i]);
+    check_prob(&logit_cases[i], 0);
+  }
+
+  // an activated tensor never passes a threshold of 1
+  qnt_param_t qnt;
+  qnt_param_init(&qnt, -128, 1.0f / 255, 1.0f);
+  TEST_CHECK(qnt.prob_thres_q == 128);
+
+  printf("test_qnt_thres: %d failures\n", test_failures);
+  return test_failures != 0;
+}
@@ -0,0 +1,55 @@
+#include "postprocess.h"
+#include "test_common.h"
+#include "yolo_fixture.h"
+
+/*
+ * a workspace reserved from the model grid must never grow: realloc_count
+ * stays 0 from an empty scene up to every anchor passing, on one and on
+ * several decode threads and with every nms engine. the legacy one is
+ * quadratic and skips the two busiest scenes.
+ */
+static const float scene_busy[] = {0, 0.001f, 0.05f, 0.001f, 0.5f, 1.0f};
+
+static void check_scenes(int class_num, int threads, nms_method_e method,
+                         int scene_num) {
+  yolo_fixture_t fx;
+  detect_result_group_t group;
+
+  post_process_workspace_t *ws = post_process_workspace_create(640, 640);
+  post_process_workspace_set_threads(ws, threads);
+  post_process_set_nms_method(method);
+  for (int i = 0; i < scene_num; i++) {
+    yolo_fixture_init(&fx, 640, class_num, scene_busy[i], i + 1);
+    yolo_fixture_add_objects(&fx, 10, i + 1);
+    ws->labels = &fx.labels;
+    for (int frame = 0; frame < 3; frame++) {
+      post_process(fx.nhwc[0].data(), fx.nhwc[1].data(), fx.nhwc[2].data(),
+                   640, 640, NMS_THRESH, 1, 1, fx.qnts, ws, &group);
+    }
+  }
+
+  if (ws->realloc_count) {
+    printf("%d classes, %d threads, nms %d: %lu frames grew the workspace\n",
+           class_num, threads, method, ws->realloc_count);
+  }
+  TEST_CHECK(ws->realloc_count == 0);
+  post_process_workspace_destroy(ws);
+}
+
+int main() {
+  int scene_num = sizeof(scene_busy) / sizeof(scene_busy[0]);
+
+  check_scenes(80, 1, NMS_METHOD_TOPK_BATCHED, scene_num);
+  check_scenes(80, 3, NMS_METHOD_TOPK_BATCHED, scene_num);
+  check_scenes(1, 1, NMS_METHOD_TOPK_BATCHED, scene_num);
+  check_scenes(80, 1, NMS_METHOD_LEGACY, 4);
+  check_scenes(1, 3, NMS_METHOD_LEGACY, 4);
+  check_scenes(80, 1, NMS_METHOD_SPATIAL_GRID, scene_num);
+  check_scenes(1, 3, NMS_METHOD_SPATIAL_GRID, scene_num);
+  check_scenes(80, 1, NMS_METHOD_SPATIAL_GRID_AGNOSTIC, scene_num);
+  check_scenes(1, 3, NMS_METHOD_SPATIAL_GRID_AGNOSTIC, scene_num);
+
+  post_process_set_nms_method(NMS_METHOD_TOPK_BATCHED);
+  printf("test_workspace: %d failures\n", test_failures);
+  return test_failures != 0;
+}
@@ -0,0 +1,143 @@
+#ifndef __YOLO_FIXTURE_H__
+#define __YOLO_FIXTURE_H__
+
+#include "postprocess.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define YOLO_FIXTURE_BRANCHES 3
+#define YOLO_FIXTURE_ANCHORS 3
+
+/*
+ * int8 NHWC outputs of a yolov5 head on a square input, quantized like the
+ * sigmoid outputs of the real model (zp -128, scale 1/255). a busy share of
+ * the anchors passes the box confidence gate, the others stay below it.
+ */
+typedef struct {
+  int model_in;
+  int class_num;
+  int grid[YOLO_FIXTURE_BRANCHES];
+  std::vector<int8_t> nhwc[YOLO_FIXTURE_BRANCHES];
+  qnt_param_t qnts[YOLO_FIXTURE_BRANCHES];
+  label_table_t labels;
+} yolo_fixture_t;
+
+static inline int yolo_fixture_channels(const yolo_fixture_t *fx) {
+  return YOLO_FIXTURE_ANCHORS * (fx->class_num + 5);
+}
+
+static void yolo_fixture_init(yolo_fixture_t *fx, int model_in, int class_num,
+                              float busy, unsigned int seed) {
+  fx->model_in = model_in;
+  fx->class_num = class_num;
+  memset(&fx->labels, 0, sizeof(fx->labels));
+  fx->labels.count = class_num;
+
+  int box_size = class_num + 5;
+  int busy_ppm = (int)(busy * 1000000);
+  for (int b = 0; b < YOLO_FIXTURE_BRANCHES; b++) {
+    int grid = model_in / (8 << b);
+    fx->grid[b] = grid;
+    fx->nhwc[b].resize(grid * grid * yolo_fixture_channels(fx));
+    qnt_param_init(&fx->qnts[b], -128, 1.0f / 255, BOX_THRESH);
+
+    for (int i = 0; i < grid * grid * YOLO_FIXTURE_ANCHORS; i++) {
+      int8_t *anchor = &fx->nhwc[b][i * box_size];
+      for (int k = 0; k < box_size; k++) {
+        anchor[k] = (int8_t)(rand_r(&seed) % 256 - 128);
+      }
+      // box confidence above 0.5 or below 0.2
+      if ((int)(rand_r(&seed) % 1000000) < busy_ppm) {
+        anchor[4] = (int8_t)(rand_r(&seed) % 128);
+      } else {
+        anchor[4] = (int8_t)(rand_r(&seed) % 50 - 128);
+      }
+    }
+  }
+}
+
+static int8_t yolo_fixture_jitter(int8_t q, unsigned int *seed) {
+  int v = q + (int)(rand_r(seed) % 7) - 3;
+  return (int8_t)(v < -128 ? -128 : (v > 127 ? 127 : v));
+}
+
+/*
+ * num objects of random classes, each reported by the 3x3 cells around its
+ * center on one branch and by all their anchors, the way a real head sees
+ * one object many times over for nms to reduce
+ */
+static void yolo_fixture_add_objects(yolo_fixture_t *fx, int num,
+                                     unsigned int seed) {
+  int box_size = fx->class_num + 5;
+
+  for (int i = 0; i < num; i++) {
+    int b = rand_r(&seed) % YOLO_FIXTURE_BRANCHES;
+    int grid = fx->grid[b];
+    int center_h = 1 + rand_r(&seed) % (grid - 2);
+    int center_w = 1 + rand_r(&seed) % (grid - 2);
+    int cls = rand_r(&seed) % fx->class_num;
+    int8_t size_q = (int8_t)(rand_r(&seed) % 64);
+
+    for (int dh = -1; dh <= 1; dh++) {
+      for (int dw = -1; dw <= 1; dw++) {
+        int cell = (center_h + dh) * grid + center_w + dw;
+        for (int a = 0; a < YOLO_FIXTURE_ANCHORS; a++) {
+          int8_t *anchor =
+              &fx->nhwc[b][(cell * YOLO_FIXTURE_ANCHORS + a) * box_size];
+          // sigmoid * 2 - 0.5 moves the box of every cell onto the center
+          anchor[0] = yolo_fixture_jitter(dw < 0 ? 127 : (dw ? -128 : 0),
+                                          &seed);
+          anchor[1] = yolo_fixture_jitter(dh < 0 ? 127 : (dh ? -128 : 0),
+                                          &seed);
+          anchor[2] = yolo_fixture_jitter(size_q, &seed);
+          anchor[3] = yolo_fixture_jitter(size_q, &seed);
+          anchor[4] = (int8_t)(64 + rand_r(&seed) % 64);
+          for (int k = 0; k < fx->class_num; k++) {
+            anchor[5 + k] = (int8_t)(rand_r(&seed) % 32 - 128);
+          }
+          anchor[5 + cls] = (int8_t)(64 + rand_r(&seed) % 64);
+        }
+      }
+    }
+  }
+}
+
+/* branch b in NCHW, channel major */
+static std::vector<int8_t> yolo_fixture_nchw(const yolo_fixture_t *fx,
+                                             int b) {
+  int channels = yolo_fixture_channels(fx);
+  int grid_len = fx->grid[b] * fx->grid[b];
+  std::vector<int8_t> out(fx->nhwc[b].size());
+
+  for (int cell = 0; cell < grid_len; cell++) {
+    for (int ch = 0; ch < channels; ch++) {
+      out[ch * grid_len + cell] = fx->nhwc[b][cell * channels + ch];
+    }
+  }
+
+  return out;
+}
+
+/*
+ * branch b in NC1HWC2, blocks of c2 channels per cell. the padding channels
+ * of the last block hold the largest int8, a decoder must never read them.
+ */
+static std::vector<int8_t> yolo_fixture_nc1hwc2(const yolo_fixture_t *fx,
+                                                int b, int c2) {
+  int channels = yolo_fixture_channels(fx);
+  int c1 = (channels + c2 - 1) / c2;
+  int grid_len = fx->grid[b] * fx->grid[b];
+  std::vector<int8_t> out(c1 * grid_len * c2, 127);
+
+  for (int cell = 0; cell < grid_len; cell++) {
+    for (int ch = 0; ch < channels; ch++) {
+      out[((ch / c2) * grid_len + cell) * c2 + ch % c2] =
+          fx->nhwc[b][cell * channels + ch];
+    }
+  }
+
+  return out;
+}
+
+#endif /*__YOLO_FIXTURE_H__*/
@@ -0,0 +1,98 @@
+#ifndef __YOLO_FIXTURE_RECORD_H__
+#define __YOLO_FIXTURE_RECORD_H__
+
+#include "infer_backend.h"
+#include "yolo_fixture.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * one frame of the fixture as a mock backend recording of a uint8 NHWC
+ * input model, replayed by runners created on path. c2 0 records NHWC
+ * outputs, otherwise NC1HWC2 ones in blocks of c2 channels.
+ */
+static int yolo_fixture_record(const char *path, yolo_fixture_t *fx, int c2) {
+  rknn_tensor_attr input_attr, output_attrs[YOLO_FIXTURE_BRANCHES];
+  std::vector<int8_t> outputs[YOLO_FIXTURE_BRANCHES];
+  rknn_tensor_mem mems[YOLO_FIXTURE_BRANCHES];
+  rknn_tensor_mem *mem_ptrs[YOLO_FIXTURE_BRANCHES];
+  int channels = yolo_fixture_channels(fx);
+
+  memset(&input_attr, 0, sizeof(input_attr));
+  input_attr.n_dims = 4;
+  input_attr.dims[0] = 1;
+  input_attr.dims[1] = fx->model_in;
+  input_attr.dims[2] = fx->model_in;
+  input_attr.dims[3] = 3;
+  input_attr.n_elems = fx->model_in * fx->model_in * 3;
+  input_attr.size = input_attr.size_with_stride = input_attr.n_elems;
+  input_attr.w_stride = fx->model_in;
+  input_attr.fmt = RKNN_TENSOR_NHWC;
+  input_attr.type = RKNN_TENSOR_UINT8;
+  strcpy(input_attr.name, "images");
+
+  for (int b = 0; b < YOLO_FIXTURE_BRANCHES; b++) {
+    rknn_tensor_attr *attr = &output_attrs[b];
+    int grid = fx->grid[b];
+
+    memset(attr, 0, sizeof(rknn_tensor_attr));
+    attr->index = b;
+    attr->dims[0] = 1;
+    if (c2 > 0) {
+      outputs[b] = yolo_fixture_nc1hwc2(fx, b, c2);
+      attr->n_dims = 5;
+      attr->dims[1] = (channels + c2 - 1) / c2;
+      attr->dims[2] = grid;
+      attr->dims[3] = grid;
+      attr->dims[4] = c2;
+      attr->fmt = RKNN_TENSOR_NC1HWC2;
+    } else {
+      outputs[b] = fx->nhwc[b];
+      attr->n_dims = 4;
+      attr->dims[1] = grid;
+      attr->dims[2] = grid;
+      attr->dims[3] = channels;
+      attr->fmt = RKNN_TENSOR_NHWC;
+    }
+    attr->n_elems = grid * grid * channels;
+    attr->size = attr->size_with_stride = outputs[b].size();
+    attr->type = RKNN_TENSOR_INT8;
+    attr->qnt_type = RKNN_TENSOR_QNT_AFFINE_ASYMMETRIC;
+    attr->zp = fx->qnts[b].zp;
+    attr->scale = fx->qnts[b].scale;
+    snprintf(attr->name, sizeof(attr->name), "output%d", b);
+
+    memset(&mems[b], 0, sizeof(rknn_tensor_mem));
+    mems[b].virt_addr = outputs[b].data();
+    mems[b].size = outputs[b].size();
+    mem_ptrs[b] = &mems[b];
+  }
+
+  FILE *fp = infer_backend_mock_record_open(path, 1, &input_attr,
+                                            YOLO_FIXTURE_BRANCHES,
+                                            output_attrs);
+  if (!fp) {
+    return -1;
+  }
+  int ret = infer_backend_mock_record_frame(fp, YOLO_FIXTURE_BRANCHES,
+                                            output_attrs, mem_ptrs);
+  fclose(fp);
+
+  return ret;
+}
+
+/* a label file of class_num names for rknn_runner_load_labels */
+static int yolo_fixture_write_labels(const char *path, int class_num) {
+  FILE *fp = fopen(path, "w");
+  if (!fp) {
+    return -1;
+  }
+  for (int i = 0; i < class_num; i++) {
+    fprintf(fp, "class%d\n", i);
+  }
+  fclose(fp);
+
+  return 0;
+}
+
+#endif /*__YOLO_FIXTURE_RECORD_H__*/